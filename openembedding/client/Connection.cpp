@@ -1,13 +1,21 @@
 #include "Connection.h"
 #include "EmbeddingDumpOperator.h"
+#include "EmbeddingHotKeyOperator.h"
 #include "EmbeddingInitOperator.h"
+#include "EmbeddingLatencyOperator.h"
 #include "EmbeddingLoadOperator.h"
+#include "EmbeddingMemoryOperator.h"
+#include "EmbeddingMigrateOperator.h"
+#include "EmbeddingDirectLoadOperator.h"
 #include "EmbeddingPullOperator.h"
 #include "EmbeddingPushOperator.h"
+#include "EmbeddingPushPullOperator.h"
 #include "EmbeddingRestoreOperator.h"
 #include "EmbeddingStorage.h"
 #include "EmbeddingStoreOperator.h"
+#include "CheckpointFlusher.h"
 #include "PersistManager.h"
+#include "LockProfiler.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -15,10 +23,16 @@ namespace embedding {
 
 using ps::Operator;
 REGISTER_OPERATOR(embedding, EmbeddingDumpOperator);
+REGISTER_OPERATOR(embedding, EmbeddingHotKeyOperator);
 REGISTER_OPERATOR(embedding, EmbeddingInitOperator);
+REGISTER_OPERATOR(embedding, EmbeddingLatencyOperator);
 REGISTER_OPERATOR(embedding, EmbeddingLoadOperator);
+REGISTER_OPERATOR(embedding, EmbeddingMemoryOperator);
+REGISTER_OPERATOR(embedding, EmbeddingMigrateOperator);
+REGISTER_OPERATOR(embedding, EmbeddingDirectLoadOperator);
 REGISTER_OPERATOR(embedding, EmbeddingPullOperator);
 REGISTER_OPERATOR(embedding, EmbeddingPushOperator);
+REGISTER_OPERATOR(embedding, EmbeddingPushPullOperator);
 REGISTER_OPERATOR(embedding, EmbeddingRestoreOperator);
 REGISTER_OPERATOR(embedding, EmbeddingStorageOperator);
 REGISTER_OPERATOR(embedding, EmbeddingStoreOperator);
@@ -45,6 +59,7 @@ ps::Status Connection::create_operator(int32_t storage_id, const std::string& ke
     handler_id = reader.table().key_to_hdl.at(key);
     ps::OperatorDescriptor opd = reader.table().op_descs.at(handler_id);
     op_config.load(opd.config_str);
+    op_config.node()["storage_id"] = storage_id;
     op = ps::OperatorFactory::singleton().create(opd.lib_name, opd.op_name, op_config);
     if (op == nullptr) {
         RETURN_WARNING_STATUS(ps::Status::InvalidID("operator not found"));
@@ -84,22 +99,51 @@ RpcConnection::RpcConnection(const EnvConfig& env) {
     _master_client->tree_node_add(_model_lock_path);
 
     VariableAsyncTaskThreadPool::singleton().initialize(_env.server.server_concurrency);
+    if (_env.server.lock_profile) {
+        LockProfiler::singleton().set_enabled(true);
+        if (_env.server.report_interval > 0) {
+            _lock_reporter = true;
+            _lock_report_monitor = pico_monitor().submit("lock_profile_reporter", 0,
+                  static_cast<uint64_t>(_env.server.report_interval * 1000), [] {
+                SLOG(INFO) << "======== LOCK CONTENTION ======\n" << LockProfiler::singleton().report();
+            });
+        }
+    }
     if (!_env.server.pmem_pool_root_path.empty()) {
         SLOG(INFO) << "using pmem with dram cache size: " << _env.server.cache_size << "MB";
         PersistManager::singleton().initialize(
               _env.server.pmem_pool_root_path + "/rank" + std::to_string(_rpc->global_rank()));
         PersistManager::singleton().dynamic_cache.set_cache_size((_env.server.cache_size << 20) / 3 * 2);
         PersistManager::singleton().reserved_cache.set_cache_size((_env.server.cache_size << 20) / 3);
+        PersistManager::singleton().cache_policy = _env.server.cache_policy;
+        if (_env.server.checkpoint_flush_bandwidth) {
+            CheckpointFlusher::singleton().initialize(_env.server.checkpoint_flush_bandwidth << 20);
+        }
+        if (_env.server.cache_budget_interval > 0) {
+            _cache_budget = true;
+            _cache_budget_monitor = pico_monitor().submit("cache_budget_controller", 0,
+                  static_cast<uint64_t>(_env.server.cache_budget_interval * 1000), [] {
+                PersistManager& manager = PersistManager::singleton();
+                manager.cache_budgets.redistribute(manager.dynamic_cache.cache_size());
+            });
+        }
     }
 }
 
 RpcConnection::~RpcConnection() {
+    if (_lock_reporter) {
+        pico_monitor().destroy_with_additional_run(_lock_report_monitor).wait();
+    }
+    if (_cache_budget) {
+        pico_monitor().destroy_with_additional_run(_cache_budget_monitor).wait();
+    }
     _client->finalize();
     _client.reset();
     _rpc_client.reset();
     _rpc->finalize();
     _master_client->finalize();
     _master_client.reset();
+    CheckpointFlusher::singleton().finalize();
     VariableAsyncTaskThreadPool::singleton().finalize();
 }
 
@@ -158,6 +202,14 @@ ps::Status RpcConnection::create_storage(const std::map<int32_t, std::vector<int
     core::Configure op_config;
     op_config.node()["update_early_return"] = _env.server.update_early_return;
     op_config.node()["compress_algorithm"] = _env.server.message_compress; 
+    op_config.node()["push_gradient_codec"] = _env.server.push_gradient_codec;
+    op_config.node()["push_gradient_topk"] = _env.server.push_gradient_topk;
+    op_config.node()["push_error_feedback"] = _env.server.push_error_feedback;
+    op_config.node()["push_error_feedback_rows"] = _env.server.push_error_feedback_rows;
+    op_config.node()["pull_wire_precision"] = _env.server.pull_wire_precision;
+    op_config.node()["request_index_codec"] = _env.server.request_index_codec;
+    op_config.node()["sort_request_indices"] = _env.server.sort_request_indices;
+    op_config.node()["hot_key_top_k"] = _env.server.hot_key_top_k;
     config.node()["op_config"] = op_config.node();
 
     int timeout = _env.server.recv_timeout;
@@ -172,6 +224,8 @@ ps::Status RpcConnection::create_storage(const std::map<int32_t, std::vector<int
             "EmbeddingPullOperator", op_config, storage_id, handler_id, timeout));
     CHECK_STATUS_RETURN(_client->register_handler("push", "embedding",
             "EmbeddingPushOperator", op_config, storage_id, handler_id, timeout));
+    CHECK_STATUS_RETURN(_client->register_handler("push_pull", "embedding",
+            "EmbeddingPushPullOperator", op_config, storage_id, handler_id, timeout));
     CHECK_STATUS_RETURN(_client->register_handler("store", "embedding",
             "EmbeddingStoreOperator", op_config, storage_id, handler_id, timeout));
     CHECK_STATUS_RETURN(_client->register_handler("init", "embedding",
@@ -180,6 +234,16 @@ ps::Status RpcConnection::create_storage(const std::map<int32_t, std::vector<int
             "EmbeddingDumpOperator", op_config, storage_id, handler_id, timeout));
     CHECK_STATUS_RETURN(_client->register_handler("load", "embedding",
             "EmbeddingLoadOperator", op_config, storage_id, handler_id, timeout));
+    CHECK_STATUS_RETURN(_client->register_handler("hot_key", "embedding",
+            "EmbeddingHotKeyOperator", op_config, storage_id, handler_id, timeout));
+    CHECK_STATUS_RETURN(_client->register_handler("migrate", "embedding",
+            "EmbeddingMigrateOperator", op_config, storage_id, handler_id, timeout));
+    CHECK_STATUS_RETURN(_client->register_handler("direct_load", "embedding",
+            "EmbeddingDirectLoadOperator", op_config, storage_id, handler_id, timeout));
+    CHECK_STATUS_RETURN(_client->register_handler("memory", "embedding",
+            "EmbeddingMemoryOperator", op_config, storage_id, handler_id, timeout));
+    CHECK_STATUS_RETURN(_client->register_handler("latency", "embedding",
+            "EmbeddingLatencyOperator", op_config, storage_id, handler_id, timeout));
     return ps::Status();
 }
 
@@ -194,10 +258,18 @@ ps::Status RpcConnection::create_storage_handler(int32_t storage_id, std::unique
     create_handler_pool(storage_id, "read_only_pull", storage->_read_only_pull_handler);
     create_handler_pool(storage_id, "pull", storage->_pull_handler);
     create_handler_pool(storage_id, "push", storage->_push_handler);
+    create_handler_pool(storage_id, "push_pull", storage->_push_pull_handler);
     create_handler_pool(storage_id, "store", storage->_store_handler);
     create_handler_pool(storage_id, "init", storage->_init_handler);
     create_handler_pool(storage_id, "dump", storage->_dump_handler);
     create_handler_pool(storage_id, "load", storage->_load_handler);
+    create_handler_pool(storage_id, "hot_key", storage->_hot_key_handler);
+    create_handler_pool(storage_id, "migrate", storage->_migrate_handler);
+    create_handler_pool(storage_id, "direct_load", storage->_direct_load_handler);
+    create_handler_pool(storage_id, "memory", storage->_memory_handler);
+    create_handler_pool(storage_id, "latency", storage->_latency_handler);
+    storage->_placement = SharedShardPlacement::storage(storage_id);
+    storage->_pull_caches->initialize(_env.worker.pull_cache_items, _env.worker.pull_cache_staleness);
     return ps::Status();
 }
 
@@ -134,6 +134,10 @@ private:
     std::unique_ptr<core::RpcClient> _rpc_client;
     std::unique_ptr<ps::Client> _client;
     EnvConfig _env;
+    bool _lock_reporter = false;
+    size_t _lock_report_monitor = 0;
+    bool _cache_budget = false;
+    size_t _cache_budget_monitor = 0;
 };
 
 }
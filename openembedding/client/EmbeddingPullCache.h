@@ -0,0 +1,142 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_PULL_CACHE_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_PULL_CACHE_H
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <pico-core/RWSpinLock.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Rows of a variable pulled by this worker, tagged with the batch id they were pulled for.
+// A row pulled for batch b is served to the pulls of batch b to b + staleness, so the
+// weights seen by training are at most staleness batches old. Direct mapped, a key only
+// replaces the key in its slot. Rows are dropped when the version of the storage changes.
+class EmbeddingPullCache {
+public:
+    EmbeddingPullCache(size_t num_items, size_t line_size, int64_t staleness)
+        : _line_size(line_size), _staleness(staleness) {
+        size_t capacity = 1;
+        while (capacity < num_items) {
+            capacity <<= 1;
+        }
+        _mask = capacity - 1;
+        _slots.resize(capacity);
+        _rows.resize(capacity * line_size);
+    }
+
+    EmbeddingPullCache(const EmbeddingPullCache&) = delete;
+    EmbeddingPullCache& operator=(const EmbeddingPullCache&) = delete;
+
+    // Copies the row of key to weights if it is fresh for batch_id.
+    bool get(uint64_t key, int64_t batch_id, uint64_t version, char* weights) {
+        _lookups.fetch_add(1, std::memory_order_relaxed);
+        size_t slot = this->slot(key);
+        core::shared_lock_guard<core::RWSpinLock> guard(_lock);
+        const Slot& item = _slots[slot];
+        if (!item.valid || item.key != key || item.version != version ||
+              batch_id < item.batch_id || batch_id - item.batch_id > _staleness) {
+            return false;
+        }
+        memcpy(weights, _rows.data() + slot * _line_size, _line_size);
+        _hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Rows of n keys pulled for batch_id.
+    void put(const uint64_t* keys, size_t n, int64_t batch_id, uint64_t version, const char* weights) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        for (size_t i = 0; i < n; ++i) {
+            size_t slot = this->slot(keys[i]);
+            Slot& item = _slots[slot];
+            if (item.valid && item.key == keys[i] && item.version == version && item.batch_id > batch_id) {
+                continue; // keep the newer row
+            }
+            item.valid = true;
+            item.key = keys[i];
+            item.batch_id = batch_id;
+            item.version = version;
+            memcpy(_rows.data() + slot * _line_size, weights + i * _line_size, _line_size);
+        }
+    }
+
+    size_t line_size()const {
+        return _line_size;
+    }
+
+    uint64_t hits()const {
+        return _hits.load(std::memory_order_relaxed);
+    }
+
+    uint64_t lookups()const {
+        return _lookups.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        bool valid = false;
+        uint64_t key = 0;
+        int64_t batch_id = 0;
+        uint64_t version = 0;
+    };
+
+    size_t slot(uint64_t key)const {
+        return (key * 0x9E3779B97F4A7C15ull >> 32) & _mask;
+    }
+
+    size_t _line_size = 0;
+    int64_t _staleness = 0;
+    size_t _mask = 0;
+    core::RWSpinLock _lock;
+    std::vector<Slot> _slots;
+    std::vector<char> _rows;
+    std::atomic<uint64_t> _hits = {0};
+    std::atomic<uint64_t> _lookups = {0};
+};
+
+// Pull caches of the variables of a storage, disabled if num_items is 0.
+class EmbeddingPullCaches {
+public:
+    void initialize(size_t num_items, int64_t staleness) {
+        _num_items = num_items;
+        _staleness = staleness;
+    }
+
+    std::shared_ptr<EmbeddingPullCache> get(uint32_t variable_id, size_t line_size) {
+        if (_num_items == 0) {
+            return nullptr;
+        }
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::shared_ptr<EmbeddingPullCache>& cache = _caches[variable_id];
+        if (!cache) {
+            cache = std::make_shared<EmbeddingPullCache>(_num_items, line_size, _staleness);
+        }
+        return cache;
+    }
+
+    uint64_t version()const {
+        return _version.load(std::memory_order_acquire);
+    }
+
+    // Called when the weights are changed other than by training, e.g. loaded.
+    void invalidate() {
+        _version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+private:
+    size_t _num_items = 0;
+    int64_t _staleness = 0;
+    std::atomic<uint64_t> _version = {0};
+    core::RWSpinLock _lock;
+    std::unordered_map<uint32_t, std::shared_ptr<EmbeddingPullCache>> _caches;
+};
+
+}
+}
+}
+
+#endif
@@ -1,5 +1,8 @@
 #include "EmbeddingVariableHandle.h"
 
+#include <chrono>
+#include <thread>
+
 namespace paradigm4 {
 namespace pico {
 namespace embedding {
@@ -65,6 +68,19 @@ HandlerWaiterDone<Handler> handler_waiter_done(HandlerPointer<Handler>&& pointer
     return HandlerWaiterDone<Handler>(std::move(pointer));
 }
 
+// Requests rejected by servers after a shard migration are resent with the new placement.
+// A resent push keeps its push_id, so the servers that accepted it do not apply it again.
+// Pushes to a shard being switched are rejected until INSTALL, they are resent every
+// MIGRATE_WAIT_MS after the first retry.
+constexpr int PLACEMENT_RETRY = 50;
+// Poll interval of copy_shard before the source begins the copy at a store.
+constexpr int MIGRATE_WAIT_MS = 100;
+
+static void wait_placement(int retry) {
+    if (retry) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(MIGRATE_WAIT_MS));
+    }
+}
 
 HandlerWaiter EmbeddingVariableHandle::init_config(const core::Configure& config)const {
     SCHECK(!_read_only);
@@ -94,6 +110,9 @@ HandlerWaiter EmbeddingVariableHandle::clear_weights() {
     items->meta = _meta;
     items->clear_weights = true;
     SLOG(INFO) << "variable " << _variable_id << " clear_weights";
+    if (_pull_caches) {
+        _pull_caches->invalidate();
+    }
 
     HandlerPointer<ps::PushHandler> handler(_init_handler);
     if (handler) {
@@ -105,6 +124,13 @@ HandlerWaiter EmbeddingVariableHandle::clear_weights() {
 // predictor controller
 HandlerWaiter EmbeddingVariableHandle::pull_weights(const uint64_t* indices, size_t n, int64_t batch_id)const {
     VTIMER(1, embedding_variable, pull_weights, ms);
+    if (_pull_cache && !_read_only) {
+        return cached_pull_weights(indices, n, batch_id);
+    }
+    return pull_servers(indices, n, batch_id);
+}
+
+HandlerWaiter EmbeddingVariableHandle::pull_servers(const uint64_t* indices, size_t n, int64_t batch_id)const {
     core::vector<EmbeddingPullItems> items(1);
     items[0].variable_id = _variable_id;
     items[0].meta = _meta;
@@ -115,6 +141,7 @@ HandlerWaiter EmbeddingVariableHandle::pull_weights(const uint64_t* indices, siz
     ObjectPool<std::unique_ptr<ps::UDFHandler>>* handler_pool = _pull_handler;
     if (_read_only) {
         handler_pool = _read_only_pull_handler;
+        items[0].hot_keys = _hot_keys;
     }
     ps::UDFHandler* pull_handler = handler_pool->acquire().release();
     if (!pull_handler) {
@@ -123,11 +150,20 @@ HandlerWaiter EmbeddingVariableHandle::pull_weights(const uint64_t* indices, siz
     }
     pull_handler->call(&items, _timeout);
 
-    return [this, handler_pool, pull_handler](void* result) {
+    return [this, handler_pool, pull_handler, items](void* result) mutable {
         core::vector<EmbeddingPullResults> block_items(1);
         block_items[0] = *static_cast<EmbeddingPullResults*>(result);
         pull_handler->set_wait_result(&block_items);
         ps::Status status = pull_handler->wait();
+        for (int i = 0; i < PLACEMENT_RETRY && status.IsNoReplica(); ++i) {
+            wait_placement(i);
+            status = _storage->refresh_placement();
+            if (status.ok()) {
+                pull_handler->call(&items, _timeout);
+                pull_handler->set_wait_result(&block_items);
+                status = pull_handler->wait();
+            }
+        }
         if (block_items[0].should_persist) {
             _should_persist->store(true, std::memory_order_relaxed);
         }
@@ -136,6 +172,68 @@ HandlerWaiter EmbeddingVariableHandle::pull_weights(const uint64_t* indices, siz
     };
 }
 
+// Hit rows are copied out at once, the missed rows are pulled and then scattered with them.
+// The hits and lookups of all the workers are reported as accumulators.
+HandlerWaiter EmbeddingVariableHandle::cached_pull_weights(const uint64_t* indices, size_t n, int64_t batch_id)const {
+    static thread_local core::Accumulator<core::SumAggregator<size_t>> acc_lookups("pull_cache_lookups");
+    static thread_local core::Accumulator<core::SumAggregator<size_t>> acc_hits("pull_cache_hits");
+    struct CachedPull {
+        uint64_t version = 0;
+        std::vector<size_t> hit_positions;
+        std::vector<char> hit_weights;
+        std::vector<size_t> miss_positions;
+        std::vector<uint64_t> miss_indices;
+        std::vector<char> miss_weights;
+    };
+    size_t line_size = _pull_cache->line_size();
+    auto pull = std::make_shared<CachedPull>();
+    pull->version = _pull_caches->version();
+    pull->hit_weights.resize(n * line_size);
+    for (size_t i = 0; i < n; ++i) {
+        char* weights = pull->hit_weights.data() + pull->hit_positions.size() * line_size;
+        if (_pull_cache->get(indices[i], batch_id, pull->version, weights)) {
+            pull->hit_positions.push_back(i);
+        } else {
+            pull->miss_positions.push_back(i);
+            pull->miss_indices.push_back(indices[i]);
+        }
+    }
+    acc_lookups.write(n);
+    acc_hits.write(pull->hit_positions.size());
+
+    std::shared_ptr<HandlerWaiter> miss_waiter;
+    if (!pull->miss_indices.empty()) {
+        miss_waiter = std::make_shared<HandlerWaiter>(
+              pull_servers(pull->miss_indices.data(), pull->miss_indices.size(), batch_id));
+    }
+    std::shared_ptr<EmbeddingPullCache> cache = _pull_cache;
+    return [pull, miss_waiter, cache, line_size, batch_id](void* result) {
+        EmbeddingPullResults& results = *static_cast<EmbeddingPullResults*>(result);
+        if (miss_waiter) {
+            pull->miss_weights.resize(pull->miss_indices.size() * line_size);
+            EmbeddingPullResults miss_results = results;
+            miss_results.indices = pull->miss_indices.data();
+            miss_results.n = pull->miss_indices.size();
+            miss_results.weights = pull->miss_weights.data();
+            ps::Status status = miss_waiter->wait(&miss_results);
+            if (!status.ok()) {
+                return status;
+            }
+            for (size_t i = 0; i < pull->miss_positions.size(); ++i) {
+                memcpy(results.weights + pull->miss_positions[i] * line_size,
+                      pull->miss_weights.data() + i * line_size, line_size);
+            }
+            cache->put(pull->miss_indices.data(), pull->miss_indices.size(),
+                  batch_id, pull->version, pull->miss_weights.data());
+        }
+        for (size_t i = 0; i < pull->hit_positions.size(); ++i) {
+            memcpy(results.weights + pull->hit_positions[i] * line_size,
+                  pull->hit_weights.data() + i * line_size, line_size);
+        }
+        return ps::Status();
+    };
+}
+
 HandlerWaiter EmbeddingVariableHandle::push_gradients(const uint64_t* indices, size_t n, const char* gradients)const {
     VTIMER(1, embedding_variable, push_gradients, ms);
     SCHECK(!_read_only);
@@ -146,14 +244,83 @@ HandlerWaiter EmbeddingVariableHandle::push_gradients(const uint64_t* indices, s
     items[0].indices = indices;
     items[0].n = n;
     items[0].gradients = gradients;
+    items[0].push_id = EmbeddingPushOperator::new_push_id();
 
-    HandlerPointer<ps::UDFHandler> handler(_push_handler);
-    if (handler) {
-        handler->call(&items, _timeout);
+    ObjectPool<std::unique_ptr<ps::UDFHandler>>* handler_pool = _push_handler;
+    ps::UDFHandler* handler = handler_pool->acquire().release();
+    if (!handler) {
+        SLOG(WARNING) << "no push_handler";
+        return [](void*) { return ps::Status::Error("no push_handler"); };
     }
-    return handler.done_waiter();
+    handler->call(&items, _timeout);
+
+    return [this, handler_pool, handler, items](void*) mutable {
+        ps::Status status = handler->wait();
+        for (int i = 0; i < PLACEMENT_RETRY && status.IsNoReplica(); ++i) {
+            wait_placement(i);
+            status = _storage->refresh_placement();
+            if (status.ok()) {
+                handler->call(&items, _timeout);
+                status = handler->wait();
+            }
+        }
+        handler_pool->release(std::unique_ptr<ps::UDFHandler>(handler));
+        if (!status.ok()) {
+            SLOG(WARNING) << status.ToString();
+        }
+        return status;
+    };
 }
 
+HandlerWaiter EmbeddingVariableHandle::push_pull(const uint64_t* push_indices, size_t push_n,
+      const char* gradients, const uint64_t* pull_indices, size_t pull_n, int64_t batch_id)const {
+    VTIMER(1, embedding_variable, push_pull, ms);
+    SCHECK(!_read_only);
+    
+    EmbeddingPushPullItems items;
+    items.push.resize(1);
+    items.push[0].variable_id = _variable_id;
+    items.push[0].meta = _meta;
+    items.push[0].indices = push_indices;
+    items.push[0].n = push_n;
+    items.push[0].gradients = gradients;
+    items.push[0].push_id = EmbeddingPushOperator::new_push_id();
+    items.pull.resize(1);
+    items.pull[0].variable_id = _variable_id;
+    items.pull[0].meta = _meta;
+    items.pull[0].indices = pull_indices;
+    items.pull[0].n = pull_n;
+    items.pull[0].batch_id = batch_id;
+
+    ObjectPool<std::unique_ptr<ps::UDFHandler>>* handler_pool = _push_pull_handler;
+    ps::UDFHandler* handler = handler_pool->acquire().release();
+    if (!handler) {
+        SLOG(WARNING) << "no push_pull_handler";
+        return [](void*) { return ps::Status::Error("no push_pull_handler"); };
+    }
+    handler->call(&items, _timeout);
+
+    return [this, handler_pool, handler, items](void* result) mutable {
+        core::vector<EmbeddingPullResults> block_items(1);
+        block_items[0] = *static_cast<EmbeddingPullResults*>(result);
+        handler->set_wait_result(&block_items);
+        ps::Status status = handler->wait();
+        for (int i = 0; i < PLACEMENT_RETRY && status.IsNoReplica(); ++i) {
+            wait_placement(i);
+            status = _storage->refresh_placement();
+            if (status.ok()) {
+                handler->call(&items, _timeout);
+                handler->set_wait_result(&block_items);
+                status = handler->wait();
+            }
+        }
+        if (block_items[0].should_persist) {
+            _should_persist->store(true, std::memory_order_relaxed);
+        }
+        handler_pool->release(std::unique_ptr<ps::UDFHandler>(handler));
+        return status;
+    };
+}
 
 EmbeddingVariableHandle EmbeddingStorageHandler::variable(uint32_t variable_id, EmbeddingVariableMeta meta) {
     EmbeddingVariableHandle variable;
@@ -164,14 +331,19 @@ EmbeddingVariableHandle EmbeddingStorageHandler::variable(uint32_t variable_id,
     variable._read_only_pull_handler = &_read_only_pull_handler;
     variable._pull_handler = &_pull_handler;
     variable._push_handler = &_push_handler;
+    variable._push_pull_handler = &_push_pull_handler;
     variable._init_handler = &_init_handler;
+    variable._hot_keys = _hot_keys.get();
+    variable._storage = this;
+    variable._pull_caches = _pull_caches.get();
+    variable._pull_cache = _pull_caches->get(variable_id, variable._meta.line_size());
     return variable;
 }
 
-HandlerWaiter EmbeddingStorageHandler::update_weights() {
+HandlerWaiter EmbeddingStorageHandler::update_weights(int worker_num) {
     HandlerPointer<ps::UDFHandler> handler(&_store_handler);
     if (handler) {
-        handler->call(&_timeout, _timeout);
+        handler->call(&worker_num, _timeout);
     }
     return handler.done_waiter();
 }
@@ -192,6 +364,7 @@ HandlerWaiter EmbeddingStorageHandler::load_storage(const URIConfig& uri, size_t
 
     bool restore_model = false;
     uri.config().get_val("restore_model", restore_model);
+    _pull_caches->invalidate();
     HandlerPointer<ps::LoadHandler> handler(&_load_handler);
     if (handler) {
         if (restore_model) {
@@ -203,6 +376,32 @@ HandlerWaiter EmbeddingStorageHandler::load_storage(const URIConfig& uri, size_t
     return handler.done_waiter();
 }
 
+HandlerWaiter EmbeddingStorageHandler::direct_load_storage(const URIConfig& uri, size_t threads) {
+    ps::UDFHandler* handler = _direct_load_handler.acquire().release();
+    if (!handler) {
+        SLOG(WARNING) << "no direct_load_handler";
+        return [](void*) { return ps::Status::Error("no direct_load_handler"); };
+    }
+    _pull_caches->invalidate();
+    auto items = std::make_shared<EmbeddingDirectLoadItems>();
+    items->uri = uri.uri();
+    items->threads = threads;
+    handler->call(items.get(), _timeout);
+    return [this, handler, items, uri](void*) {
+        EmbeddingDirectLoadItems result;
+        handler->set_wait_result(&result);
+        ps::Status status = handler->wait();
+        _direct_load_handler.release(std::unique_ptr<ps::UDFHandler>(handler));
+        if (status.ok() && result.relay) {
+            status = load_storage(uri).wait();
+        }
+        if (!status.ok()) {
+            SLOG(WARNING) << status.ToString();
+        }
+        return status;
+    };
+}
+
 // predictor controller
 HandlerWaiter EmbeddingStorageHandler::dump_storage(const URIConfig& uri, size_t file_number) {
     std::string hadoop_bin;
@@ -215,7 +414,128 @@ HandlerWaiter EmbeddingStorageHandler::dump_storage(const URIConfig& uri, size_t
     return handler.done_waiter();
 }
 
+HandlerWaiter EmbeddingStorageHandler::replicate_hot_keys(size_t top_k) {
+    ps::UDFHandler* handler = _hot_key_handler.acquire().release();
+    if (!handler) {
+        SLOG(WARNING) << "no hot_key_handler";
+        return [](void*) { return ps::Status::Error("no hot_key_handler"); };
+    }
+    auto hot_keys = std::make_shared<EmbeddingHotKeys>();
+    hot_keys->top_k = top_k;
+    handler->call(hot_keys.get(), _timeout);
+    return [this, handler, hot_keys, top_k](void*) {
+        EmbeddingHotKeys collected;
+        handler->set_wait_result(&collected);
+        ps::Status status = handler->wait();
+        if (status.ok()) {
+            collected.merge(top_k);
+            _hot_keys_replicated->store(!collected.empty(), std::memory_order_relaxed);
+            if (!collected.empty()) {
+                collected.install = true;
+                handler->call(&collected, _timeout);
+                status = handler->wait();
+            }
+        }
+        _hot_key_handler.release(std::unique_ptr<ps::UDFHandler>(handler));
+        if (!status.ok()) {
+            SLOG(WARNING) << status.ToString();
+        }
+        return status;
+    };
+}
 
+ps::Status EmbeddingStorageHandler::migrate_step(EmbeddingMigrateItems& items, EmbeddingMigrateItems& result) {
+    HandlerPointer<ps::UDFHandler> handler(&_migrate_handler);
+    if (handler) {
+        handler->call(&items, _timeout);
+        handler->set_wait_result(&result);
+    }
+    return handler.done_waiter().wait();
+}
+
+ps::Status EmbeddingStorageHandler::refresh_placement() {
+    EmbeddingMigrateItems items, result;
+    items.step = EmbeddingMigrateItems::QUERY;
+    CHECK_STATUS_RETURN(migrate_step(items, result));
+    _placement->update(result.placement);
+    return ps::Status();
+}
+
+ps::Status EmbeddingStorageHandler::memory_usage(EmbeddingStorageMemory& result) {
+    EmbeddingStorageMemory items;
+    HandlerPointer<ps::UDFHandler> handler(&_memory_handler);
+    if (handler) {
+        handler->call(&items, _timeout);
+        handler->set_wait_result(&result);
+    }
+    return handler.done_waiter().wait();
+}
+
+ps::Status EmbeddingStorageHandler::latencies(EmbeddingLatencies& result) {
+    EmbeddingLatencies items;
+    HandlerPointer<ps::UDFHandler> handler(&_latency_handler);
+    if (handler) {
+        handler->call(&items, _timeout);
+        handler->set_wait_result(&result);
+    }
+    return handler.done_waiter().wait();
+}
+
+HandlerWaiter EmbeddingStorageHandler::copy_shard(int32_t shard_id, int from, int to) {
+    return [this, shard_id, from, to](void*) {
+        SLOG(INFO) << "copy shard " << shard_id << " from node " << from << " to node " << to;
+        EmbeddingMigrateItems read;
+        read.step = EmbeddingMigrateItems::READ;
+        read.node_id = from;
+        read.shard_id = shard_id;
+        EmbeddingMigrateItems write;
+        write.step = EmbeddingMigrateItems::WRITE;
+        write.node_id = to;
+        write.shard_id = shard_id;
+        EmbeddingMigrateItems result;
+        while (true) {
+            CHECK_STATUS_RETURN(migrate_step(read, result));
+            read.start = false;
+            if (result.finished) {
+                break;
+            }
+            if (result.blocks.empty()) {
+                // the source lists the rows at the next store
+                std::this_thread::sleep_for(std::chrono::milliseconds(MIGRATE_WAIT_MS));
+                continue;
+            }
+            read.offset = result.offset;
+            write.blocks = std::move(result.blocks);
+            CHECK_STATUS_RETURN(migrate_step(write, result));
+        }
+        return ps::Status();
+    };
+}
+
+HandlerWaiter EmbeddingStorageHandler::switch_shard(int32_t shard_id, int from, int to) {
+    return [this, shard_id, from, to](void*) {
+        SLOG(INFO) << "switch shard " << shard_id << " from node " << from << " to node " << to;
+        EmbeddingMigrateItems items, result;
+        items.step = EmbeddingMigrateItems::SYNC;
+        items.node_id = from;
+        items.shard_id = shard_id;
+        CHECK_STATUS_RETURN(migrate_step(items, result));
+
+        items.step = EmbeddingMigrateItems::WRITE;
+        items.node_id = to;
+        items.blocks = std::move(result.blocks);
+        CHECK_STATUS_RETURN(migrate_step(items, result));
+
+        CHECK_STATUS_RETURN(refresh_placement());
+        items.step = EmbeddingMigrateItems::INSTALL;
+        items.blocks.clear();
+        items.placement = _placement->get();
+        items.placement.move(shard_id, from, to);
+        CHECK_STATUS_RETURN(migrate_step(items, result));
+        _placement->update(items.placement);
+        return ps::Status();
+    };
+}
 
 }
 }
@@ -8,11 +8,18 @@
 
 #include "Meta.h"
 #include "ObjectPool.h"
+#include "EmbeddingPullCache.h"
 
 #include "EmbeddingPullOperator.h"
 #include "EmbeddingPushOperator.h"
+#include "EmbeddingPushPullOperator.h"
 #include "EmbeddingLoadOperator.h"
 #include "EmbeddingDumpOperator.h"
+#include "EmbeddingHotKeyOperator.h"
+#include "EmbeddingMigrateOperator.h"
+#include "EmbeddingDirectLoadOperator.h"
+#include "EmbeddingMemoryOperator.h"
+#include "EmbeddingLatencyOperator.h"
 #include "EmbeddingStoreOperator.h"
 
 namespace paradigm4 {
@@ -49,6 +56,8 @@ private:
     std::function<ps::Status(void*)> _waiter;
 };
 
+class EmbeddingStorageHandler;
+
 // not handler, just a handle of storage handler.
 class EmbeddingVariableHandle {
 public:
@@ -67,10 +76,16 @@ public:
     HandlerWaiter clear_weights();
 
     // predictor controller
+    // Training pulls are served from the pull cache if enabled, only the missed rows are pulled.
     HandlerWaiter pull_weights(const uint64_t* indices, size_t n, int64_t batch_id)const;
 
     HandlerWaiter push_gradients(const uint64_t* indices, size_t n, const char* gradients)const;
 
+    // Push gradients of batch_id - 1 and pull weights of batch_id in one request.
+    // Wait with EmbeddingPullResults after update_weights of batch_id - 1.
+    HandlerWaiter push_pull(const uint64_t* push_indices, size_t push_n, const char* gradients,
+          const uint64_t* pull_indices, size_t pull_n, int64_t batch_id)const;
+
     int _timeout = -1;
     bool _read_only = false;
     uint32_t _variable_id = 0;
@@ -79,9 +94,19 @@ public:
     ObjectPool<std::unique_ptr<ps::UDFHandler>>* _read_only_pull_handler = nullptr;
     ObjectPool<std::unique_ptr<ps::UDFHandler>>* _pull_handler = nullptr;
     ObjectPool<std::unique_ptr<ps::UDFHandler>>* _push_handler = nullptr;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>>* _push_pull_handler = nullptr;
     ObjectPool<std::unique_ptr<ps::PushHandler>>* _init_handler = nullptr;
+    HotKeyDirectory* _hot_keys = nullptr;
+    EmbeddingStorageHandler* _storage = nullptr;
+    EmbeddingPullCaches* _pull_caches = nullptr;
+    std::shared_ptr<EmbeddingPullCache> _pull_cache;
 
     std::atomic<bool>* _should_persist;
+
+private:
+    HandlerWaiter pull_servers(const uint64_t* indices, size_t n, int64_t batch_id)const;
+
+    HandlerWaiter cached_pull_weights(const uint64_t* indices, size_t n, int64_t batch_id)const;
 };
 
 class EmbeddingStorageHandler {
@@ -95,23 +120,69 @@ public:
 
     EmbeddingVariableHandle variable(uint32_t variable_id, EmbeddingVariableMeta meta);
 
-    HandlerWaiter update_weights();
+    // Called by every worker, the weights are updated after all the workers called it.
+    HandlerWaiter update_weights(int worker_num);
 
     // predictor controller
     HandlerWaiter load_storage(const URIConfig& uri, size_t server_concurency = 4);
 
+    // Servers read the files on shared storage by themselves with threads each,
+    // fall back to load_storage if the shard number changed.
+    HandlerWaiter direct_load_storage(const URIConfig& uri, size_t threads);
+
     // predictor controller
     HandlerWaiter dump_storage(const URIConfig& uri, size_t file_number);
 
+    // Replicate the top_k most pulled keys of each variable to all servers for read only pulls.
+    // top_k 0 only refreshes the rows of the replicated keys.
+    HandlerWaiter replicate_hot_keys(size_t top_k);
+
+    // The last replicate_hot_keys of this worker found replicated keys.
+    bool hot_keys_replicated()const {
+        return _hot_keys_replicated->load(std::memory_order_relaxed);
+    }
+
+    // Copy the rows of a shard from one node to another while training,
+    // the source still serves the shard and tracks the rows changed after the copy.
+    // The copy begins at the next update_weights, wait for it while training.
+    HandlerWaiter copy_shard(int32_t shard_id, int from, int to);
+
+    // Resend the changed rows and move the shard to the target on all nodes.
+    // Call after copy_shard, the pushes of the shard are rejected and retried until moved.
+    HandlerWaiter switch_shard(int32_t shard_id, int from, int to);
+
+    // Memory of the storage on every server, by shard and variable.
+    ps::Status memory_usage(EmbeddingStorageMemory& result);
+
+    // Latency histograms of the servers of the storage, merged into result by node.
+    ps::Status latencies(EmbeddingLatencies& result);
+
+    // Fetch the newest shard placement from servers.
+    ps::Status refresh_placement();
+
     int _timeout = -1;
     ObjectPool<std::unique_ptr<ps::UDFHandler>> _read_only_pull_handler;
     ObjectPool<std::unique_ptr<ps::UDFHandler>> _pull_handler;
     ObjectPool<std::unique_ptr<ps::UDFHandler>> _push_handler;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>> _push_pull_handler;
     ObjectPool<std::unique_ptr<ps::UDFHandler>> _store_handler;
     ObjectPool<std::unique_ptr<ps::PushHandler>> _init_handler;
     
     ObjectPool<std::unique_ptr<ps::LoadHandler>> _load_handler;
     ObjectPool<std::unique_ptr<ps::DumpHandler>> _dump_handler;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>> _hot_key_handler;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>> _migrate_handler;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>> _direct_load_handler;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>> _memory_handler;
+    ObjectPool<std::unique_ptr<ps::UDFHandler>> _latency_handler;
+
+    std::unique_ptr<HotKeyDirectory> _hot_keys = std::make_unique<HotKeyDirectory>();
+    std::unique_ptr<std::atomic<bool>> _hot_keys_replicated = std::make_unique<std::atomic<bool>>(false);
+    std::unique_ptr<EmbeddingPullCaches> _pull_caches = std::make_unique<EmbeddingPullCaches>();
+    std::shared_ptr<SharedShardPlacement> _placement = std::make_shared<SharedShardPlacement>();
+
+private:
+    ps::Status migrate_step(EmbeddingMigrateItems& items, EmbeddingMigrateItems& result);
 };
 
 
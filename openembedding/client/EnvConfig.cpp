@@ -24,6 +24,34 @@ PICO_CONFIGURE_DEFINE(ServerConfig,
         GreaterEqualChecker<size_t>(0));
 
 
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        cache_policy,
+        std::string,
+        "lru",
+        "replacement policy of the dram cache of pmem, 2q keeps the keys set again from a scan of cold keys",
+        true,
+        EnumChecker<std::string>({"lru", "2q"}));
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        checkpoint_flush_bandwidth,
+        size_t,
+        256,
+        "MB per second of each server flushing persisted checkpoints to pmem in the background,"
+        " 0 means flushing only when persisting exceeds the pending window",
+        true,
+        GreaterEqualChecker<size_t>(0));
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        cache_budget_interval,
+        int,
+        10,
+        "interval (s) of moving the dram cache of pmem between variables by the ghost hits, 0 means never",
+        true,
+        GreaterEqualChecker<int>(0));
+
+
 PICO_CONFIGURE_DEFINE(ServerConfig,
         message_compress,
         std::string,
@@ -52,6 +80,61 @@ PICO_CONFIGURE_DEFINE(ServerConfig,
         GreaterEqualChecker<size_t>(1));
 
 
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        server_dump_file_per_shard,
+        bool,
+        false,
+        "each server writes every shard to its own file in parallel, server_dump_files is ignored",
+        true,
+        DefaultChecker<bool>());
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        server_dump_threads,
+        size_t,
+        4,
+        "threads of each server writing shard files when server_dump_file_per_shard",
+        true,
+        GreaterEqualChecker<size_t>(1));
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        server_dump_compress,
+        std::string,
+        "",
+        "streaming compression of dumped model files, empty string \"\" means not using compress",
+        true,
+        EnumChecker<std::string>({"", "lz4"}));
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        server_dump_indexed,
+        bool,
+        false,
+        "models dumped without optimizer are written as indexed files, which servers map for read only pulls, not for hdfs",
+        true,
+        DefaultChecker<bool>());
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        server_direct_load,
+        bool,
+        false,
+        "servers read model files from shared storage by themselves instead of through the client, "
+        "only for models dumped with server_dump_file_per_shard, not for hdfs",
+        true,
+        DefaultChecker<bool>());
+
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        server_load_threads,
+        size_t,
+        4,
+        "threads of each server reading model files when server_direct_load",
+        true,
+        GreaterEqualChecker<size_t>(1));
+
+
 PICO_CONFIGURE_DEFINE(ServerConfig,
         recv_timeout,
         int,
@@ -77,6 +160,104 @@ PICO_CONFIGURE_DEFINE(ServerConfig,
         true,
         DefaultChecker<bool>());
 
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        push_gradient_codec,
+        std::string,
+        "",
+        "lossy codec of push gradients, empty string \"\" means full precision",
+        true,
+        EnumChecker<std::string>({"", "bf16", "int8", "topk"}));
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        push_gradient_topk,
+        size_t,
+        8,
+        "number of values kept in each gradient row by the topk codec",
+        true,
+        GreaterEqualChecker<size_t>(1));
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        push_error_feedback,
+        bool,
+        false,
+        "keep the codec error on worker and add it to the next push",
+        true,
+        DefaultChecker<bool>());
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        push_error_feedback_rows,
+        size_t,
+        1 << 20,
+        "max rows of each variable keeping the codec error on worker, rows not pushed recently are dropped",
+        true,
+        GreaterEqualChecker<size_t>(1));
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        pull_wire_precision,
+        std::string,
+        "",
+        "precision of the pulled weights on wire, empty string \"\" means the variable datatype",
+        true,
+        EnumChecker<std::string>({"", "bf16", "fp16"}));
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        request_index_codec,
+        std::string,
+        "",
+        "codec of the indices in pull push requests, \"varint\" sorts and delta encodes them",
+        true,
+        EnumChecker<std::string>({"", "varint"}));
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        sort_request_indices,
+        bool,
+        false,
+        "client sorts the indices of each shard so that servers access tables in key order",
+        true,
+        DefaultChecker<bool>());
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        hot_key_top_k,
+        size_t,
+        0,
+        "number of the most pulled keys of each variable replicated to all servers for read only pulls, 0 means disabled",
+        true,
+        DefaultChecker<size_t>());
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        hot_key_interval,
+        size_t,
+        100,
+        "number of update_weights between the refreshes of hot keys, 0 means only refreshed manually, "
+        "the rows of the replicas are refreshed after every update_weights",
+        true,
+        DefaultChecker<size_t>());
+
+PICO_CONFIGURE_DEFINE(ServerConfig,
+        lock_profile,
+        bool,
+        false,
+        "record the contention of the server locks, reported every report_interval",
+        true,
+        DefaultChecker<bool>());
+
+PICO_CONFIGURE_DEFINE(WorkerConfig,
+        pull_cache_items,
+        size_t,
+        0,
+        "rows of each variable cached by the worker for training pulls, 0 means no cache, "
+        "the hits and lookups are reported every report_interval",
+        true,
+        GreaterEqualChecker<size_t>(0));
+
+PICO_CONFIGURE_DEFINE(WorkerConfig,
+        pull_cache_staleness,
+        int,
+        1,
+        "batches a cached row pulled for batch b is served after b, the weights are at most this stale",
+        true,
+        GreaterEqualChecker<int>(0));
+
 PICO_CONFIGURE_DEFINE(MasterConfig,
         endpoint,
         std::string,
@@ -318,6 +499,13 @@ PICO_STRUCT_CONFIGURE_DEFINE(EnvConfig,
         true,
         DefaultChecker<ServerConfig>());
 
+PICO_STRUCT_CONFIGURE_DEFINE(EnvConfig,
+        worker,
+        WorkerConfig,
+        "worker",
+        true,
+        DefaultChecker<WorkerConfig>());
+
 
 }
 }
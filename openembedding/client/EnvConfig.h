@@ -54,12 +54,36 @@ DECLARE_CONFIG(MasterConfig, ConfigNode) {
 DECLARE_CONFIG(ServerConfig, ConfigNode) {
     PICO_CONFIGURE_DECLARE(std::string, pmem_pool_root_path);
     PICO_CONFIGURE_DECLARE(size_t, cache_size);
+    PICO_CONFIGURE_DECLARE(std::string, cache_policy);
+    PICO_CONFIGURE_DECLARE(size_t, checkpoint_flush_bandwidth);
+    PICO_CONFIGURE_DECLARE(int, cache_budget_interval);
     PICO_CONFIGURE_DECLARE(std::string, message_compress);
     PICO_CONFIGURE_DECLARE(size_t, server_dump_files);
+    PICO_CONFIGURE_DECLARE(bool, server_dump_file_per_shard);
+    PICO_CONFIGURE_DECLARE(size_t, server_dump_threads);
+    PICO_CONFIGURE_DECLARE(std::string, server_dump_compress);
+    PICO_CONFIGURE_DECLARE(bool, server_dump_indexed);
+    PICO_CONFIGURE_DECLARE(bool, server_direct_load);
+    PICO_CONFIGURE_DECLARE(size_t, server_load_threads);
     PICO_CONFIGURE_DECLARE(int, server_concurrency);
     PICO_CONFIGURE_DECLARE(int, recv_timeout);
     PICO_CONFIGURE_DECLARE(int, report_interval);
     PICO_CONFIGURE_DECLARE(bool, update_early_return);
+    PICO_CONFIGURE_DECLARE(std::string, push_gradient_codec);
+    PICO_CONFIGURE_DECLARE(size_t, push_gradient_topk);
+    PICO_CONFIGURE_DECLARE(bool, push_error_feedback);
+    PICO_CONFIGURE_DECLARE(size_t, push_error_feedback_rows);
+    PICO_CONFIGURE_DECLARE(std::string, pull_wire_precision);
+    PICO_CONFIGURE_DECLARE(std::string, request_index_codec);
+    PICO_CONFIGURE_DECLARE(bool, sort_request_indices);
+    PICO_CONFIGURE_DECLARE(size_t, hot_key_top_k);
+    PICO_CONFIGURE_DECLARE(size_t, hot_key_interval);
+    PICO_CONFIGURE_DECLARE(bool, lock_profile);
+};
+
+DECLARE_CONFIG(WorkerConfig, ConfigNode) {
+    PICO_CONFIGURE_DECLARE(size_t, pull_cache_items);
+    PICO_CONFIGURE_DECLARE(int, pull_cache_staleness);
 };
 
 class EnvConfig: public ConfigNode {
@@ -70,6 +94,7 @@ public:
     PICO_CONFIGURE_DECLARE(RpcConfig, rpc);
     PICO_CONFIGURE_DECLARE(MasterConfig, master);
     PICO_CONFIGURE_DECLARE(ServerConfig, server);
+    PICO_CONFIGURE_DECLARE(WorkerConfig, worker);
 public:
 
     void load_yaml(const core::Configure& configure, const std::string& master_endpoint = "", const std::string& rpc_bind_ip = "") {
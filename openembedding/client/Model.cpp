@@ -2,6 +2,7 @@
 
 #include <pico-ps/service/Server.h>
 #include "EmbeddingShardFile.h"
+#include "EmbeddingIndexedFile.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -20,6 +21,19 @@ inline ps::Status wait_all(std::vector<HandlerWaiter>&& waiters) {
     return status;
 }
 
+// Storages dumped with server_dump_indexed are mapped by the servers.
+static bool indexed_storage(const core::URIConfig& uri) {
+    if (uri.storage_type() == core::FileSystemType::HDFS) {
+        return false;
+    }
+    for (auto& path: core::FileSystem::get_file_list(uri.uri())) {
+        if (IndexedShardFile::match(path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Model::set_model_status(ps::ModelStatus model_status) {
     _model_meta.model_status = model_status;
 }
@@ -88,12 +102,19 @@ ps::Status Model::access_variable(uint32_t variable_id, EmbeddingVariableHandle&
 
 ps::Status Model::dump_model(core::URIConfig uri, std::string model_sign, size_t num_files)const {
     _conn->set_default_hadoop_bin(uri);
+    const ServerConfig& server = _conn->env_config().server;
+    uri.config().set_val("dump_file_per_shard", server.server_dump_file_per_shard);
+    uri.config().set_val("dump_threads", server.server_dump_threads);
+    uri.config().set_val("dump_compress", server.server_dump_compress);
+    uri.config().set_val("dump_indexed",
+          server.server_dump_indexed && uri.storage_type() != core::FileSystemType::HDFS);
     FileWriter meta_file;
     core::FileSystem::create_output_dir(uri);
     SCHECK(meta_file.open(uri + "/model_meta"));
     ModelOfflineMeta model_meta;
     model_meta.model_sign = model_sign;
     model_meta.variables = _model_meta.variables;
+    uri.config().get_val("checkpoint", model_meta.checkpoint);
     core::PicoJsonNode json = model_meta.to_json_node();
     std::string str = json.dump(4);
     meta_file.write(str.c_str(), str.length());
@@ -107,6 +128,27 @@ ps::Status Model::dump_model(core::URIConfig uri, std::string model_sign, size_t
     return ps::Status();
 }
 
+ps::Status Model::memory_usage(core::PicoJsonNode& result)const {
+    result = core::PicoJsonNode::object();
+    for (auto& pair: _model_meta.storages) {
+        EmbeddingStorageHandler* storage = nullptr;
+        EmbeddingStorageMemory memory;
+        CHECK_STATUS_RETURN(access_storage(pair.second, storage));
+        CHECK_STATUS_RETURN(storage->memory_usage(memory));
+        result.add(pair.first, memory.to_json_node());
+    }
+    return ps::Status();
+}
+
+ps::Status Model::latencies(core::PicoJsonNode& result)const {
+    EmbeddingLatencies latencies;
+    for (auto& pair: _storages) {
+        CHECK_STATUS_RETURN(pair.second->latencies(latencies));
+    }
+    result = latencies.to_json_node();
+    return ps::Status();
+}
+
 ps::Status Model::load_model(core::URIConfig uri) {
     _conn->set_default_hadoop_bin(uri);
     ModelOfflineMeta model_meta;
@@ -117,17 +159,38 @@ ps::Status Model::load_model(core::URIConfig uri) {
               << _model_meta.to_json_node().dump(4) << "\n";
         RETURN_WARNING_STATUS(ps::Status::InvalidConfig("model meta not match"));
     }
+    // A delta checkpoint is loaded on top of the rows already loaded.
+    bool delta = false;
+    uri.config().get_val("delta", delta);
+    if (delta && model_meta.checkpoint != "delta") {
+        RETURN_WARNING_STATUS(ps::Status::InvalidConfig("not a delta checkpoint: " + uri.uri()));
+    }
+    if (!delta && model_meta.checkpoint == "delta") {
+        RETURN_WARNING_STATUS(ps::Status::InvalidConfig(
+              "a delta checkpoint is loaded after its base: " + uri.uri()));
+    }
     std::vector<HandlerWaiter> waiters;
-    for (size_t variable_id = 0; variable_id < _model_meta.variables.size(); ++variable_id) {
+    for (size_t variable_id = 0; variable_id < _model_meta.variables.size() && !delta; ++variable_id) {
         EmbeddingVariableHandle handle;
         CHECK_STATUS_RETURN(access_variable(variable_id, handle));
         waiters.push_back(handle.clear_weights());
     }
     CHECK_STATUS_RETURN(wait_all(std::move(waiters)));
 
+    const ServerConfig& server = _conn->env_config().server;
+    bool direct_load = server.server_direct_load && uri.storage_type() != core::FileSystemType::HDFS;
     for (auto& pair: _model_meta.storages) {
-        waiters.push_back(_storages.at(pair.second)->load_storage(uri + "/" + pair.first));
-        _conn->set_storage_restore_uri(pair.second, uri + "/" + pair.first);
+        EmbeddingStorageHandler& storage = *_storages.at(pair.second);
+        bool indexed = indexed_storage(uri + "/" + pair.first);
+        if (direct_load || indexed) {
+            waiters.push_back(storage.direct_load_storage(uri + "/" + pair.first, server.server_load_threads));
+        } else {
+            waiters.push_back(storage.load_storage(uri + "/" + pair.first));
+        }
+        // indexed files are mapped again by the restored servers.
+        if (!delta) {
+            _conn->set_storage_restore_uri(pair.second, uri + "/" + pair.first);
+        }
     }
     CHECK_STATUS_RETURN(wait_all(std::move(waiters)));
     return ps::Status();
@@ -212,7 +275,7 @@ ps::Status Model::read_meta_file(const core::URIConfig& uri, ModelOfflineMeta& m
     if (!json.at("version").try_as(version)) {
         RETURN_WARNING_STATUS(ps::Status::InvalidConfig("model file meta miss version field"));
     }
-    if (version != ModelOfflineMeta::version()) {
+    if (!ModelOfflineMeta::readable(version)) {
         RETURN_WARNING_STATUS(ps::Status::InvalidConfig("unsupport version: " + version));
     }
     if (!model_meta.from_json_node(json)) {
@@ -35,6 +35,12 @@ public:
 
     ps::Status load_model(core::URIConfig uri);
 
+    // Memory of the storages by storage name, node, shard and variable id in storage.
+    ps::Status memory_usage(core::PicoJsonNode& result)const;
+
+    // Latency histograms of the servers of all storages by node.
+    ps::Status latencies(core::PicoJsonNode& result)const;
+
     ps::Status load_model();
 
     ps::Status create_model(core::URIConfig uri);
@@ -120,6 +120,30 @@ ps::Status ModelController::show_model(const std::string& model_sign, core::Pico
     return ps::Status();
 }
 
+ps::Status ModelController::show_model_memory(const std::string& model_sign, core::PicoJsonNode& result) {
+    ModelMeta model_meta;
+    CHECK_STATUS_RETURN(_conn->pull_model_meta(model_sign, model_meta));
+    Model model(_conn);
+    CHECK_STATUS_RETURN(model.update_model_meta(model_meta));
+    core::PicoJsonNode memory;
+    CHECK_STATUS_RETURN(model.memory_usage(memory));
+    result = core::PicoJsonNode::object();
+    result.add(model_sign, memory);
+    return ps::Status();
+}
+
+ps::Status ModelController::show_model_latency(const std::string& model_sign, core::PicoJsonNode& result) {
+    ModelMeta model_meta;
+    CHECK_STATUS_RETURN(_conn->pull_model_meta(model_sign, model_meta));
+    Model model(_conn);
+    CHECK_STATUS_RETURN(model.update_model_meta(model_meta));
+    core::PicoJsonNode latencies;
+    CHECK_STATUS_RETURN(model.latencies(latencies));
+    result = core::PicoJsonNode::object();
+    result.add(model_sign, latencies);
+    return ps::Status();
+}
+
 ps::Status ModelController::show_models(core::PicoJsonNode& result) {
     result = core::PicoJsonNode::object();
     std::vector<std::string> model_signs = _conn->list_model();
@@ -141,8 +165,13 @@ ps::Status ModelController::show_node(int32_t node_id, core::PicoJsonNode& resul
             return ps::Status::Error(error + ": " + std::to_string(node_id));
         }
     }
+    // Includes the shard sizes and memory usages of the storages on the node.
+    core::PicoJsonNode node;
+    if (str.empty() || !node.load(str)) {
+        node = core::PicoJsonNode::object();
+    }
     result = core::PicoJsonNode::object();
-    result.add(std::to_string(node_id), core::PicoJsonNode::object());
+    result.add(std::to_string(node_id), node);
     return ps::Status();
 }
 
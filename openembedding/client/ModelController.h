@@ -39,6 +39,10 @@ public:
 
     ps::Status show_models(core::PicoJsonNode& result);
 
+    ps::Status show_model_memory(const std::string& model_sign, core::PicoJsonNode& result);
+
+    ps::Status show_model_latency(const std::string& model_sign, core::PicoJsonNode& result);
+
     ps::Status show_node(int32_t node_id, core::PicoJsonNode& result);
 
     ps::Status show_nodes(core::PicoJsonNode& result);
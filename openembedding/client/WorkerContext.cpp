@@ -81,6 +81,7 @@ int32_t WorkerContext::create_storage(int32_t shard_num) {
     });
     core::lock_guard<core::RWSpinLock> lk(_lock);
     _model->add_storage(storage_id, std::to_string(storage_id));
+    _store_counts.emplace(storage_id, 0);
     return storage_id;
 }
 
@@ -113,13 +114,55 @@ EmbeddingVariableHandle WorkerContext::create_variable(int32_t storage_id, const
 }
 
 HandlerWaiter WorkerContext::update_weights(int32_t storage_id) {
-    if (storage_id % _comm->comm_size() == _comm->comm_rank()) {
-        core::shared_lock_guard<core::RWSpinLock> lk(_lock);
-        EmbeddingStorageHandler* storage = nullptr;
-        SCHECK(_model->access_storage(storage_id, storage).ok());
-        return storage->update_weights();
+    core::shared_lock_guard<core::RWSpinLock> lk(_lock);
+    EmbeddingStorageHandler* storage = nullptr;
+    SCHECK(_model->access_storage(storage_id, storage).ok());
+    // Every worker sends the store with the push_pull requests it sent.
+    const ServerConfig& server = _conn->env_config().server;
+    if (storage_id % _comm->comm_size() != _comm->comm_rank() || server.hot_key_top_k == 0) {
+        return storage->update_weights(_comm->comm_size());
     }
-    return [](void*){ return ps::Status(); };
+    // The gradients of hot keys are reduced by their owners, which broadcast the updated rows
+    // to the replicas after every update. The hot keys are refreshed every hot_key_interval.
+    // Before the first refresh replicating some keys there is no row to broadcast, the keys
+    // replicated by exb_replicate_hot_keys of other workers are found by the next refresh.
+    size_t top_k = 0;
+    if (server.hot_key_interval != 0 && ++_store_counts.at(storage_id) % server.hot_key_interval == 0) {
+        top_k = server.hot_key_top_k;
+    }
+    auto store = std::make_shared<HandlerWaiter>(storage->update_weights(_comm->comm_size()));
+    if (top_k == 0 && server.hot_key_interval != 0 && !storage->hot_keys_replicated()) {
+        return [store](void* result) { return store->wait(result); };
+    }
+    return [storage, store, top_k](void* result) {
+        CHECK_STATUS_RETURN(store->wait(result));
+        return storage->replicate_hot_keys(top_k).wait();
+    };
+}
+
+HandlerWaiter WorkerContext::replicate_hot_keys(int32_t storage_id) {
+    size_t top_k = _conn->env_config().server.hot_key_top_k;
+    if (top_k == 0) {
+        return [](void*){ return ps::Status::InvalidConfig("hot_key_top_k is 0"); };
+    }
+    core::shared_lock_guard<core::RWSpinLock> lk(_lock);
+    EmbeddingStorageHandler* storage = nullptr;
+    SCHECK(_model->access_storage(storage_id, storage).ok());
+    return storage->replicate_hot_keys(top_k);
+}
+
+HandlerWaiter WorkerContext::copy_shard(int32_t storage_id, int32_t shard_id, int from, int to) {
+    core::shared_lock_guard<core::RWSpinLock> lk(_lock);
+    EmbeddingStorageHandler* storage = nullptr;
+    SCHECK(_model->access_storage(storage_id, storage).ok());
+    return storage->copy_shard(shard_id, from, to);
+}
+
+HandlerWaiter WorkerContext::switch_shard(int32_t storage_id, int32_t shard_id, int from, int to) {
+    core::shared_lock_guard<core::RWSpinLock> lk(_lock);
+    EmbeddingStorageHandler* storage = nullptr;
+    SCHECK(_model->access_storage(storage_id, storage).ok());
+    return storage->switch_shard(shard_id, from, to);
 }
 
 void WorkerContext::load_model(const core::URIConfig& uri)const {
@@ -138,6 +181,15 @@ void WorkerContext::dump_model(const core::URIConfig& uri, const std::string& mo
 }
 
 void WorkerContext::report_accumulator() {
+    // Latency percentiles of this process, include the server in it.
+    std::map<std::string, LatencyCounts> latencies = LatencyHistograms::singleton().counts();
+    if (!latencies.empty()) {
+        SLOG(INFO) << "======== LATENCY INFO ======";
+        for (auto& pair: latencies) {
+            SLOG(INFO) << pair.first << " : " << pair.second.to_json_node().dump();
+        }
+    }
+
     auto output_info = AccumulatorServer::singleton().generate_output_info();
     if (output_info.size() == 0) {
     SLOG(INFO) << "===== No Accumulator =====";
@@ -6,6 +6,7 @@
 #include "Communication.h"
 #include "EmbeddingVariableHandle.h"
 #include "Model.h"
+#include "LatencyHistogram.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -26,6 +27,12 @@ public:
 
     HandlerWaiter update_weights(int32_t storage_id);
 
+    HandlerWaiter replicate_hot_keys(int32_t storage_id);
+
+    HandlerWaiter copy_shard(int32_t storage_id, int32_t shard_id, int from, int to);
+
+    HandlerWaiter switch_shard(int32_t storage_id, int32_t shard_id, int from, int to);
+
     int32_t worker_rank()const {
         return _comm->comm_rank();
     }
@@ -65,6 +72,8 @@ private:
 
     ServerConfig _server_config;
 
+    std::unordered_map<int32_t, std::atomic<size_t>> _store_counts; // for hot key refresh
+
     bool _reporter = false;
     size_t _report_monitor = 0;
 };
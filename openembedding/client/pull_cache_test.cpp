@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include "EmbeddingPullCache.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+std::vector<char> cache_row(char value, size_t line_size) {
+    return std::vector<char>(line_size, value);
+}
+
+TEST(EmbeddingPullCache, Staleness) {
+    size_t line_size = 8;
+    EmbeddingPullCache cache(16, line_size, 2);
+    std::vector<char> row = cache_row(1, line_size);
+    std::vector<char> weights(line_size);
+    uint64_t key = 7;
+    EXPECT_FALSE(cache.get(key, 10, 0, weights.data()));
+    cache.put(&key, 1, 10, 0, row.data());
+    for (int64_t batch_id: {10, 11, 12}) {
+        std::fill(weights.begin(), weights.end(), 0);
+        EXPECT_TRUE(cache.get(key, batch_id, 0, weights.data()));
+        EXPECT_EQ(row, weights);
+    }
+    EXPECT_FALSE(cache.get(key, 13, 0, weights.data()));
+    EXPECT_FALSE(cache.get(key, 9, 0, weights.data())); // pulled after the batch
+
+    // an older row does not replace a newer one
+    std::vector<char> newer = cache_row(2, line_size);
+    cache.put(&key, 1, 12, 0, newer.data());
+    cache.put(&key, 1, 11, 0, row.data());
+    EXPECT_TRUE(cache.get(key, 14, 0, weights.data()));
+    EXPECT_EQ(newer, weights);
+    EXPECT_EQ(4, cache.hits());
+    EXPECT_EQ(7, cache.lookups());
+}
+
+TEST(EmbeddingPullCache, Invalidate) {
+    size_t line_size = 8;
+    EmbeddingPullCaches caches;
+    EXPECT_EQ(nullptr, caches.get(0, line_size)); // disabled
+
+    caches.initialize(16, 1);
+    std::shared_ptr<EmbeddingPullCache> cache = caches.get(0, line_size);
+    ASSERT_NE(nullptr, cache);
+    EXPECT_EQ(cache, caches.get(0, line_size));
+    std::vector<char> row = cache_row(1, line_size);
+    std::vector<char> weights(line_size);
+    uint64_t key = 3;
+    uint64_t version = caches.version();
+    cache->put(&key, 1, 0, version, row.data());
+    EXPECT_TRUE(cache->get(key, 0, caches.version(), weights.data()));
+
+    caches.invalidate();
+    EXPECT_NE(version, caches.version());
+    EXPECT_FALSE(cache->get(key, 0, caches.version(), weights.data()));
+    // rows of a pull sent before the invalidation are not served after it
+    cache->put(&key, 1, 1, version, row.data());
+    EXPECT_FALSE(cache->get(key, 1, caches.version(), weights.data()));
+    cache->put(&key, 1, 1, caches.version(), row.data());
+    EXPECT_TRUE(cache->get(key, 1, caches.version(), weights.data()));
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
@@ -4,6 +4,7 @@
 #include "ModelController.h"
 #include "EmbeddingRestoreOperator.h"
 #include "PersistManager.h"
+#include "IndexDedup.h"
 
 using namespace paradigm4::pico;
 using namespace paradigm4::pico::embedding;
@@ -180,11 +181,13 @@ void exb_delete_storage(struct exb_storage* storage) {
 }
 
 struct exb_variable* exb_create_variable(struct exb_storage* storage,
-      uint64_t vocabulary_size, uint64_t embedding_dim, const char* dtype) {
+      uint64_t vocabulary_size, uint64_t embedding_dim, const char* dtype, const char* partition) {
     EmbeddingVariableMeta meta;
     meta.datatype = DataType(dtype);
     meta.embedding_dim = embedding_dim;
     meta.vocabulary_size = vocabulary_size;
+    meta.partition = ShardPartition(partition);
+    SCHECK(meta.partition.policy != ShardPartition::UNKNOWN) << "unknown partition " << partition;
     exb_variable* variable = new exb_variable;
     variable->handle = storage->context->create_variable(storage->storage_id, meta);
     storage->variables.push_back(variable);
@@ -218,16 +221,10 @@ void exb_set_initializer(struct exb_variable* variable, struct exb_initializer*
 }
 
 size_t exb_unique_indices(const uint64_t* indices, size_t n, size_t* unique) {
-    EasyHashMap<uint64_t, size_t> mp(-1, n);
-    for (size_t i = 0; i < n; ++i) {
-        if (mp.count(indices[i])) {
-            unique[i] = mp.at(indices[i]);
-        } else {
-            unique[i] = mp.size();
-            mp.force_emplace(indices[i], unique[i]);
-        }
-    }
-    return mp.size();
+    static thread_local IndexDedup dedup;
+    dedup.dedup(indices, n);
+    std::copy_n(dedup.inverse(), n, unique);
+    return dedup.size();
 }
 
 struct exb_pull_waiter* exb_pull_weights(const struct exb_variable* variable, const uint64_t* indices, size_t n, int64_t batch_id) {
@@ -242,12 +239,39 @@ struct exb_waiter* exb_push_gradients(struct exb_variable* variable, const uint6
     return reinterpret_cast<exb_waiter*>(waiter.release());
 }
 
+struct exb_pull_waiter* exb_push_pull(struct exb_variable* variable,
+      const uint64_t* push_indices, size_t push_n, const void* gradients,
+      const uint64_t* pull_indices, size_t pull_n, int64_t batch_id) {
+    core::unique_ptr<HandlerWaiter> waiter = core::make_unique<HandlerWaiter>(
+            variable->handle.push_pull(push_indices, push_n, reinterpret_cast<const char*>(gradients),
+                  pull_indices, pull_n, batch_id));
+    return reinterpret_cast<exb_pull_waiter*>(waiter.release());
+}
+
 struct exb_waiter* exb_update_weights(struct exb_storage* storage) {
     core::unique_ptr<HandlerWaiter> waiter = core::make_unique<HandlerWaiter>(
             storage->context->update_weights(storage->storage_id));
     return reinterpret_cast<exb_waiter*>(waiter.release());
 }
 
+struct exb_waiter* exb_replicate_hot_keys(struct exb_storage* storage) {
+    core::unique_ptr<HandlerWaiter> waiter = core::make_unique<HandlerWaiter>(
+            storage->context->replicate_hot_keys(storage->storage_id));
+    return reinterpret_cast<exb_waiter*>(waiter.release());
+}
+
+struct exb_waiter* exb_copy_shard(struct exb_storage* storage, int32_t shard_id, int from, int to) {
+    core::unique_ptr<HandlerWaiter> waiter = core::make_unique<HandlerWaiter>(
+            storage->context->copy_shard(storage->storage_id, shard_id, from, to));
+    return reinterpret_cast<exb_waiter*>(waiter.release());
+}
+
+struct exb_waiter* exb_switch_shard(struct exb_storage* storage, int32_t shard_id, int from, int to) {
+    core::unique_ptr<HandlerWaiter> waiter = core::make_unique<HandlerWaiter>(
+            storage->context->switch_shard(storage->storage_id, shard_id, from, to));
+    return reinterpret_cast<exb_waiter*>(waiter.release());
+}
+
 bool exb_pull_wait(struct exb_pull_waiter* waiter, const uint64_t* indices, size_t n, void* weights) {
     core::unique_ptr<HandlerWaiter> wait(reinterpret_cast<HandlerWaiter*>(waiter));
     EmbeddingPullResults items = {indices, n, reinterpret_cast<char*>(weights)};
@@ -309,6 +333,20 @@ void exb_load_model(struct exb_context* context, const char* path) {
     context->entity->load_model(uri);
 }
 
+void exb_checkpoint_model(struct exb_context* context, const char* path, const char* model_sign, const char* checkpoint) {
+    SCHECK(std::string(checkpoint) == "base" || std::string(checkpoint) == "delta") << checkpoint;
+    core::URIConfig uri(path);
+    uri.config().set_val("include_optimizer", true);
+    uri.config().set_val("checkpoint", std::string(checkpoint));
+    context->entity->dump_model(uri, model_sign);
+}
+
+void exb_load_model_delta(struct exb_context* context, const char* path) {
+    core::URIConfig uri(path);
+    uri.config().set_val("delta", true);
+    context->entity->load_model(uri);
+}
+
 bool exb_should_persist_model(struct exb_context* context) {
     return context->entity->should_persist.load(std::memory_order_acquire);
 }
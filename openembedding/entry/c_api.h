@@ -68,8 +68,10 @@ struct exb_storage* exb_create_storage(struct exb_context*, int32_t shard_num =
 
 void exb_delete_storage(struct exb_storage*);
 
+// partition: how keys are divided into shards, "modulo", "hash", "jump" or "range".
 struct exb_variable* exb_create_variable(struct exb_storage*,
-      uint64_t vocabulary_size, size_t embedding_dim, const char* dtype = "float32");
+      uint64_t vocabulary_size, size_t embedding_dim, const char* dtype = "float32",
+      const char* partition = "modulo");
 
 int32_t exb_storage_id(struct exb_storage*);
 
@@ -87,8 +89,28 @@ struct exb_pull_waiter* exb_pull_weights(const struct exb_variable*,
 struct exb_waiter* exb_push_gradients(struct exb_variable*,
       const uint64_t* indices, size_t n, const void* gradients);
 
+// Push gradients of batch_id - 1 and pull weights of batch_id in one request.
+// Wait it by exb_pull_wait after exb_update_weights of batch_id - 1.
+struct exb_pull_waiter* exb_push_pull(struct exb_variable*,
+      const uint64_t* push_indices, size_t push_n, const void* gradients,
+      const uint64_t* pull_indices, size_t pull_n, int64_t batch_id);
+
+// Called by every worker after its pushes of the batch, the weights are updated
+// after all the workers called it and all their pushes are applied.
 struct exb_waiter* exb_update_weights(struct exb_storage*);
 
+// Replicate the most pulled keys to all servers for read only pulls, see hot_key_top_k.
+struct exb_waiter* exb_replicate_hot_keys(struct exb_storage*);
+
+// Copy a shard from server node `from` to server node `to` while training.
+// Both nodes must already serve the storage. The copy begins at the next exb_update_weights,
+// so wait for it in another thread while training.
+struct exb_waiter* exb_copy_shard(struct exb_storage*, int32_t shard_id, int from, int to);
+
+// Move the shard copied by exb_copy_shard to the target node on all servers.
+// It may run while training, the pushes of the shard wait until it is moved.
+struct exb_waiter* exb_switch_shard(struct exb_storage*, int32_t shard_id, int from, int to);
+
 bool exb_pull_wait(struct exb_pull_waiter*, const uint64_t* indices, size_t n, void* weights);
 
 bool exb_wait(struct exb_waiter*);
@@ -109,6 +131,12 @@ void exb_dump_model(struct exb_context*, const char* path, const char* model_sig
 
 void exb_load_model(struct exb_context*, const char* path);
 
+// checkpoint is "base" or "delta", a delta only contains the rows changed since the last checkpoint.
+void exb_checkpoint_model(struct exb_context*, const char* path, const char* model_sign, const char* checkpoint);
+
+// Load a delta checkpoint after its base and the deltas before.
+void exb_load_model_delta(struct exb_context*, const char* path);
+
 void exb_create_model(struct exb_connection*, const char* path, int32_t replica_num, int32_t shard_num = -1);
 
 struct exb_variable* exb_get_model_variable(struct exb_connection*, const char* model_sign, int32_t variable_id, int pull_timeout = -1);
@@ -37,6 +37,51 @@ TEST(c_api, pull_push) {
     }
 }
 
+TEST(c_api, push_pull) {
+    for (size_t i = 1; i < 5; ++i) {
+        c_api_push_pull(i, 100, 128, false);
+        c_api_push_pull(i, 100000, 8, false);
+        c_api_push_pull(i, 100000, 16, true);
+    }
+}
+
+TEST(c_api, checkpoint) {
+    for (size_t i = 1; i < 5; ++i) {
+        c_api_checkpoint(i, 1000, 8, false);
+        c_api_checkpoint(i, 1000, 8, true);
+    }
+}
+
+TEST(c_api, direct_load) {
+    for (size_t i = 1; i < 5; ++i) {
+        c_api_direct_load(i, 1000, 8, false, "");
+        c_api_direct_load(i, 100000, 16, true, "lz4");
+    }
+}
+
+TEST(c_api, hot_keys) {
+    for (size_t i = 1; i < 5; ++i) {
+        c_api_hot_keys(i, 100, 8);
+    }
+}
+
+TEST(c_api, migrate) {
+    for (size_t i = 2; i < 5; ++i) {
+        c_api_migrate(i, 1000, 8, false);
+        c_api_migrate(i, 100000, 16, true);
+    }
+}
+
+TEST(c_api, partition) {
+    for (const char* partition: {"hash", "jump", "range"}) {
+        for (size_t i = 1; i < 5; ++i) {
+            c_api_pull_push(i, 100, 128, false, partition);
+            c_api_pull_push(i, 100000, 8, false, partition);
+            c_api_pull_push(i, 100000, 16, true, partition);
+        }
+    }
+}
+
 TEST(c_api, one) {
     c_api_threads(1, 1, 1, 1000);
     c_api_threads(3, 1, 1, 1000);
@@ -186,25 +186,58 @@ void test_loop(exb_context* context, std::vector<exb_storage*>& storages,
 
 const char* yaml_config = "";
 
-void c_api_pull_push(int node_num, int word_num, int dim, bool sparse) {
+// A worker process with a storage and a variable initialized to 100.
+struct TestWorker {
+    core::MultiProcess& mp;
+    exb_connection* connection;
+    exb_context* context;
+    exb_storage* storage;
+    exb_variable* variable;
+};
+
+void set_test_optimizer(exb_variable* variable) {
+    exb_optimizer* optimizer = exb_create_optimizer("test");
+    exb_set_optimizer_property(optimizer, "learning_rate", "1");
+    exb_set_optimizer(variable, optimizer);
+}
+
+// Starts a master and node_num worker processes running fn(worker).
+template<class F>
+void c_api_workers(int node_num, int word_num, int dim, bool sparse, const char* partition, F fn,
+      const char* config = yaml_config) {
     exb_string master_endpoint;
     exb_master* master = exb_master_start();
     exb_master_endpoint(master, &master_endpoint);
     {
         core::MultiProcess mp(node_num, "");
-        exb_connection* connection = exb_connect(yaml_config, master_endpoint.data);
+        exb_connection* connection = exb_connect(config, master_endpoint.data);
         exb_context* context = exb_context_initialize(connection, node_num);
         exb_storage* storage = exb_create_storage(context);
-        exb_variable* variable = exb_create_variable(storage, sparse ? -1 : word_num, dim);
-        
+        exb_variable* variable = exb_create_variable(storage, sparse ? -1 : word_num, dim, "float32", partition);
+
         exb_initializer* initializer = exb_create_initializer("constant");
         exb_set_initializer_property(initializer, "value", "100");
         exb_set_initializer(variable, initializer);
-        
+
+        TestWorker worker = {mp, connection, context, storage, variable};
+        fn(worker);
+
+        exb_delete_storage(storage);
+        exb_context_finalize(context);
+        exb_disconnect(connection);
+    }
+    exb_master_join(master);
+}
+
+void c_api_pull_push(int node_num, int word_num, int dim, bool sparse, const char* partition = "modulo") {
+    c_api_workers(node_num, word_num, dim, sparse, partition, [&](TestWorker& worker) {
+        exb_context* context = worker.context;
+        exb_storage* storage = worker.storage;
+        exb_variable* variable = worker.variable;
         std::vector<uint64_t> indices;
         std::vector<float> gradients;
         std::vector<float> answer;
-        for (int i = mp.process_index(); i < word_num; i += node_num) {
+        for (int i = worker.mp.process_index(); i < word_num; i += node_num) {
             indices.push_back(i);
             for (int j = 0; j < dim; ++j) {
                 gradients.push_back(i);
@@ -231,9 +264,7 @@ void c_api_pull_push(int node_num, int word_num, int dim, bool sparse) {
         exb_wait(exb_push_gradients(variable, indices.data(), indices.size(), gradients.data()));
         exb_wait(exb_push_gradients(variable, indices.data(), indices.size(), gradients.data()));
         
-        exb_optimizer* optimizer = exb_create_optimizer("test");
-        exb_set_optimizer_property(optimizer, "learning_rate", "1");
-        exb_set_optimizer(variable, optimizer);
+        set_test_optimizer(variable);
         exb_barrier(context, "update_weights");
         exb_wait(exb_update_weights(storage));
         exb_pull_wait(waiter1, indices.data(), indices.size(), weights.data());
@@ -249,14 +280,239 @@ void c_api_pull_push(int node_num, int word_num, int dim, bool sparse) {
         exb_wait(exb_update_weights(storage));
         exb_pull_wait(waiter2, indices.data(), indices.size(), weights.data());
         EXPECT_EQ(weights, answer);
+    });
+}
 
-        exb_delete_storage(storage);
-        exb_context_finalize(context);
-        exb_disconnect(connection);
-    }
-    exb_master_join(master);
+
+// The gradients of each batch are pushed with the pulls of the next batch,
+// and the store is not synchronized with the pushes of the other workers.
+void c_api_push_pull(int node_num, int word_num, int dim, bool sparse) {
+    c_api_workers(node_num, word_num, dim, sparse, "modulo", [&](TestWorker& worker) {
+        exb_storage* storage = worker.storage;
+        exb_variable* variable = worker.variable;
+        set_test_optimizer(variable);
+        
+        std::vector<uint64_t> indices;
+        std::vector<float> gradients;
+        std::vector<float> answer;
+        for (int i = worker.mp.process_index(); i < word_num; i += node_num) {
+            indices.push_back(i);
+            for (int j = 0; j < dim; ++j) {
+                gradients.push_back(i);
+                answer.push_back(i + 100 + 10000);
+            }
+        }
+
+        std::vector<float> weights(gradients.size());
+        exb_pull_waiter* waiter = exb_pull_weights(variable, indices.data(), indices.size(), 0);
+        SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+
+        waiter = exb_push_pull(variable, indices.data(), indices.size(), gradients.data(),
+              indices.data(), indices.size(), 1);
+        exb_wait(exb_update_weights(storage));
+        SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+        EXPECT_EQ(weights, answer);
+
+        answer = weights;
+        for (float& val: answer) {
+            val *= 2;
+        }
+        waiter = exb_push_pull(variable, indices.data(), indices.size(), weights.data(),
+              indices.data(), indices.size(), 2);
+        exb_wait(exb_update_weights(storage));
+        SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+        EXPECT_EQ(weights, answer);
+    });
+}
+
+// A delta checkpoint loaded after its base restores the rows of the delta checkpoint.
+void c_api_checkpoint(int node_num, int word_num, int dim, bool sparse) {
+    c_api_workers(node_num, word_num, dim, sparse, "modulo", [&](TestWorker& worker) {
+        exb_context* context = worker.context;
+        exb_storage* storage = worker.storage;
+        exb_variable* variable = worker.variable;
+        set_test_optimizer(variable);
+
+        std::vector<uint64_t> indices, half_indices;
+        std::vector<float> gradients, half_gradients;
+        for (int i = worker.mp.process_index(); i < word_num; i += node_num) {
+            indices.push_back(i);
+            gradients.insert(gradients.end(), dim, i);
+            if (i % 2 == 0) {
+                half_indices.push_back(i);
+                half_gradients.insert(half_gradients.end(), dim, i);
+            }
+        }
+        auto pull = [&](int64_t batch_id) {
+            std::vector<float> weights(indices.size() * dim);
+            exb_pull_waiter* waiter = exb_pull_weights(variable, indices.data(), indices.size(), batch_id);
+            SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+            return weights;
+        };
+        auto train = [&](const std::vector<uint64_t>& keys, const std::vector<float>& grads) {
+            exb_wait(exb_push_gradients(variable, keys.data(), keys.size(), grads.data()));
+            exb_barrier(context, "update_weights");
+            exb_wait(exb_update_weights(storage));
+        };
+        auto checkpoint = [&](const char* path, const char* kind) {
+            exb_barrier(context, "checkpoint");
+            if (worker.mp.process_index() == 0) {
+                exb_checkpoint_model(context, path, path, kind);
+            }
+            exb_barrier(context, "checkpoint");
+        };
+
+        pull(0);
+        train(indices, gradients);
+        std::vector<float> base = pull(1);
+        checkpoint("ckpt_base", "base");
+        train(half_indices, half_gradients);
+        std::vector<float> delta = pull(2);
+        EXPECT_NE(base, delta);
+        checkpoint("ckpt_delta", "delta");
+        train(indices, gradients);
+        EXPECT_NE(delta, pull(3));
+
+        exb_load_model(context, "ckpt_base");
+        EXPECT_EQ(base, pull(3));
+        exb_load_model_delta(context, "ckpt_delta");
+        EXPECT_EQ(delta, pull(3));
+    });
+    core::FileSystem::rmrf("ckpt_base");
+    core::FileSystem::rmrf("ckpt_delta");
 }
 
+// A model dumped per shard with the optimizer and loaded by the servers themselves
+// restores the weights and the optimizer states.
+void c_api_direct_load(int node_num, int word_num, int dim, bool sparse, const char* compress) {
+    std::string config = std::string("server:\n  server_dump_file_per_shard: true\n")
+          + "  server_direct_load: true\n  server_dump_compress: \"" + compress + "\"\n";
+    c_api_workers(node_num, word_num, dim, sparse, "modulo", [&](TestWorker& worker) {
+        exb_context* context = worker.context;
+        exb_storage* storage = worker.storage;
+        exb_variable* variable = worker.variable;
+        set_test_optimizer(variable);
+
+        std::vector<uint64_t> indices;
+        std::vector<float> gradients;
+        for (int i = worker.mp.process_index(); i < word_num; i += node_num) {
+            indices.push_back(i);
+            gradients.insert(gradients.end(), dim, 1);
+        }
+        auto pull = [&](int64_t batch_id) {
+            std::vector<float> weights(indices.size() * dim);
+            exb_pull_waiter* waiter = exb_pull_weights(variable, indices.data(), indices.size(), batch_id);
+            SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+            return weights;
+        };
+        auto train = [&]() {
+            exb_wait(exb_push_gradients(variable, indices.data(), indices.size(), gradients.data()));
+            exb_barrier(context, "update_weights");
+            exb_wait(exb_update_weights(storage));
+        };
+
+        pull(0);
+        train();
+        // the test optimizer adds 10000 at every other update
+        std::vector<float> dumped = pull(1);
+        EXPECT_EQ(dumped, std::vector<float>(dumped.size(), 100 + 1 + 10000));
+        exb_barrier(context, "dump");
+        if (worker.mp.process_index() == 0) {
+            exb_dump_model_include_optimizer(context, "ckpt_direct", "ckpt_direct");
+        }
+        exb_barrier(context, "dump");
+        train();
+        train();
+        EXPECT_NE(dumped, pull(3));
+
+        exb_load_model(context, "ckpt_direct");
+        EXPECT_EQ(dumped, pull(3));
+        // the second update adds no 10000 only if the state was loaded
+        train();
+        EXPECT_EQ(pull(4), std::vector<float>(dumped.size(), 100 + 2 + 10000));
+    }, config.c_str());
+    core::FileSystem::rmrf("ckpt_direct");
+}
+
+// Training with the hot keys replicated, every update_weights broadcasts the updated rows.
+void c_api_hot_keys(int node_num, int word_num, int dim) {
+    const char* config = "server:\n  hot_key_top_k: 4\n  hot_key_interval: 2\n";
+    c_api_workers(node_num, word_num, dim, false, "modulo", [&](TestWorker& worker) {
+        exb_context* context = worker.context;
+        exb_storage* storage = worker.storage;
+        exb_variable* variable = worker.variable;
+        set_test_optimizer(variable);
+
+        std::vector<uint64_t> indices;
+        std::vector<float> gradients;
+        for (int i = worker.mp.process_index(); i < word_num; i += node_num) {
+            indices.push_back(i);
+            gradients.insert(gradients.end(), dim, 1);
+        }
+        std::vector<float> weights(gradients.size());
+        for (int batch_id = 0; batch_id < 10; ++batch_id) {
+            // pulled many times so that the servers sample them
+            for (int i = 0; i < 16; ++i) {
+                exb_pull_waiter* waiter = exb_pull_weights(variable, indices.data(), indices.size(), batch_id);
+                SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+            }
+            // the test optimizer adds 10000 at every other update
+            float answer = 100 + batch_id + 10000 * ((batch_id + 1) / 2);
+            EXPECT_EQ(weights, std::vector<float>(weights.size(), answer));
+            exb_wait(exb_push_gradients(variable, indices.data(), indices.size(), gradients.data()));
+            exb_barrier(context, "update_weights");
+            SCHECK(exb_wait(exb_update_weights(storage))) << exb_last_error();
+        }
+        SCHECK(exb_wait(exb_replicate_hot_keys(storage))) << exb_last_error();
+    }, config);
+}
+
+// Shard 0 is moved to another node while the workers train with push_pull,
+// no push is lost or applied twice and the optimizer states are moved with the rows.
+void c_api_migrate(int node_num, int word_num, int dim, bool sparse) {
+    c_api_workers(node_num, word_num, dim, sparse, "modulo", [&](TestWorker& worker) {
+        exb_storage* storage = worker.storage;
+        exb_variable* variable = worker.variable;
+        set_test_optimizer(variable);
+
+        std::vector<uint64_t> indices;
+        std::vector<float> gradients;
+        for (int i = worker.mp.process_index(); i < word_num; i += node_num) {
+            indices.push_back(i);
+            gradients.insert(gradients.end(), dim, 1);
+        }
+        std::vector<float> weights(gradients.size());
+        exb_pull_waiter* waiter = exb_pull_weights(variable, indices.data(), indices.size(), 0);
+        SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+
+        std::thread migrate;
+        if (worker.mp.process_index() == 0) {
+            migrate = std::thread([storage, node_num]() {
+                // the copy is rejected by the nodes without shard 0
+                for (int from = 0; from < node_num; ++from) {
+                    int to = (from + 1) % node_num;
+                    if (exb_wait(exb_copy_shard(storage, 0, from, to))) {
+                        SCHECK(exb_wait(exb_switch_shard(storage, 0, from, to))) << exb_last_error();
+                        return;
+                    }
+                }
+                SLOG(FATAL) << "shard 0 not found";
+            });
+        }
+        for (int batch_id = 1; batch_id <= 100; ++batch_id) {
+            waiter = exb_push_pull(variable, indices.data(), indices.size(), gradients.data(),
+                  indices.data(), indices.size(), batch_id);
+            exb_wait(exb_update_weights(storage));
+            SCHECK(exb_pull_wait(waiter, indices.data(), indices.size(), weights.data())) << exb_last_error();
+            // the test optimizer adds 10000 at every other update
+            float answer = 100 + batch_id + 10000 * ((batch_id + 1) / 2);
+            EXPECT_EQ(weights, std::vector<float>(weights.size(), answer));
+        }
+        if (migrate.joinable()) {
+            migrate.join();
+        }
+    });
+}
 
 void c_api_threads(int node_num, int var_num, int var_type, int reps, bool load = false, int shard_num = -1) {
     std::vector<TestVariableConfig> configs;
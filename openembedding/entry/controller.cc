@@ -52,6 +52,16 @@ void check_status_throw(ps::Status status) {
 }
 
 class ModelService : public models {
+    // "<model_sign>/memory" for example.
+    bool strip_suffix(std::string& path, const std::string& suffix) {
+        if (path.size() > suffix.size() &&
+              path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            path.resize(path.size() - suffix.size());
+            return true;
+        }
+        return false;
+    }
+
     template<class T>
     bool json_get(core::PicoJsonNode& json, const std::string& key, T& value) {
         if (!json.has(key)) {
@@ -123,6 +133,10 @@ public:
                 std::string model_sign = cntl->http_request().unresolved_path();
                 if (model_sign.empty()) {
                     check_status_throw(_model_controller->show_models(result));
+                } else if (strip_suffix(model_sign, "/memory")) {
+                    check_status_throw(_model_controller->show_model_memory(model_sign, result));
+                } else if (strip_suffix(model_sign, "/latency")) {
+                    check_status_throw(_model_controller->show_model_latency(model_sign, result));
                 } else {
                     check_status_throw(_model_controller->show_model(model_sign, result));
                 }
@@ -10,8 +10,9 @@ namespace exb {
 class Variable {
 public:
     Variable(exb_storage* storage,
-          uint64_t vocabulary_size, size_t embedding_dim, std::string datatype) {
-        _handle = exb_create_variable(storage, vocabulary_size, embedding_dim, datatype.c_str());
+          uint64_t vocabulary_size, size_t embedding_dim, std::string datatype, std::string partition) {
+        _handle = exb_create_variable(storage, vocabulary_size, embedding_dim,
+              datatype.c_str(), partition.c_str());
     }
 
     intptr_t intptr() {
@@ -66,8 +67,9 @@ public:
         _handle = nullptr;
     }
 
-    Variable create_variable(uint64_t vocabulary_size, size_t embedding_dim, std::string datatype) {
-        return Variable(_handle, vocabulary_size, embedding_dim, datatype);
+    Variable create_variable(uint64_t vocabulary_size, size_t embedding_dim,
+          std::string datatype, std::string partition) {
+        return Variable(_handle, vocabulary_size, embedding_dim, datatype, partition);
     }
 
     intptr_t intptr() {
@@ -141,6 +143,16 @@ public:
         exb_load_model(_handle, path.c_str());
     }
 
+    void checkpoint_model(std::string path, double model_version, std::string checkpoint) {
+        int64_t ver = floor(model_version);
+        std::string model_sign = _model_uuid + '-' + std::to_string(ver);
+        exb_checkpoint_model(_handle, path.c_str(), model_sign.c_str(), checkpoint.c_str());
+    }
+
+    void load_model_delta(std::string path) {
+        exb_load_model_delta(_handle, path.c_str());
+    }
+
     bool should_persist_model() {
         return exb_should_persist_model(_handle);
     }
@@ -236,6 +248,8 @@ PYBIND11_MODULE(libexb, m) {
         .def("create_storage", &Context::create_storage, gil_scoped_release)
         .def("save_model", &Context::save_model, gil_scoped_release)
         .def("load_model", &Context::load_model, gil_scoped_release)
+        .def("checkpoint_model", &Context::checkpoint_model, gil_scoped_release)
+        .def("load_model_delta", &Context::load_model_delta, gil_scoped_release)
         .def("persist_model", &Context::persist_model, gil_scoped_release)
         .def("restore_model", &Context::restore_model, gil_scoped_release)
         .def("should_persist_model", &Context::should_persist_model)
@@ -246,7 +260,9 @@ PYBIND11_MODULE(libexb, m) {
 
     pybind11::class_<Storage>(m, "Storage")
         .def("finalize", &Storage::finalize, gil_scoped_release)
-        .def("create_variable", &Storage::create_variable, gil_scoped_release)
+        .def("create_variable", &Storage::create_variable, gil_scoped_release,
+              pybind11::arg("vocabulary_size"), pybind11::arg("embedding_dim"),
+              pybind11::arg("datatype"), pybind11::arg("partition") = "modulo")
         .def_property_readonly("intptr", &Storage::intptr)
         .def_property_readonly("storage_id", &Storage::storage_id);
 
@@ -0,0 +1,91 @@
+#include "CheckpointFlusher.h"
+
+#include "EmbeddingStorage.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+void CheckpointFlusher::initialize(size_t bandwidth) {
+    SCHECK(!_running.load());
+    SCHECK(bandwidth > 0);
+    _bandwidth = bandwidth;
+    _running.store(true);
+    _thread = std::thread(&CheckpointFlusher::flushing, this);
+}
+
+void CheckpointFlusher::finalize() {
+    if (!_running.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _running.store(false);
+        _cv.notify_all();
+    }
+    _thread.join();
+    SLOG(INFO) << "checkpoint flusher finalized, " << (_flushed_bytes.load() >> 20) << "MB flushed";
+}
+
+void CheckpointFlusher::add_storage(EmbeddingStorage* st) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _storages.insert(st);
+}
+
+// Waits for the storage being flushed.
+void CheckpointFlusher::remove_storage(EmbeddingStorage* st) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _storages.erase(st);
+}
+
+void CheckpointFlusher::flushing() {
+    size_t tick_budget = std::max<size_t>(1, _bandwidth * TICK_MS / 1000);
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_running.load()) {
+        size_t budget = tick_budget;
+        for (EmbeddingStorage* st: _storages) {
+            if (budget == 0) {
+                break;
+            }
+            budget -= flush_storage(*st, budget);
+        }
+        _flushed_bytes.fetch_add(tick_budget - budget, std::memory_order_relaxed);
+        _cv.wait_for(lock, std::chrono::milliseconds(size_t(TICK_MS)));
+    }
+}
+
+size_t CheckpointFlusher::flush_storage(EmbeddingStorage& st, size_t budget) {
+    // Persisting bumps the version, a pass flushing nothing catches up with it.
+    uint64_t version = st.persist_version.load();
+    if (st.flushed_version.load() == version) {
+        return 0;
+    }
+    size_t flushed = 0;
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    for (auto& pair: st._shards) {
+        ps::ShardData& shard = *pair.second;
+        EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+        size_t i = 0;
+        while (flushed < budget) {
+            core::lock_guard<core::RWSpinLock> guard(shard._lock);
+            const std::vector<uint32_t>& variable_ids = ht.variable_ids();
+            if (i >= variable_ids.size()) {
+                break;
+            }
+            size_t chunk = std::min(budget - flushed, size_t(CHUNK_BYTES));
+            size_t n = ht[variable_ids[i]].flush_checkpoint(chunk);
+            flushed += n;
+            if (n < chunk) {
+                ++i; // otherwise the variable may have more items
+            }
+        }
+    }
+    if (flushed == 0) {
+        st.flushed_version.store(version);
+    }
+    return std::min(flushed, budget);
+}
+
+}
+}
+}
@@ -0,0 +1,64 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_CHECKPOINT_FLUSHER_H
+#define PARADIGM4_HYPEREMBEDDING_CHECKPOINT_FLUSHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+class EmbeddingStorage;
+
+// One thread of a server flushing the committing checkpoints of persisted models to pmem
+// in the background, at most bandwidth bytes per second. The shard lock is held for one
+// small chunk at a time, so the flushing is interleaved with the batches.
+class CheckpointFlusher {
+public:
+    static constexpr size_t CHUNK_BYTES = 1 << 20;
+    static constexpr size_t TICK_MS = 10;
+
+    static CheckpointFlusher& singleton() {
+        static CheckpointFlusher flusher;
+        return flusher;
+    }
+
+    void initialize(size_t bandwidth);
+
+    void finalize();
+
+    bool running() {
+        return _running.load();
+    }
+
+    void add_storage(EmbeddingStorage* st);
+
+    void remove_storage(EmbeddingStorage* st);
+
+    uint64_t flushed_bytes() {
+        return _flushed_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    void flushing();
+
+    // Returns the bytes flushed, at most budget.
+    size_t flush_storage(EmbeddingStorage& st, size_t budget);
+
+    std::atomic<bool> _running = {false};
+    size_t _bandwidth = 0; // bytes per second
+    std::thread _thread;
+    std::mutex _mutex; // guards the storages and wakes the thread
+    std::condition_variable _cv;
+    std::unordered_set<EmbeddingStorage*> _storages;
+    std::atomic<uint64_t> _flushed_bytes = {0};
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include "EmbeddingDirectLoadOperator.h"
+
+#include <pico-core/ThreadGroup.h>
+#include "EmbeddingInitOperator.h"
+#include "EmbeddingShardFile.h"
+#include "EmbeddingIndexedFile.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Files dumped with dump_file_per_shard are "model_<node>_<file>_<shard>",
+// indexed files are "indexed_<shard>_<variable>", other files may contain any shards.
+static int32_t file_shard(const std::string& path) {
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    int node_id, file_id, shard_id, variable_id;
+    if (sscanf(name.c_str(), "model_%d_%d_%d", &node_id, &file_id, &shard_id) == 3) {
+        return shard_id;
+    }
+    if (sscanf(name.c_str(), "indexed_%d_%d", &shard_id, &variable_id) == 2) {
+        return shard_id;
+    }
+    return -1;
+}
+
+// Every shard meta of the file is checked, rows are set until the first error.
+static ps::Status load_file(const std::string& path, int32_t shard_id,
+      ps::RuntimeInfo& rt, EmbeddingStorage& st) {
+    FileReader reader;
+    if (!reader.open(path, FileReader::LARGE_BUFFER_SIZE)) {
+        return ps::Status::Error("open model file failed: " + path);
+    }
+    EmbeddingShardDataMeta shard;
+    core::vector<uint64_t> indices;
+    core::vector<char> weights;
+    core::vector<char> states;
+    while (read_shard_meta(reader, shard)) {
+        if (shard.shard_id != shard_id || shard.shard_num != rt.global_shard_num()) {
+            return ps::Status::InvalidConfig("shard " + std::to_string(shard.shard_id) + " of "
+                  + std::to_string(shard.shard_num) + " in model file: " + path);
+        }
+        bool state_matched = true;
+        st.write_shard(shard.shard_id, [&](boost::any& any) {
+            EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&any);
+            auto& variable = ht.get(shard.variable_id, shard.meta);
+            EmbeddingVariableContext variable_context;
+            variable_context.variable_id = shard.variable_id;
+            variable.set_variable_context(variable_context);
+            load_variable_config(variable, shard.meta, shard.config, rt.global_shard_num());
+            state_matched = shard.state_line_size == 0 || shard.state_line_size == variable.state_line_size();
+        });
+        if (!state_matched) {
+            return ps::Status::InvalidConfig("optimizer state size changed in model file: " + path);
+        }
+        uint64_t cursor = 0, n = 0;
+        while (cursor < shard.num_items) {
+            if (!reader.read(n) || n > shard.num_items - cursor) {
+                return ps::Status::Error("malformed model file: " + path);
+            }
+            indices.resize(n);
+            weights.resize(n * shard.meta.line_size());
+            states.resize(n * shard.state_line_size);
+            if (!reader.read(indices.data(), indices.size()) ||
+                  !reader.read(weights.data(), weights.size()) ||
+                  !reader.read(states.data(), states.size())) {
+                return ps::Status::Error("truncated model file: " + path);
+            }
+            st.write_shard(shard.shard_id, [&](boost::any& any) {
+                EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&any);
+                ht[shard.variable_id].set_weights(indices.data(), n, weights.data(),
+                      shard.state_line_size ? states.data() : nullptr);
+            });
+            cursor += n;
+        }
+    }
+    if (reader.error()) {
+        return ps::Status::Error("truncated model file: " + path);
+    }
+    return ps::Status();
+}
+
+ps::Status EmbeddingDirectLoadOperator::generate_request(EmbeddingDirectLoadItems& items,
+        ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) {
+    for (auto& node: rt.nodes()) {
+        reqs.emplace_back(node.first);
+        reqs.back() << items.uri << items.threads;
+    }
+    return ps::Status();
+}
+
+void EmbeddingDirectLoadOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
+    VTIMER(1, embedding_direct_load, apply_request, ms);
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    std::string uri_str;
+    size_t threads;
+    req >> uri_str >> threads;
+    core::URIConfig uri(uri_str);
+
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    std::unordered_set<int32_t> local_shards = st.local_shards(rt);
+    // Files not dumped per shard would be read by every server, N times the bytes of
+    // the relay load, so they are loaded by the client relay.
+    bool relay = false;
+    std::vector<std::string> paths, indexed_paths;
+    for (auto& path: core::FileSystem::get_file_list(uri.uri())) {
+        int32_t shard_id = file_shard(path);
+        if (shard_id == -1) {
+            relay = true;
+        } else if (!local_shards.count(shard_id)) {
+            continue;
+        } else if (IndexedShardFile::match(path)) {
+            indexed_paths.push_back(path);
+        } else {
+            paths.push_back(path);
+        }
+    }
+    // Indexed files are mapped for read only pulls instead of loaded.
+    ps::Status status;
+    std::vector<std::shared_ptr<const IndexedShardFile>> mapped;
+    for (const std::string& path: indexed_paths) {
+        auto file = std::make_shared<IndexedShardFile>();
+        if (!file->open(core::URIConfig(path).name())) {
+            status = ps::Status::Error("open indexed file failed: " + path);
+        } else if (file->footer().shard_num != rt.global_shard_num()) {
+            status = ps::Status::InvalidConfig("indexed file of another shard num: " + path);
+        }
+        mapped.push_back(std::move(file));
+    }
+    if (relay) {
+        SLOG(INFO) << "model files not dumped per shard, load by client";
+    } else if (status.ok()) {
+        for (auto& file: mapped) {
+            st.mapped.install(std::move(file));
+        }
+        // Shard indices depend on the shard number, so check all files before setting any rows.
+        for (const std::string& path: paths) {
+            FileReader reader;
+            EmbeddingShardDataMeta shard;
+            if (!reader.open(path)) {
+                status = ps::Status::Error("open model file failed: " + path);
+                break;
+            }
+            if (read_shard_meta(reader, shard) && shard.shard_num != rt.global_shard_num()) {
+                SLOG(INFO) << "shard num changed from " << shard.shard_num << " to "
+                      << rt.global_shard_num() << ", load by client";
+                relay = true;
+                break;
+            }
+        }
+    }
+    if (!relay && status.ok()) {
+        core::ThreadGroup group(std::max<size_t>(1, std::min(threads, paths.size())));
+        std::vector<core::AsyncReturn> asyncs;
+        std::vector<ps::Status> statuses(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i) {
+            asyncs.push_back(group.async_exec([&, i](int) {
+                statuses[i] = load_file(paths[i], file_shard(paths[i]), rt, st);
+            }));
+        }
+        for (core::AsyncReturn& async: asyncs) {
+            async.wait();
+        }
+        for (ps::Status& file_status: statuses) {
+            if (!file_status.ok()) {
+                status = file_status;
+                break;
+            }
+        }
+    }
+    if (!status.ok()) {
+        ps::PSResponse resp(req);
+        resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
+        resp << status << psmeta;
+        dealer->send_response(std::move(resp.rpc_response()));
+        return;
+    }
+
+    ps::PSResponse resp(req);
+    resp << relay << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+}
+
+ps::Status EmbeddingDirectLoadOperator::apply_response(ps::PSResponse& resp, int&, void* result) {
+    SCHECK(result) << "result not set!";
+    bool relay;
+    resp >> relay;
+    SCHECK(resp.archive().is_exhausted());
+    static_cast<EmbeddingDirectLoadItems*>(result)->relay |= relay;
+    return ps::Status();
+}
+
+}
+}
+}
@@ -0,0 +1,48 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_DIRECT_LOAD_OPERATOR_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_DIRECT_LOAD_OPERATOR_H
+
+#include <pico-ps/operator/UDFOperator.h>
+#include "EmbeddingStorage.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+struct EmbeddingDirectLoadItems {
+    std::string uri;
+    size_t threads = 4;
+    bool relay = false; // result, the files need to be loaded by the client relay
+};
+
+// Every server reads the dumped files of a storage from shared storage and sets the rows
+// of the shards it serves, without sending them through the client. Only files dumped per
+// shard are read, by the servers of the shard. If any file may contain all the shards, or
+// the files were dumped with another shard number, nothing is loaded and relay is set.
+// Indexed files are mapped for read only pulls.
+class EmbeddingDirectLoadOperator: public ps::UDFOperator<EmbeddingDirectLoadItems, int> {
+public:
+    EmbeddingDirectLoadOperator(const Configure& config):
+          ps::UDFOperator<EmbeddingDirectLoadItems, int>(config) {}
+
+    ~EmbeddingDirectLoadOperator() override {}
+
+    EmbeddingDirectLoadOperator(EmbeddingDirectLoadOperator&&) = default;
+    EmbeddingDirectLoadOperator& operator=(EmbeddingDirectLoadOperator&&) = default;
+
+    bool read_only() override { return false; }
+
+    ps::Status generate_request(EmbeddingDirectLoadItems& items,
+          ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) override;
+
+    void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          const ps::TableDescriptor& table, core::Dealer* dealer) override;
+
+    ps::Status apply_response(ps::PSResponse& resp, int&, void* result) override;
+};
+
+
+}
+}
+}
+
+#endif
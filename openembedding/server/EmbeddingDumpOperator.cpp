@@ -1,8 +1,10 @@
 #include "EmbeddingDumpOperator.h"
 
+#include <pico-core/ThreadGroup.h>
 #include <pico-ps/operator/DumpOperator.h>
 #include "EmbeddingVariable.h"
 #include "EmbeddingShardFile.h"
+#include "EmbeddingIndexedFile.h"
 #include "EmbeddingStorage.h"
 #include "Factory.h"
 
@@ -10,54 +12,145 @@ namespace paradigm4 {
 namespace pico {
 namespace embedding {
 
-void EmbeddingDumpOperator::apply_request(ps::RuntimeInfo& rt,
-        ps::PSRequest& req,
-        ps::Storage* storage,
-        ps::PSResponse& resp_ret) {
-    ps::DumpArgs dump_args;
-    req >> dump_args;
-    int32_t file_id;
-    req >> file_id;
-    std::vector<int32_t> shard_ids;
-    req >> shard_ids;
-    SCHECK(req.archive().is_exhausted());
-    ps::PSResponse resp(req);
-    //core::FileSystem::mkdir_p(dump_args.uri());
-
-    core::URIConfig uri(dump_args.uri());
-    std::string file = format_string("/model_%d_%d", rt.node_id(), file_id);
-    FileWriter writer;
+static void open_writer(const core::URIConfig& uri, const std::string& file, FileWriter& writer) {
     if (!writer.open(uri + file)) {
         if (uri.storage_type() != core::FileSystemType::HDFS) {
             core::FileSystem::mkdir_p(uri);
         }
         SCHECK(writer.open(uri + file));
     }
-    bool include_optimizer = true;
-    uri.config().get_val("include_optimizer", include_optimizer);
+}
 
-    bool persist_model = false;
-    uri.config().get_val("persist_model", persist_model);
-    if (persist_model && !include_optimizer) {
-        SLOG(WARNING) << "persist model not support without optimizer.";
-        include_optimizer = true;
+// A variable being dumped. Rows are read from a snapshot with shared shard locks while
+// training goes on, or from the variable with the shard locked if snapshots are not supported.
+struct VariableDump {
+    std::shared_ptr<EmbeddingVariableBase> variable;
+    EmbeddingShardDataMeta shard_meta;
+    bool snapshot = false;
+    bool delta = false;
+    core::vector<uint64_t> dirty;
+    int reader_id = -1;
+
+    size_t read_indices(uint64_t* indices, size_t n) {
+        if (snapshot) {
+            return variable->read_snapshot_indices(indices, n);
+        }
+        if (reader_id == -1) {
+            reader_id = variable->create_reader();
+        }
+        return variable->read_indices(reader_id, indices, n);
+    }
+
+    void get_weights(const uint64_t* indices, size_t n, char* weights, char* states) {
+        if (snapshot) {
+            variable->get_snapshot_weights(indices, n, weights, states);
+        } else {
+            variable->get_weights(indices, n, weights, states);
+        }
     }
+
+    void end() {
+        if (snapshot) {
+            variable->end_snapshot();
+        } else if (reader_id != -1) {
+            variable->delete_reader(reader_id);
+        }
+    }
+};
+
+// Writes the variables of shards, the buffers are reused between blocks.
+struct ShardDumper {
+    bool include_optimizer = true;
+    bool persist_model = false;
     size_t persist_pending_window = 2;
-    uri.config().get_val("persist_pending_window", persist_pending_window);
-    
-    auto& st = *(static_cast<EmbeddingStorage*>(storage));
-    core::shared_lock_guard<EmbeddingStorage> l(st);
-    for (int32_t shard_id: shard_ids) {
-        SCHECK(rt.local_shards().count(shard_id) != 0) 
-                << "Bad Request: invalid shard_id = " << shard_id;
+    // "base" starts tracking changed rows, "delta" only writes the rows changed since
+    // the last checkpoint, a delta is loaded after its base and the deltas before.
+    std::string checkpoint;
+    bool indexed = false; // indexed files of weights for mmap serving
+    core::vector<uint64_t> indices;
+    core::vector<char> weights;
+    core::vector<char> states;
+
+    void dump(ps::RuntimeInfo& rt, EmbeddingStorage& st, int32_t shard_id, FileWriter& writer) {
         auto& shard = *(st.get(shard_id));
-        // should not lock shared
-        core::lock_guard<ps::ShardData> sl(shard);
+        std::vector<VariableDump> variables;
+        bool snapshot = begin(rt, shard, shard_id, variables);
+        for (VariableDump& dump: variables) {
+            const EmbeddingShardDataMeta& shard_meta = dump.shard_meta;
+            write_shard_meta(writer, shard_meta);
+            size_t block_num_items = dump.variable->server_block_num_items();
+            if (dump.delta) {
+                for (size_t i = 0; i < dump.dirty.size(); i += block_num_items) {
+                    size_t n = std::min(block_num_items, dump.dirty.size() - i);
+                    with_shard(shard, snapshot, [&]() {
+                        read_block(dump, dump.dirty.data() + i, n);
+                    });
+                    write_block(shard_meta, dump.dirty.data() + i, n, writer);
+                }
+            } else if (shard_meta.num_items) {
+                size_t n = 0;
+                indices.resize(block_num_items);
+                do {
+                    with_shard(shard, snapshot, [&]() {
+                        n = dump.read_indices(indices.data(), indices.size());
+                        read_block(dump, indices.data(), n);
+                    });
+                    if (n) {
+                        write_block(shard_meta, indices.data(), n, writer);
+                    }
+                } while (n);
+            }
+        }
+        end(shard, snapshot, variables);
+    }
+
+    // Every variable of the shard is written to an indexed file sorted by index.
+    void dump_indexed(ps::RuntimeInfo& rt, EmbeddingStorage& st, int32_t shard_id, const core::URIConfig& uri) {
+        auto& shard = *(st.get(shard_id));
+        std::vector<VariableDump> variables;
+        bool snapshot = begin(rt, shard, shard_id, variables);
+        for (VariableDump& dump: variables) {
+            const EmbeddingShardDataMeta& shard_meta = dump.shard_meta;
+            with_shard(shard, snapshot, [&]() {
+                indices.resize(shard_meta.num_items);
+                indices.resize(dump.read_indices(indices.data(), indices.size()));
+            });
+            std::sort(indices.begin(), indices.end());
+
+            FileWriter writer;
+            open_writer(uri, format_string("/indexed_%d_%d", shard_id, shard_meta.variable_id)
+                  + IndexedShardFile::SUFFIX, writer);
+            size_t block_num_items = dump.variable->server_block_num_items();
+            for (size_t i = 0; i < indices.size(); i += block_num_items) {
+                size_t n = std::min(block_num_items, indices.size() - i);
+                with_shard(shard, snapshot, [&]() {
+                    read_block(dump, indices.data() + i, n);
+                });
+                writer.write(weights.data(), weights.size());
+            }
+            IndexedShardFile::Footer footer;
+            footer.variable_id = shard_meta.variable_id;
+            footer.shard_id = shard_id;
+            footer.shard_num = shard_meta.shard_num;
+            footer.num_items = indices.size();
+            footer.line_size = shard_meta.meta.line_size();
+            IndexedShardFile::write_tail(writer, footer, indices.data(), shard_meta.meta);
+        }
+        end(shard, snapshot, variables);
+    }
+
+    // Locks the shard and prepares the variables. Returns true if all variables are snapshotted
+    // and the shard is unlocked, otherwise the shard stays locked until end.
+    bool begin(ps::RuntimeInfo& rt, ps::ShardData& shard, int32_t shard_id, std::vector<VariableDump>& variables) {
+        shard.lock();
         EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+        bool snapshot = !persist_model;
         for (uint32_t variable_id: ht.variable_ids()) {
-            EmbeddingVariableBase& variable = ht[variable_id];
-            
-            EmbeddingShardDataMeta shard_meta;
+            variables.emplace_back();
+            VariableDump& dump = variables.back();
+            dump.variable = ht.share(variable_id);
+            EmbeddingVariableBase& variable = *dump.variable;
+            EmbeddingShardDataMeta& shard_meta = dump.shard_meta;
             shard_meta.variable_id = variable_id;
             shard_meta.meta = ht.meta(variable_id);
 
@@ -74,27 +167,167 @@ void EmbeddingDumpOperator::apply_request(ps::RuntimeInfo& rt,
             shard_meta.shard_id = shard_id;
             shard_meta.shard_num = rt.global_shard_num();
             shard_meta.state_line_size = include_optimizer ? variable.state_line_size() : 0;
-            shard_meta.num_items = persist_model ? 0 : variable.num_indices();
-            writer.write(shard_meta);
+            if (!persist_model && !checkpoint.empty()) {
+                bool tracked = variable.take_dirty_indices(dump.dirty);
+                dump.delta = checkpoint == "delta" && tracked;
+                if (checkpoint == "delta" && !tracked) {
+                    SLOG(WARNING) << "no base checkpoint of variable " << variable_id
+                          << " in shard " << shard_id << ", dump all rows.";
+                }
+            }
+            if (snapshot) {
+                dump.snapshot = variable.begin_snapshot();
+                snapshot = dump.snapshot;
+            }
+            shard_meta.num_items = persist_model ? 0 : dump.delta ? dump.dirty.size()
+                  : dump.snapshot ? variable.snapshot_num_indices() : variable.num_indices();
+        }
+        if (!snapshot) {
+            // Some variable does not support snapshots, dump with the shard locked.
+            for (VariableDump& dump: variables) {
+                if (dump.snapshot) {
+                    dump.variable->end_snapshot();
+                    dump.snapshot = false;
+                    dump.shard_meta.num_items = dump.delta ? dump.dirty.size() : dump.variable->num_indices();
+                }
+            }
+            return false;
+        }
+        shard.unlock();
+        return true;
+    }
 
-            if (shard_meta.num_items) {
-                int reader_id = variable.create_reader();
-                size_t n = 0;
-                core::vector<uint64_t> indices(variable.server_block_num_items());
-                while ( (n = variable.read_indices(reader_id, indices.data(), indices.size())) ) {
-                    writer.write(n);
-                    indices.resize(n);
-                    core::vector<char> weights(indices.size() * shard_meta.meta.line_size());
-                    core::vector<char> states(indices.size() * shard_meta.state_line_size);
-                    variable.get_weights(indices.data(), n, weights.data(), states.data());
-                    writer.write(indices.data(), indices.size());
-                    writer.write(weights.data(), weights.size());
-                    writer.write(states.data(), states.size());
+    void end(ps::ShardData& shard, bool snapshot, std::vector<VariableDump>& variables) {
+        if (snapshot) {
+            shard.lock();
+        }
+        for (VariableDump& dump: variables) {
+            dump.end();
+        }
+        shard.unlock();
+    }
+
+    template<class F>
+    static void with_shard(ps::ShardData& shard, bool snapshot, F f) {
+        if (snapshot) {
+            core::shared_lock_guard<core::RWSpinLock> guard(shard._lock);
+            f();
+        } else {
+            f();
+        }
+    }
+
+    void read_block(VariableDump& dump, const uint64_t* block, size_t n) {
+        weights.resize(n * dump.shard_meta.meta.line_size());
+        states.resize(n * dump.shard_meta.state_line_size);
+        dump.get_weights(block, n, weights.data(), states.empty() ? nullptr : states.data());
+    }
+
+    void write_block(const EmbeddingShardDataMeta& shard_meta, const uint64_t* block, size_t n, FileWriter& writer) {
+        writer.write(n);
+        writer.write(block, n);
+        writer.write(weights.data(), weights.size());
+        writer.write(states.data(), states.size());
+    }
+};
+
+void EmbeddingDumpOperator::apply_request(ps::RuntimeInfo& rt,
+        ps::PSRequest& req,
+        ps::Storage* storage,
+        ps::PSResponse& resp_ret) {
+    ps::DumpArgs dump_args;
+    req >> dump_args;
+    int32_t file_id;
+    req >> file_id;
+    std::vector<int32_t> shard_ids;
+    req >> shard_ids;
+    SCHECK(req.archive().is_exhausted());
+    ps::PSResponse resp(req);
+    //core::FileSystem::mkdir_p(dump_args.uri());
+
+    core::URIConfig uri(dump_args.uri());
+    ShardDumper options;
+    uri.config().get_val("include_optimizer", options.include_optimizer);
+    uri.config().get_val("persist_model", options.persist_model);
+    if (options.persist_model && !options.include_optimizer) {
+        SLOG(WARNING) << "persist model not support without optimizer.";
+        options.include_optimizer = true;
+    }
+    uri.config().get_val("persist_pending_window", options.persist_pending_window);
+    uri.config().get_val("checkpoint", options.checkpoint);
+    uri.config().get_val("dump_indexed", options.indexed);
+    // Indexed files only keep the weights.
+    options.indexed = options.indexed && !options.include_optimizer
+          && !options.persist_model && options.checkpoint.empty();
+    bool file_per_shard = false;
+    uri.config().get_val("dump_file_per_shard", file_per_shard);
+    size_t dump_threads = 4;
+    uri.config().get_val("dump_threads", dump_threads);
+    std::string compress;
+    uri.config().get_val("dump_compress", compress);
+    std::string suffix = compress == "lz4" ? Lz4File::SUFFIX : "";
+    
+    auto& st = *(static_cast<EmbeddingStorage*>(storage));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    // Shards moved by online migration, the shards moved in are dumped
+    // with the first local shard of the node.
+    std::unordered_set<int32_t> local_shards = st.local_shards(rt);
+    if (!rt.local_shards().empty()) {
+        int32_t first = *std::min_element(rt.local_shards().begin(), rt.local_shards().end());
+        if (std::count(shard_ids.begin(), shard_ids.end(), first)) {
+            for (int32_t shard_id: local_shards) {
+                if (!rt.local_shards().count(shard_id)) {
+                    shard_ids.push_back(shard_id);
                 }
-                variable.delete_reader(reader_id);
             }
         }
     }
+    std::vector<int32_t> dump_shards;
+    for (int32_t shard_id: shard_ids) {
+        SCHECK(rt.local_shards().count(shard_id) != 0 || local_shards.count(shard_id) != 0) 
+                << "Bad Request: invalid shard_id = " << shard_id;
+        if (local_shards.count(shard_id)) {
+            dump_shards.push_back(shard_id);
+        }
+    }
+
+    if (options.indexed) {
+        core::ThreadGroup threads(std::max<size_t>(1, std::min(dump_threads, dump_shards.size())));
+        std::vector<core::AsyncReturn> asyncs;
+        for (int32_t shard_id: dump_shards) {
+            asyncs.push_back(threads.async_exec([&, shard_id](int) {
+                ShardDumper dumper = options;
+                dumper.dump_indexed(rt, st, shard_id, uri);
+            }));
+        }
+        for (core::AsyncReturn& async: asyncs) {
+            async.wait();
+        }
+    } else if (file_per_shard) {
+        // Every shard is written to its own file, the loader reads all files of the directory.
+        core::ThreadGroup threads(std::max<size_t>(1, std::min(dump_threads, dump_shards.size())));
+        std::vector<core::AsyncReturn> asyncs;
+        for (int32_t shard_id: dump_shards) {
+            asyncs.push_back(threads.async_exec([&, shard_id](int) {
+                FileWriter writer;
+                open_writer(uri, format_string("/model_%d_%d_%d", rt.node_id(), file_id, shard_id) + suffix, writer);
+                ShardDumper dumper = options;
+                dumper.dump(rt, st, shard_id, writer);
+            }));
+        }
+        for (core::AsyncReturn& async: asyncs) {
+            async.wait();
+        }
+    } else {
+        FileWriter writer;
+        open_writer(uri, format_string("/model_%d_%d", rt.node_id(), file_id) + suffix, writer);
+        for (int32_t shard_id: dump_shards) {
+            options.dump(rt, st, shard_id, writer);
+        }
+    }
+    if (options.persist_model) {
+        st.persist_version.fetch_add(1);
+    }
     resp << ps::Status();
     resp_ret = std::move(resp);
 }
@@ -0,0 +1,262 @@
+#include "EmbeddingHotKeyOperator.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+void EmbeddingHotKeys::merge(size_t top_k) {
+    for (auto it = variables.begin(); it != variables.end();) {
+        Variable& variable = it->second;
+        std::unordered_set<uint64_t> present(variable.keys.begin(), variable.keys.end());
+        bool complete = true;
+        for (uint64_t key: variable.keys) {
+            if (!variable.rows.count(key)) {
+                complete = false;
+            }
+        }
+        if (!complete) {
+            SLOG(WARNING) << "owner of hot key not found, skip variable " << it->first;
+            it = variables.erase(it);
+            continue;
+        }
+        core::vector<std::pair<uint64_t, uint64_t>> candidates(variable.counts.begin(), variable.counts.end());
+        std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        });
+        for (auto& candidate: candidates) {
+            if (variable.keys.size() >= top_k) {
+                break;
+            }
+            if (!present.count(candidate.first) && variable.rows.count(candidate.first)) {
+                variable.keys.push_back(candidate.first);
+            }
+        }
+        ++it;
+    }
+}
+
+ps::Status EmbeddingHotKeyOperator::generate_request(EmbeddingHotKeys& items,
+        ps::RuntimeInfo& rt, int& install, std::vector<ps::PSRequest>& reqs) {
+    VTIMER(1, embedding_hot_key, generate_request, ms);
+    install = items.install;
+    for (auto& node: rt.nodes()) {
+        reqs.emplace_back(node.first);
+        auto& req = reqs.back();
+        req << items.install;
+        if (!items.install) {
+            req << items.top_k;
+            continue;
+        }
+        core::BinaryArchive weights(true);
+        req << items.variables.size();
+        for (auto& pair: items.variables) {
+            const EmbeddingHotKeys::Variable& variable = pair.second;
+            size_t line_size = variable.meta.line_size();
+            req << pair.first << variable.meta << variable.keys.size();
+            weights.prepare_write(variable.keys.size() * line_size);
+            char* p = weights.end();
+            for (uint64_t key: variable.keys) {
+                req << key;
+                memcpy(p, variable.rows.at(key).data(), line_size);
+                p += line_size;
+            }
+            weights.advance_end(variable.keys.size() * line_size);
+        }
+        ps::ps_serialize(req.lazy(), _compress_info, std::move(weights));
+    }
+    return ps::Status();
+}
+
+void EmbeddingHotKeyOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
+    VTIMER(1, embedding_hot_key, apply_request, ms);
+    ps::PSResponse resp(req);
+    bool install;
+    req >> install;
+    if (install) {
+        apply_install(req, table);
+    } else {
+        apply_collect(req, resp, table);
+    }
+    resp << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+}
+
+void EmbeddingHotKeyOperator::apply_collect(ps::PSRequest& req, ps::PSResponse& resp,
+        const ps::TableDescriptor& table) {
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    size_t top_k;
+    req >> top_k;
+    int32_t global_shard_num = rt.global_shard_num();
+    std::unordered_set<int32_t> local_shards = st.local_shards(rt);
+    std::map<uint32_t, EmbeddingVariableMeta> metas;
+    for (int32_t shard_id: local_shards) {
+        auto& shard = *(st.get(shard_id));
+        core::shared_lock_guard<core::RWSpinLock> guard(shard._lock);
+        EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+        for (uint32_t variable_id: ht.variable_ids()) {
+            metas.emplace(variable_id, ht.meta(variable_id));
+        }
+    }
+
+    core::BinaryArchive weights(true);
+    resp << metas.size();
+    for (auto& pair: metas) {
+        uint32_t variable_id = pair.first;
+        const EmbeddingVariableMeta& meta = pair.second;
+        core::vector<uint64_t> keys;
+        std::shared_ptr<const HotKeyReplica> replica = st.hot_keys.replica(variable_id);
+        if (replica && replica->meta == meta) {
+            keys = replica->keys;
+        }
+        core::vector<std::pair<uint64_t, uint64_t>> top;
+        if (top_k) {
+            HotKeyCounter& counter = st.hot_keys.counter(variable_id, top_k);
+            top = counter.top(top_k);
+            counter.decay();
+        }
+
+        resp << variable_id << meta << keys.size();
+        for (uint64_t key: keys) {
+            resp << key;
+        }
+        resp << top.size();
+        for (auto& candidate: top) {
+            resp << candidate.first << candidate.second;
+        }
+
+        // Rows of the owned keys and candidates, grouped by shard.
+        ShardPartitioner partitioner = meta.partitioner(global_shard_num);
+        std::map<int32_t, core::vector<uint64_t>> shard_keys;
+        std::unordered_set<uint64_t> visited;
+        auto add_owned = [&](uint64_t key) {
+            int32_t shard_id = partitioner.shard(key);
+            if (local_shards.count(shard_id) && visited.insert(key).second) {
+                shard_keys[shard_id].push_back(key);
+            }
+        };
+        for (uint64_t key: keys) {
+            add_owned(key);
+        }
+        for (auto& candidate: top) {
+            add_owned(candidate.first);
+        }
+        core::vector<uint64_t> owned;
+        core::vector<uint64_t> indices;
+        for (auto& shard_pair: shard_keys) {
+            auto& shard = *(st.get(shard_pair.first));
+            core::shared_lock_guard<core::RWSpinLock> guard(shard._lock);
+            EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+            if (!ht.contains(variable_id) || !(ht.meta(variable_id) == meta)) {
+                continue;
+            }
+            indices.clear();
+            for (uint64_t key: shard_pair.second) {
+                indices.push_back(partitioner.index(key, shard_pair.first));
+            }
+            weights.prepare_write(indices.size() * meta.line_size());
+            ht[variable_id].get_weights(indices.data(), indices.size(), weights.end());
+            weights.advance_end(indices.size() * meta.line_size());
+            owned.insert(owned.end(), shard_pair.second.begin(), shard_pair.second.end());
+        }
+        resp << owned.size();
+        for (uint64_t key: owned) {
+            resp << key;
+        }
+    }
+    ps::ps_serialize(resp.lazy(), _compress_info, std::move(weights));
+}
+
+void EmbeddingHotKeyOperator::apply_install(ps::PSRequest& req, const ps::TableDescriptor& table) {
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    size_t variable_num;
+    req >> variable_num;
+    core::vector<std::pair<uint32_t, std::shared_ptr<HotKeyReplica>>> replicas;
+    for (size_t i = 0; i < variable_num; ++i) {
+        uint32_t variable_id;
+        size_t num_keys;
+        std::shared_ptr<HotKeyReplica> replica = std::make_shared<HotKeyReplica>();
+        req >> variable_id >> replica->meta >> num_keys;
+        replica->keys.resize(num_keys);
+        for (uint64_t& key: replica->keys) {
+            req >> key;
+        }
+        replicas.emplace_back(variable_id, std::move(replica));
+    }
+    core::BinaryArchive weights;
+    ps::ps_deserialize(req.lazy(), _compress_info, weights);
+    const char* p = weights.cursor();
+    for (auto& pair: replicas) {
+        HotKeyReplica& replica = *pair.second;
+        size_t line_size = replica.meta.line_size();
+        replica.weights.assign(p, p + replica.keys.size() * line_size);
+        p += replica.keys.size() * line_size;
+        for (size_t j = 0; j < replica.keys.size(); ++j) {
+            replica.offsets.force_emplace(replica.keys[j], j * line_size);
+        }
+        std::shared_ptr<const HotKeyReplica> old = st.hot_keys.replica(pair.first);
+        if (old && old->meta == replica.meta && (old->keys.size() > replica.keys.size()
+              || !std::equal(old->keys.begin(), old->keys.end(), replica.keys.begin()))) {
+            SLOG(WARNING) << "hot keys of variable " << pair.first << " rebuilt, clients will relearn them";
+        }
+        st.hot_keys.set_replica(pair.first, std::move(pair.second));
+    }
+}
+
+ps::Status EmbeddingHotKeyOperator::apply_response(ps::PSResponse& resp, int& install, void* result) {
+    if (install) {
+        SCHECK(resp.archive().is_exhausted());
+        return ps::Status();
+    }
+    SCHECK(result) << "result not set!";
+    auto& hot_keys = *static_cast<EmbeddingHotKeys*>(result);
+    core::vector<std::pair<uint32_t, core::vector<uint64_t>>> owned;
+    size_t variable_num;
+    resp >> variable_num;
+    for (size_t i = 0; i < variable_num; ++i) {
+        uint32_t variable_id;
+        EmbeddingVariableMeta meta;
+        size_t num_keys, num_candidates, num_owned;
+        resp >> variable_id >> meta >> num_keys;
+        core::vector<uint64_t> keys(num_keys);
+        for (uint64_t& key: keys) {
+            resp >> key;
+        }
+        EmbeddingHotKeys::Variable& variable = hot_keys.variables[variable_id];
+        variable.meta = meta;
+        if (keys.size() > variable.keys.size()) {
+            variable.keys = std::move(keys);
+        }
+        resp >> num_candidates;
+        for (size_t j = 0; j < num_candidates; ++j) {
+            uint64_t key, count;
+            resp >> key >> count;
+            variable.counts[key] += count;
+        }
+        resp >> num_owned;
+        owned.emplace_back(variable_id, core::vector<uint64_t>(num_owned));
+        for (uint64_t& key: owned.back().second) {
+            resp >> key;
+        }
+    }
+    core::BinaryArchive weights;
+    ps_deserialize(resp.lazy(), _compress_info, weights);
+    const char* p = weights.cursor();
+    for (auto& pair: owned) {
+        EmbeddingHotKeys::Variable& variable = hot_keys.variables[pair.first];
+        size_t line_size = variable.meta.line_size();
+        for (uint64_t key: pair.second) {
+            variable.rows[key].assign(p, p + line_size);
+            p += line_size;
+        }
+    }
+    return ps::Status();
+}
+
+}
+}
+}
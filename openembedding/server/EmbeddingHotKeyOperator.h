@@ -0,0 +1,79 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_HOT_KEY_OPERATOR_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_HOT_KEY_OPERATOR_H
+
+#include <pico-ps/operator/UDFOperator.h>
+#include "EmbeddingStorage.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Hot keys of all variables, used as the items of both steps of a refresh
+// and as the result of the collect step.
+struct EmbeddingHotKeys {
+    struct Variable {
+        EmbeddingVariableMeta meta;
+        core::vector<uint64_t> keys; // replicated keys, the longest one of all servers
+        std::unordered_map<uint64_t, uint64_t> counts; // candidates of new keys
+        std::unordered_map<uint64_t, core::vector<char>> rows; // rows of keys and candidates
+    };
+
+    // Append the most pulled candidates to keys until top_k keys.
+    // Keys are never removed, so the prefixes learned by clients are still valid.
+    void merge(size_t top_k);
+
+    // No key is replicated.
+    bool empty()const {
+        for (auto& pair: variables) {
+            if (!pair.second.keys.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool install = false;
+    size_t top_k = 0; // candidates of each server for collect, 0 only collects the rows of keys
+    std::unordered_map<uint32_t, Variable> variables;
+};
+
+// Collect: every server returns its replica keys, its top pulled owned keys and
+// the current rows of the owned ones, then decays its pull counts.
+// Collected after every update_weights without candidates to broadcast the updated rows.
+// Install: every server replaces its read only replicas with the merged keys and rows.
+class EmbeddingHotKeyOperator: public ps::UDFOperator<EmbeddingHotKeys, int> {
+public:
+    EmbeddingHotKeyOperator(const Configure& config):
+          ps::UDFOperator<EmbeddingHotKeys, int>(config) {
+        initialize_compress_info(config, "EmbeddingHotKeyOperator", _compress_info);
+    }
+
+    ~EmbeddingHotKeyOperator() override {}
+
+    EmbeddingHotKeyOperator(EmbeddingHotKeyOperator&&) = default;
+    EmbeddingHotKeyOperator& operator=(EmbeddingHotKeyOperator&&) = default;
+
+    bool read_only() override { return false; }
+
+    ps::Status generate_request(EmbeddingHotKeys& items,
+          ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) override;
+
+    void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          const ps::TableDescriptor& table, core::Dealer* dealer) override;
+
+    ps::Status apply_response(ps::PSResponse& resp, int&, void* result) override;
+
+protected:
+    void apply_collect(ps::PSRequest& req, ps::PSResponse& resp, const ps::TableDescriptor& table);
+
+    void apply_install(ps::PSRequest& req, const ps::TableDescriptor& table);
+
+    ps::CompressInfo _compress_info;
+};
+
+
+}
+}
+}
+
+#endif
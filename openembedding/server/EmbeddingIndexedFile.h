@@ -0,0 +1,179 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_INDEXED_FILE_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_INDEXED_FILE_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+#include <pico-core/RWSpinLock.h>
+#include "EmbeddingShardFile.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Rows of a variable in a shard for serving, mapped into memory and read in place.
+// [rows in the order of indices, page aligned][sorted indices][meta json][footer]
+class IndexedShardFile {
+public:
+    static constexpr const char* SUFFIX = ".exbi";
+    static constexpr uint64_t MAGIC = 0x3130494258424D45ull; // "EMBXBI01"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t PAGE_SIZE = 4096;
+
+    struct Footer {
+        uint64_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint32_t variable_id = 0;
+        int32_t shard_id = 0;
+        int32_t shard_num = 0;
+        uint64_t num_items = 0;
+        uint64_t line_size = 0;
+        uint64_t indices_offset = 0;
+        uint64_t meta_offset = 0;
+        uint64_t meta_size = 0;
+    };
+    static_assert(sizeof(Footer) == 64, "footer of indexed file should be packed");
+
+    static bool match(const std::string& name) {
+        std::string suffix = SUFFIX;
+        return name.size() >= suffix.size() &&
+              name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Called after num_items rows of line_size are written in the order of indices.
+    static void write_tail(FileWriter& writer, Footer footer,
+          const uint64_t* indices, const EmbeddingVariableMeta& meta) {
+        uint64_t rows_size = footer.num_items * footer.line_size;
+        std::vector<char> padding((PAGE_SIZE - rows_size % PAGE_SIZE) % PAGE_SIZE);
+        writer.write(padding.data(), padding.size());
+        std::string json = meta.to_json_node().dump();
+        footer.indices_offset = rows_size + padding.size();
+        footer.meta_offset = footer.indices_offset + footer.num_items * sizeof(uint64_t);
+        footer.meta_size = json.size();
+        writer.write(indices, footer.num_items);
+        writer.write(json.data(), json.size());
+        writer.write(&footer, 1);
+    }
+
+    IndexedShardFile() {}
+    IndexedShardFile(const IndexedShardFile&) = delete;
+    IndexedShardFile& operator=(const IndexedShardFile&) = delete;
+
+    ~IndexedShardFile() {
+        if (_data) {
+            munmap(_data, _size);
+        }
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            SLOG(WARNING) << "open indexed file failed: " << path;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Footer))) {
+            _size = st.st_size;
+            void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+            _data = data == MAP_FAILED ? nullptr : static_cast<char*>(data);
+        }
+        ::close(fd);
+        if (!_data) {
+            SLOG(WARNING) << "map indexed file failed: " << path;
+            return false;
+        }
+        memcpy(&_footer, _data + _size - sizeof(Footer), sizeof(Footer));
+        if (_footer.magic != MAGIC || _footer.version != VERSION || !check_layout()) {
+            SLOG(WARNING) << "bad indexed file: " << path;
+            return false;
+        }
+        core::PicoJsonNode json;
+        if (!json.load(std::string(_data + _footer.meta_offset, _footer.meta_size)) ||
+              !_meta.from_json_node(json) || _meta.line_size() != _footer.line_size) {
+            SLOG(WARNING) << "bad meta of indexed file: " << path;
+            return false;
+        }
+        _indices = reinterpret_cast<const uint64_t*>(_data + _footer.indices_offset);
+        madvise(_data, _footer.indices_offset, MADV_RANDOM);
+        return true;
+    }
+
+    const Footer& footer()const {
+        return _footer;
+    }
+
+    const EmbeddingVariableMeta& meta()const {
+        return _meta;
+    }
+
+    // Rows not in the file are zeros. thread safe
+    void get_weights(const uint64_t* indices, size_t n, char* weights)const {
+        const uint64_t* end = _indices + _footer.num_items;
+        size_t line_size = _footer.line_size;
+        for (size_t i = 0; i < n; ++i) {
+            const uint64_t* it = std::lower_bound(_indices, end, indices[i]);
+            if (it != end && *it == indices[i]) {
+                memcpy(weights, _data + (it - _indices) * line_size, line_size);
+            } else {
+                memset(weights, 0, line_size);
+            }
+            weights += line_size;
+        }
+    }
+
+private:
+    // The sections are in order and inside the file, without overflow.
+    bool check_layout()const {
+        uint64_t rows_size, indices_size, indices_end, meta_end;
+        return !__builtin_mul_overflow(_footer.num_items, _footer.line_size, &rows_size) &&
+              !__builtin_mul_overflow(_footer.num_items, sizeof(uint64_t), &indices_size) &&
+              !__builtin_add_overflow(_footer.indices_offset, indices_size, &indices_end) &&
+              !__builtin_add_overflow(_footer.meta_offset, _footer.meta_size, &meta_end) &&
+              _footer.indices_offset % sizeof(uint64_t) == 0 &&
+              rows_size <= _footer.indices_offset && indices_end <= _footer.meta_offset &&
+              meta_end <= _size - sizeof(Footer);
+    }
+
+    char* _data = nullptr;
+    size_t _size = 0;
+    Footer _footer;
+    EmbeddingVariableMeta _meta;
+    const uint64_t* _indices = nullptr;
+};
+
+// Indexed files mapped by a server for read only pulls, by shard and variable.
+class MappedShards {
+public:
+    std::shared_ptr<const IndexedShardFile> find(int32_t shard_id, uint32_t variable_id) {
+        core::shared_lock_guard<core::RWSpinLock> guard(_lock);
+        auto it = _files.find({shard_id, variable_id});
+        return it == _files.end() ? nullptr : it->second;
+    }
+
+    void install(std::shared_ptr<const IndexedShardFile> file) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _files[{file->footer().shard_id, file->footer().variable_id}] = std::move(file);
+    }
+
+    void erase(int32_t shard_id, uint32_t variable_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _files.erase({shard_id, variable_id});
+    }
+
+    void clear() {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _files.clear();
+    }
+
+private:
+    core::RWSpinLock _lock;
+    std::map<std::pair<int32_t, uint32_t>, std::shared_ptr<const IndexedShardFile>> _files;
+};
+
+}
+}
+}
+
+#endif
@@ -29,12 +29,13 @@ struct EmbeddingInitRequestData: ps::PushRequestData {
             shard.states.clear();
         }
         if (items.indices) {
-            int32_t global_shard_num = shards.size();
+            ShardPartitioner partitioner = items.meta.partitioner(shards.size());
             size_t line_size = items.meta.line_size();
             for (size_t i = 0; i < items.n; ++i) {
                 uint64_t index = items.indices[i];
-                ShardData& shard = shards[index % global_shard_num];
-                shard.indices.push_back(index / global_shard_num);
+                int32_t shard_id = partitioner.shard(index);
+                ShardData& shard = shards[shard_id];
+                shard.indices.push_back(partitioner.index(index, shard_id));
                 shard.weights.insert(shard.weights.end(),
                         items.weights + i * line_size,
                         items.weights + (i + 1) * line_size);
@@ -75,7 +76,8 @@ void EmbeddingInitOperator::generate_push_request(
     SCHECK(rt.global_shard_num() > 0);
     
     // Must be sent to all servers, because it is used to initialize.
-    for (auto& p: rt.nodes()) {
+    ShardPlacement placement = _placement ? _placement->get() : ShardPlacement();
+    for (auto& p: placement.nodes(rt)) {
         int32_t shard_num = p.second.size();
         int32_t block_num = push_request_data.size();
         reqs.emplace_back(p.first, 8 + shard_num * block_num * 12);
@@ -105,6 +107,26 @@ void EmbeddingInitOperator::generate_push_request(
     }
 }
 
+void load_variable_config(EmbeddingVariableBase& variable, const EmbeddingVariableMeta& meta,
+      const std::string& config_str, int32_t global_shard_num) {
+    core::Configure variable_config;
+    variable_config.load(config_str);
+    std::string table = "";
+    if (PersistManager::singleton().use_pmem()) {
+        table = "pmem.";
+        std::string cache_policy = PersistManager::singleton().cache_policy;
+        LOAD_CONFIG(variable_config, cache_policy);
+        SAVE_CONFIG(variable_config, cache_policy);
+    }
+    table += meta.use_hash_table() ? "hash" : "array";
+    SAVE_CONFIG(variable_config, table);
+    if (!meta.use_hash_table()) {
+        uint64_t reserve_items = 1 + meta.vocabulary_size / global_shard_num + 1;
+        SAVE_CONFIG(variable_config, reserve_items);
+    }
+    variable.load_config(variable_config);
+}
+
 void EmbeddingInitOperator::generate_store_request(ps::RuntimeInfo& rt,
         std::vector<ps::PSRequest>& reqs) {
     VTIMER(1, embedding_store, generate_store_request, ms);
@@ -129,7 +151,7 @@ void EmbeddingInitOperator::apply_async_push_request(ps::RuntimeInfo& rt,
         int32_t shard_id;
         req >> shard_id;
 
-        SCHECK(rt.local_shards().count(shard_id) != 0) 
+        SCHECK(st.owns(rt, shard_id)) 
                 << "Bad Request: invalid shard_id = " << shard_id;
 
         auto& shard = *(st.get(shard_id));
@@ -150,21 +172,10 @@ void EmbeddingInitOperator::apply_async_push_request(ps::RuntimeInfo& rt,
             if (clear_weights) {
                 SLOG(INFO) << "clear weights";
                 variable.clear_weights();
+                st.mapped.erase(shard_id, variable_id);
             }
             if (!config_str.empty()) {
-                core::Configure variable_config;
-                variable_config.load(config_str);
-                std::string table = "";
-                if (PersistManager::singleton().use_pmem()) {
-                    table = "pmem.";
-                }
-                table += meta.use_hash_table() ? "hash" : "array";
-                SAVE_CONFIG(variable_config, table);
-                if (!meta.use_hash_table()) {
-                    uint64_t reserve_items = 1 + meta.vocabulary_size / rt.global_shard_num() + 1;
-                    SAVE_CONFIG(variable_config, reserve_items);
-                }
-                variable.load_config(variable_config);
+                load_variable_config(variable, meta, config_str, rt.global_shard_num());
             }
             
             uint64_t shard_item_num, state_line_size;
@@ -4,11 +4,18 @@
 #include <pico-ps/common/EasyHashMap.h>
 #include <pico-ps/operator/PushOperator.h>
 #include "Meta.h"
+#include "ShardPlacement.h"
 
 namespace paradigm4 {
 namespace pico {
 namespace embedding {
 
+class EmbeddingVariableBase;
+
+// Load the dumped config of a variable, with the table chosen by this server.
+void load_variable_config(EmbeddingVariableBase& variable, const EmbeddingVariableMeta& meta,
+      const std::string& config_str, int32_t global_shard_num);
+
 class EmbeddingInitItems: public ps::PushItems {
 public:
     EmbeddingVariableMeta meta;
@@ -28,6 +35,9 @@ class EmbeddingInitOperator : public ps::PushOperator {
 public:
     EmbeddingInitOperator(const Configure& config) : ps::PushOperator(config) {
         initialize_compress_info(config, "EmbeddingInitOperator", _compress_info);
+        if (config.has("storage_id")) {
+            _placement = SharedShardPlacement::storage(config["storage_id"].as<int32_t>());
+        }
     }
 
     ~EmbeddingInitOperator()override {}
@@ -81,6 +91,7 @@ public:
 
 protected:
     ps::CompressInfo _compress_info;
+    std::shared_ptr<SharedShardPlacement> _placement; // only used by client
 };
 
 
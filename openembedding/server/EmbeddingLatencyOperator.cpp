@@ -0,0 +1,46 @@
+#include "EmbeddingLatencyOperator.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+ps::Status EmbeddingLatencyOperator::generate_request(EmbeddingLatencies&,
+        ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) {
+    for (auto& node: rt.nodes()) {
+        reqs.emplace_back(node.first);
+    }
+    return ps::Status();
+}
+
+void EmbeddingLatencyOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
+    auto& rt = *table.runtime_info;
+    std::map<std::string, LatencyCounts> histograms = LatencyHistograms::singleton().counts();
+    ps::PSResponse resp(req);
+    resp << rt.node_id() << histograms.size();
+    for (auto& pair: histograms) {
+        resp << pair.first << pair.second;
+    }
+    resp << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+}
+
+ps::Status EmbeddingLatencyOperator::apply_response(ps::PSResponse& resp, int&, void* result) {
+    SCHECK(result) << "result not set!";
+    auto& latencies = *static_cast<EmbeddingLatencies*>(result);
+    int32_t node_id;
+    size_t num_histograms;
+    resp >> node_id >> num_histograms;
+    std::map<std::string, LatencyCounts>& node = latencies.nodes[node_id];
+    for (size_t i = 0; i < num_histograms; ++i) {
+        std::string name;
+        resp >> name;
+        resp >> node[name];
+    }
+    SCHECK(resp.archive().is_exhausted());
+    return ps::Status();
+}
+
+}
+}
+}
@@ -0,0 +1,61 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_LATENCY_OPERATOR_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_LATENCY_OPERATOR_H
+
+#include <pico-ps/operator/UDFOperator.h>
+#include "EmbeddingStorage.h"
+#include "LatencyHistogram.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Latency histograms of the server processes by node, histograms are shared by all storages of a node.
+struct EmbeddingLatencies {
+    std::map<int32_t, std::map<std::string, LatencyCounts>> nodes;
+
+    core::PicoJsonNode to_json_node()const {
+        core::PicoJsonNode json;
+        std::map<std::string, LatencyCounts> total;
+        for (auto& node_pair: nodes) {
+            core::PicoJsonNode node;
+            for (auto& pair: node_pair.second) {
+                node.add(pair.first, pair.second.to_json_node());
+                total[pair.first] += pair.second;
+            }
+            json.add(std::to_string(node_pair.first), node);
+        }
+        core::PicoJsonNode total_json;
+        for (auto& pair: total) {
+            total_json.add(pair.first, pair.second.to_json_node());
+        }
+        json.add("total", total_json);
+        return json;
+    }
+};
+
+class EmbeddingLatencyOperator: public ps::UDFOperator<EmbeddingLatencies, int> {
+public:
+    EmbeddingLatencyOperator(const Configure& config):
+          ps::UDFOperator<EmbeddingLatencies, int>(config) {}
+
+    ~EmbeddingLatencyOperator() override {}
+
+    EmbeddingLatencyOperator(EmbeddingLatencyOperator&&) = default;
+    EmbeddingLatencyOperator& operator=(EmbeddingLatencyOperator&&) = default;
+
+    bool read_only() override { return true; }
+
+    ps::Status generate_request(EmbeddingLatencies& items,
+          ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) override;
+
+    void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          const ps::TableDescriptor& table, core::Dealer* dealer) override;
+
+    ps::Status apply_response(ps::PSResponse& resp, int&, void* result) override;
+};
+
+}
+}
+}
+
+#endif
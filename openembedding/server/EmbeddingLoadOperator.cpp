@@ -64,7 +64,7 @@ size_t EmbeddingLoadOperator::generate_push_items(std::shared_ptr<void>& stream_
     while (stream.i < stream.files.size()) {
         FileStream& file = stream.files[stream.i];
         if (file.state == 0) {
-            if (file.reader.read(file.shard)) {
+            if (read_shard_meta(file.reader, file.shard)) {
                 if (file.shard.num_items > 0) {
                     file.state = 1;
                 }
@@ -75,6 +75,7 @@ size_t EmbeddingLoadOperator::generate_push_items(std::shared_ptr<void>& stream_
                 push_items.push_back(std::move(items));
                 return 1;
             } else {
+                SCHECK(!file.reader.error()) << "truncated model file";
                 ++stream.i;
             }
         } else {
@@ -117,7 +118,7 @@ void EmbeddingLoadOperator::restore(const URIConfig& uri, ps::RuntimeInfo& rt, p
     DataStream stream(uri);
     while (stream.i < stream.files.size()) {
         FileStream& file = stream.files[stream.i];
-        while (file.reader.read(file.shard)) {
+        while (read_shard_meta(file.reader, file.shard)) {
             SCHECK(file.shard.shard_num == rt.global_shard_num());
             SCHECK(rt.local_shards().count(file.shard.shard_id));
             SCHECK(file.shard.num_items == 0);
@@ -134,6 +135,7 @@ void EmbeddingLoadOperator::restore(const URIConfig& uri, ps::RuntimeInfo& rt, p
             variable_config.load(file.shard.config);
             variable.load_config(variable_config);
         }
+        SCHECK(!file.reader.error()) << "truncated model file";
         ++stream.i;
     }
 }
@@ -0,0 +1,60 @@
+#include "EmbeddingMemoryOperator.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+ps::Status EmbeddingMemoryOperator::generate_request(EmbeddingStorageMemory&,
+        ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) {
+    for (auto& node: rt.nodes()) {
+        reqs.emplace_back(node.first);
+    }
+    return ps::Status();
+}
+
+void EmbeddingMemoryOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    std::unordered_set<int32_t> local_shards = st.local_shards(rt);
+    ps::PSResponse resp(req);
+    resp << rt.node_id() << st.holders_memory_usage() << local_shards.size();
+    for (int32_t shard_id: local_shards) {
+        std::map<uint32_t, EmbeddingMemoryUsage> variables = st.variables_memory_usage(shard_id);
+        resp << shard_id << variables.size();
+        for (auto& pair: variables) {
+            resp << pair.first << pair.second;
+        }
+    }
+    resp << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+}
+
+ps::Status EmbeddingMemoryOperator::apply_response(ps::PSResponse& resp, int&, void* result) {
+    SCHECK(result) << "result not set!";
+    auto& memory = *static_cast<EmbeddingStorageMemory*>(result);
+    int32_t node_id;
+    uint64_t holders;
+    size_t shard_num;
+    resp >> node_id >> holders >> shard_num;
+    EmbeddingStorageMemory::Node& node = memory.nodes[node_id];
+    node.holders = holders;
+    for (size_t i = 0; i < shard_num; ++i) {
+        int32_t shard_id;
+        size_t variable_num;
+        resp >> shard_id >> variable_num;
+        auto& shard = node.shards[shard_id];
+        for (size_t j = 0; j < variable_num; ++j) {
+            uint32_t variable_id;
+            resp >> variable_id;
+            resp >> shard[variable_id];
+        }
+    }
+    SCHECK(resp.archive().is_exhausted());
+    return ps::Status();
+}
+
+}
+}
+}
@@ -0,0 +1,71 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_MEMORY_OPERATOR_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_MEMORY_OPERATOR_H
+
+#include <pico-ps/operator/UDFOperator.h>
+#include "EmbeddingStorage.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Memory of a storage on every server, by shard and variable.
+struct EmbeddingStorageMemory {
+    struct Node {
+        uint64_t holders = 0; // push requests held until the next store
+        std::map<int32_t, std::map<uint32_t, EmbeddingMemoryUsage>> shards;
+    };
+    std::map<int32_t, Node> nodes;
+
+    core::PicoJsonNode to_json_node()const {
+        core::PicoJsonNode json;
+        EmbeddingMemoryUsage storage_total;
+        for (auto& node_pair: nodes) {
+            core::PicoJsonNode node;
+            EmbeddingMemoryUsage node_total;
+            for (auto& shard_pair: node_pair.second.shards) {
+                core::PicoJsonNode shard;
+                EmbeddingMemoryUsage shard_total;
+                for (auto& variable_pair: shard_pair.second) {
+                    shard.add(std::to_string(variable_pair.first), variable_pair.second.to_json_node());
+                    shard_total += variable_pair.second;
+                }
+                shard.add("total", shard_total.to_json_node());
+                node.add(std::to_string(shard_pair.first), shard);
+                node_total += shard_total;
+            }
+            node.add("holders", node_pair.second.holders);
+            node.add("total", node_total.to_json_node());
+            json.add(std::to_string(node_pair.first), node);
+            storage_total += node_total;
+        }
+        json.add("total", storage_total.to_json_node());
+        return json;
+    }
+};
+
+class EmbeddingMemoryOperator: public ps::UDFOperator<EmbeddingStorageMemory, int> {
+public:
+    EmbeddingMemoryOperator(const Configure& config):
+          ps::UDFOperator<EmbeddingStorageMemory, int>(config) {}
+
+    ~EmbeddingMemoryOperator() override {}
+
+    EmbeddingMemoryOperator(EmbeddingMemoryOperator&&) = default;
+    EmbeddingMemoryOperator& operator=(EmbeddingMemoryOperator&&) = default;
+
+    bool read_only() override { return true; }
+
+    ps::Status generate_request(EmbeddingStorageMemory& items,
+          ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) override;
+
+    void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          const ps::TableDescriptor& table, core::Dealer* dealer) override;
+
+    ps::Status apply_response(ps::PSResponse& resp, int&, void* result) override;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include "EmbeddingMigrateOperator.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+ps::Status EmbeddingMigrateOperator::generate_request(EmbeddingMigrateItems& items,
+        ps::RuntimeInfo& rt, int32_t& step, std::vector<ps::PSRequest>& reqs) {
+    VTIMER(1, embedding_migrate, generate_request, ms);
+    step = items.step;
+    if (items.step == EmbeddingMigrateItems::QUERY || items.step == EmbeddingMigrateItems::INSTALL) {
+        for (auto& node: rt.nodes()) {
+            reqs.emplace_back(node.first);
+            reqs.back() << items.step << items.placement;
+        }
+        return ps::Status();
+    }
+    if (!rt.nodes().count(items.node_id)) {
+        return ps::Status::InvalidID("node not found: " + std::to_string(items.node_id));
+    }
+    if (items.shard_id < 0 || items.shard_id >= rt.global_shard_num()) {
+        return ps::Status::InvalidID("shard not found: " + std::to_string(items.shard_id));
+    }
+    reqs.emplace_back(items.node_id);
+    auto& req = reqs.back();
+    req << items.step << items.shard_id;
+    if (items.step == EmbeddingMigrateItems::READ) {
+        req << items.start << items.offset;
+    } else if (items.step == EmbeddingMigrateItems::WRITE) {
+        req << items.blocks;
+    }
+    return ps::Status();
+}
+
+void EmbeddingMigrateOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
+    VTIMER(1, embedding_migrate, apply_request, ms);
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    ps::PSResponse resp(req);
+    ps::Status status;
+    int32_t step;
+    req >> step;
+    if (step == EmbeddingMigrateItems::QUERY) {
+        core::shared_lock_guard<core::RWSpinLock> guard(st.placement_lock);
+        resp << st.placement;
+    } else if (step == EmbeddingMigrateItems::READ) {
+        status = apply_read(req, resp, table);
+    } else if (step == EmbeddingMigrateItems::WRITE) {
+        status = apply_write(req, table);
+    } else if (step == EmbeddingMigrateItems::SYNC) {
+        status = apply_sync(req, resp, table);
+    } else if (step == EmbeddingMigrateItems::INSTALL) {
+        status = apply_install(req, table);
+    } else {
+        status = ps::Status::InvalidConfig("unknown migrate step");
+    }
+    if (!status.ok()) {
+        resp = ps::PSResponse(req);
+        resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
+        resp << status;
+    }
+    resp << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+}
+
+ps::Status EmbeddingMigrateOperator::apply_read(ps::PSRequest& req, ps::PSResponse& resp,
+        const ps::TableDescriptor& table) {
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    int32_t shard_id;
+    bool start;
+    uint64_t offset;
+    req >> shard_id >> start >> offset;
+    if (!st.owns(rt, shard_id)) {
+        return ps::Status::InvalidID("shard not on this node: " + std::to_string(shard_id));
+    }
+    if (start) {
+        // rows changed from now on are resent by SYNC, the copy begins at the next store
+        st.migration.start(shard_id);
+        resp << false << offset << std::vector<EmbeddingMigrateBlock>();
+        return ps::Status();
+    }
+
+    // The keys are listed once and the rows are read by offset in later requests,
+    // no reader is kept between the requests. Rows updated after the listing are recorded.
+    auto& shard = *(st.get(shard_id));
+    core::shared_lock_guard<core::RWSpinLock> guard(shard._lock);
+    EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+    auto keys = st.migration.keys(shard_id, [&ht]() {
+        MigrationTracker::Keys keys;
+        std::vector<uint32_t> variable_ids = ht.variable_ids();
+        std::sort(variable_ids.begin(), variable_ids.end());
+        for (uint32_t variable_id: variable_ids) {
+            EmbeddingVariableBase& variable = ht[variable_id];
+            keys.emplace_back(variable_id, core::vector<uint64_t>(variable.num_indices()));
+            core::vector<uint64_t>& indices = keys.back().second;
+            int reader_id = variable.create_reader();
+            size_t n = 0, read = 1;
+            while (n < indices.size() && read) {
+                read = variable.read_indices(reader_id, indices.data() + n, indices.size() - n);
+                n += read;
+            }
+            indices.resize(n);
+            variable.delete_reader(reader_id);
+        }
+        return keys;
+    });
+    if (keys == nullptr) {
+        // waiting for the store
+        resp << false << offset << std::vector<EmbeddingMigrateBlock>();
+        return ps::Status();
+    }
+
+    size_t vid = 0;
+    uint64_t index = offset;
+    while (vid < keys->size() && index >= (*keys)[vid].second.size()) {
+        index -= (*keys)[vid].second.size();
+        ++vid;
+    }
+    if (vid == keys->size()) {
+        resp << true << offset << std::vector<EmbeddingMigrateBlock>();
+        return ps::Status();
+    }
+
+    uint32_t variable_id = (*keys)[vid].first;
+    const core::vector<uint64_t>& indices = (*keys)[vid].second;
+    EmbeddingVariableBase& variable = ht[variable_id];
+    std::vector<EmbeddingMigrateBlock> blocks(1);
+    EmbeddingMigrateBlock& block = blocks.back();
+    block.variable_id = variable_id;
+    block.meta = ht.meta(variable_id);
+    block.state_line_size = variable.state_line_size();
+    size_t n = std::min<uint64_t>(variable.server_block_num_items(), indices.size() - index);
+    block.indices.assign(indices.begin() + index, indices.begin() + index + n);
+    offset += n;
+    core::Configure config;
+    variable.dump_config(config);
+    block.config = config.dump();
+    block.weights.resize(block.indices.size() * block.meta.line_size());
+    block.states.resize(block.indices.size() * block.state_line_size);
+    variable.get_weights(block.indices.data(), block.indices.size(),
+          block.weights.data(), block.states.data());
+    resp << false << offset << blocks;
+    return ps::Status();
+}
+
+ps::Status EmbeddingMigrateOperator::apply_write(ps::PSRequest& req, const ps::TableDescriptor& table) {
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    int32_t shard_id;
+    std::vector<EmbeddingMigrateBlock> blocks;
+    req >> shard_id >> blocks;
+    if (st.owns(rt, shard_id)) {
+        return ps::Status::InvalidID("shard already served by this node: " + std::to_string(shard_id));
+    }
+    if (!st.exist_shard(shard_id)) {
+        st.create_shard(shard_id);
+    }
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    st.write_shard(shard_id, [&](boost::any& any) {
+        EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&any);
+        for (EmbeddingMigrateBlock& block: blocks) {
+            auto& variable = ht.get(block.variable_id, block.meta);
+            EmbeddingVariableContext variable_context;
+            variable_context.variable_id = block.variable_id;
+            variable.set_variable_context(variable_context);
+            core::Configure config;
+            config.load(block.config);
+            variable.load_config(config);
+            if (block.state_line_size != variable.state_line_size()) {
+                block.states.clear();
+            }
+            variable.set_weights(block.indices.data(), block.indices.size(), block.weights.data(),
+                  block.states.empty() ? nullptr : block.states.data());
+        }
+    });
+    return ps::Status();
+}
+
+ps::Status EmbeddingMigrateOperator::apply_sync(ps::PSRequest& req, ps::PSResponse& resp,
+        const ps::TableDescriptor& table) {
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    int32_t shard_id;
+    req >> shard_id;
+    if (!st.owns(rt, shard_id)) {
+        return ps::Status::InvalidID("shard not on this node: " + std::to_string(shard_id));
+    }
+    // Pushes after this SYNC are rejected and resent to the target after INSTALL.
+    // The pushes in flight are drained and the pending gradients are applied here,
+    // so the rows read below are final.
+    st.migration.freeze(shard_id);
+    auto& shard = *(st.get(shard_id));
+    {
+        core::lock_guard<ps::ShardData> sl(shard);
+    }
+    st.async_tasks.wait();
+    core::lock_guard<ps::ShardData> sl(shard);
+    EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+    for (uint32_t variable_id: ht.variable_ids()) {
+        ht[variable_id].update_weights();
+    }
+    auto changed = st.migration.take(shard_id);
+    std::vector<EmbeddingMigrateBlock> blocks;
+    for (uint32_t variable_id: ht.variable_ids()) {
+        // configs are always resent, the optimizer may have global states.
+        EmbeddingVariableBase& variable = ht[variable_id];
+        blocks.emplace_back();
+        EmbeddingMigrateBlock& block = blocks.back();
+        block.variable_id = variable_id;
+        block.meta = ht.meta(variable_id);
+        block.state_line_size = variable.state_line_size();
+        core::Configure config;
+        variable.dump_config(config);
+        block.config = config.dump();
+        auto it = changed.find(variable_id);
+        if (it != changed.end()) {
+            block.indices.assign(it->second.begin(), it->second.end());
+        }
+        block.weights.resize(block.indices.size() * block.meta.line_size());
+        block.states.resize(block.indices.size() * block.state_line_size);
+        variable.get_weights(block.indices.data(), block.indices.size(),
+              block.weights.data(), block.states.data());
+    }
+    resp << blocks;
+    return ps::Status();
+}
+
+ps::Status EmbeddingMigrateOperator::apply_install(ps::PSRequest& req, const ps::TableDescriptor& table) {
+    auto& rt = *table.runtime_info;
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::shared_lock_guard<EmbeddingStorage> l(st);
+    ShardPlacement placement;
+    req >> placement;
+    core::lock_guard<core::RWSpinLock> guard(st.placement_lock);
+    if (placement.version <= st.placement.version) {
+        return ps::Status();
+    }
+    std::unordered_set<int32_t> before = st.placement.local_shards(rt);
+    st.placement = placement;
+    st.placement_version.store(placement.version);
+    std::unordered_set<int32_t> after = st.placement.local_shards(rt);
+    for (int32_t shard_id: before) {
+        if (!after.count(shard_id)) {
+            SLOG(INFO) << "shard " << shard_id << " moved out of node " << rt.node_id();
+            st.migration.stop(shard_id);
+            // the async tasks of the shard lock it when done
+            st.async_tasks.wait();
+            auto& shard = *(st.get(shard_id));
+            core::lock_guard<ps::ShardData> sl(shard);
+            shard.data = EmbeddingShard();
+        }
+    }
+    return ps::Status();
+}
+
+ps::Status EmbeddingMigrateOperator::apply_response(ps::PSResponse& resp, int32_t& step, void* result) {
+    if (step == EmbeddingMigrateItems::WRITE || step == EmbeddingMigrateItems::INSTALL) {
+        SCHECK(resp.archive().is_exhausted());
+        return ps::Status();
+    }
+    SCHECK(result) << "result not set!";
+    auto& items = *static_cast<EmbeddingMigrateItems*>(result);
+    if (step == EmbeddingMigrateItems::QUERY) {
+        ShardPlacement placement;
+        resp >> placement;
+        if (placement.version >= items.placement.version) {
+            items.placement = std::move(placement);
+        }
+    } else if (step == EmbeddingMigrateItems::READ) {
+        resp >> items.finished >> items.offset >> items.blocks;
+    } else if (step == EmbeddingMigrateItems::SYNC) {
+        resp >> items.blocks;
+    }
+    return ps::Status();
+}
+
+}
+}
+}
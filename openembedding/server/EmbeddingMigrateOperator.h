@@ -0,0 +1,83 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_MIGRATE_OPERATOR_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_MIGRATE_OPERATOR_H
+
+#include <pico-ps/operator/UDFOperator.h>
+#include "EmbeddingStorage.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Rows and optimizer states of one variable in a shard.
+struct EmbeddingMigrateBlock {
+    uint32_t variable_id = 0;
+    EmbeddingVariableMeta meta;
+    std::string config;
+    uint64_t state_line_size = 0;
+    std::vector<uint64_t> indices; // shard local
+    std::vector<char> weights;
+    std::vector<char> states;
+    PICO_SERIALIZATION(variable_id, meta, config, state_line_size, indices, weights, states);
+};
+
+// Items and result of one step of an online shard migration.
+struct EmbeddingMigrateItems {
+    enum Step {
+        QUERY = 0,   // all nodes return their placement
+        READ = 1,    // source returns the next rows of the shard, the first READ starts tracking changed rows
+        WRITE = 2,   // target sets the rows, the shard is not served before INSTALL
+        SYNC = 3,    // source returns the rows changed since the first READ, rejects later pushes
+        INSTALL = 4, // all nodes use the new placement, source drops the shard
+    };
+
+    int32_t step = QUERY;
+    int node_id = -1; // READ, WRITE and SYNC are sent to one node
+    int32_t shard_id = -1;
+    bool start = true; // READ restarts the copy
+    uint64_t offset = 0; // cursor of READ, in the keys listed at the first store after the start
+    bool finished = false;
+    std::vector<EmbeddingMigrateBlock> blocks; // READ and SYNC result, WRITE items, no READ result before the store
+    ShardPlacement placement; // QUERY result, INSTALL items
+};
+
+// Moves a shard replica to another node while training. The client streams the rows
+// from the source to the target, then at a batch boundary resends the changed rows
+// and installs the new placement on all nodes. Requests with an old placement version
+// and pushes to the shard between SYNC and INSTALL are rejected with NoReplica, and
+// the client retries them after QUERY.
+class EmbeddingMigrateOperator: public ps::UDFOperator<EmbeddingMigrateItems, int32_t> {
+public:
+    EmbeddingMigrateOperator(const Configure& config):
+          ps::UDFOperator<EmbeddingMigrateItems, int32_t>(config) {}
+
+    ~EmbeddingMigrateOperator() override {}
+
+    EmbeddingMigrateOperator(EmbeddingMigrateOperator&&) = default;
+    EmbeddingMigrateOperator& operator=(EmbeddingMigrateOperator&&) = default;
+
+    bool read_only() override { return false; }
+
+    ps::Status generate_request(EmbeddingMigrateItems& items,
+          ps::RuntimeInfo& rt, int32_t& step, std::vector<ps::PSRequest>& reqs) override;
+
+    void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          const ps::TableDescriptor& table, core::Dealer* dealer) override;
+
+    ps::Status apply_response(ps::PSResponse& resp, int32_t& step, void* result) override;
+
+protected:
+    ps::Status apply_read(ps::PSRequest& req, ps::PSResponse& resp, const ps::TableDescriptor& table);
+
+    ps::Status apply_write(ps::PSRequest& req, const ps::TableDescriptor& table);
+
+    ps::Status apply_sync(ps::PSRequest& req, ps::PSResponse& resp, const ps::TableDescriptor& table);
+
+    ps::Status apply_install(ps::PSRequest& req, const ps::TableDescriptor& table);
+};
+
+
+}
+}
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include <pico-ps/operator/PullOperator.h>
 #include <pico-ps/operator/UDFOperator.h>
 #include "EmbeddingStorage.h"
+#include "LatencyHistogram.h"
+#include "ScatterRows.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -11,7 +13,9 @@ namespace embedding {
 
 void EmbeddingPullRequestData::init(size_t shard_num, size_t block_num) {
     if (block_num != block_offsets.size()) {
+        block_dedups.clear();
         block_offsets.clear();
+        hot_nodes.clear();
     }
     if (shard_num != shards.size()) {
         node_shards.clear();
@@ -26,28 +30,68 @@ void EmbeddingPullRequestData::init(size_t shard_num, size_t block_num) {
         shard.cursor = 0;
         shard.num_indices.clear();
         shard.indices.clear();
+        shard.encoded_indices.clear();
         shard.weights.clear();
     }
-    while (block_offsets.size() < block_num) {
-        block_offsets.emplace_back(-1);
-    }
-    for (auto& offsets: block_offsets) {
-        offsets.clear();
+    block_dedups.resize(block_num);
+    block_offsets.resize(block_num);
+    for (auto& pair: hot_nodes) {
+        HotNodeData& node = pair.second;
+        node.cursor = 0;
+        for (auto& indices: node.indices) {
+            indices.clear();
+        }
+        node.weights.clear();
     }
 }
 
+EmbeddingPullRequestData::HotNodeData& EmbeddingPullRequestData::hot_node(int node_id) {
+    HotNodeData& node = hot_nodes[node_id];
+    node.indices.resize(block_offsets.size());
+    return node;
+}
 
 ps::Status EmbeddingPullOperator::generate_request(core::vector<EmbeddingPullItems>& block_items, 
         ps::RuntimeInfo& rt, EmbeddingPullRequestData& data, std::vector<ps::PSRequest>& reqs) {  
-    data.block_items = block_items;
     VTIMER(1, embedding_pull, generate_request, ms);
+    EMBEDDING_LATENCY(pull_generate_request);
     if (block_items.empty()) {
         return ps::Status();
     }
+    CHECK_STATUS_RETURN(prepare_request(block_items, rt, data));
+    for (auto& p: rt.nodes()) {
+        int node_id = p.first;
+        int32_t shard_num = data.node_shards[node_id].size();
+        int32_t block_num = block_items.size();
+        reqs.emplace_back(node_id, block_num * shard_num * 24);
+        if (!serialize_request(block_items, data, node_id, reqs.back())) {
+            reqs.pop_back();
+        }
+    }
+    data.waiting_reqs = reqs.size();
+    return ps::Status();
+}
+
+ps::Status EmbeddingPullOperator::prepare_request(core::vector<EmbeddingPullItems>& block_items,
+        ps::RuntimeInfo& rt, EmbeddingPullRequestData& data) {
+    data.block_items = block_items;
     int32_t global_shard_num = rt.global_shard_num();
     data.init(global_shard_num, block_items.size());
     
+    std::unordered_set<int> alive_nodes;
+    if (_read_only && _hot_key_top_k) {
+        for (auto& p: rt.nodes()) {
+            alive_nodes.insert(p.first);
+        }
+    }
+    // rotate the replicas of hot keys between requests
+    static thread_local size_t salt = 0;
+    ++salt;
+
+    ShardPlacement placement = _placement ? _placement->get() : ShardPlacement();
+    data.placement_version = placement.version;
     std::vector<int> selected_nodes = rt.pick_one_replica(_algo);
+    placement.pick_one_replica(selected_nodes);
     for (int32_t shard_id = 0; shard_id < rt.global_shard_num(); ++shard_id) {
         int node_id = selected_nodes[shard_id];
         if (node_id == -1) {
@@ -58,60 +102,105 @@ ps::Status EmbeddingPullOperator::generate_request(core::vector<EmbeddingPullIte
     }
     
     for (size_t k = 0; k < block_items.size(); ++k) {
-        auto& offsets = data.block_offsets[k];
         const EmbeddingPullItems& items = block_items[k];
-        size_t line_size = items.meta.line_size();
+        size_t line_size = _wire.line_size(items.meta.datatype, items.meta.embedding_dim);
+        ShardPartitioner partitioner = items.meta.partitioner(global_shard_num);
         if (items.batch_id != block_items[0].batch_id) {
             return ps::Status::Error("request batch_id not same");
         }
-        for (size_t i = 0; i < items.n; ++i) {
-            uint64_t index = items.indices[i];
-            if (index >= items.meta.vocabulary_size) {
-                return ps::Status::Error("embedding index out of range " +
-                      std::to_string(index) + " " + std::to_string(items.meta.vocabulary_size));
-            }
-            if (!offsets.count(index)) {
-                int32_t shard_id = index % global_shard_num;
-                auto& shard = data.shards[shard_id];
-                shard.indices.push_back(index / global_shard_num);
-                offsets.force_emplace(index, shard.cursor);
+        // buckets in key order give sorted shard indices
+        IndexDedup& dedup = data.block_dedups[k];
+        dedup.dedup(items.indices, items.n, partitioner, global_shard_num, _sort_indices);
+        auto& offsets = data.block_offsets[k];
+        offsets.resize(dedup.size());
+        // A replica gets the rows of an update after the store, but a training pull of the next batch
+        // is released by the store, so only the read only pulls are spread to the replicas.
+        HotKeyDirectory* directory = _read_only && _hot_key_top_k ? items.hot_keys : nullptr;
+        core::RWSpinLock no_directory;
+        core::shared_lock_guard<core::RWSpinLock> guard(directory ? directory->lock : no_directory);
+        HotKeyDirectory::Variable* hot = directory ? directory->find(items.variable_id) : nullptr;
+        for (int32_t shard_id = 0; shard_id < global_shard_num; ++shard_id) {
+            auto& shard = data.shards[shard_id];
+            for (size_t j = dedup.bucket_begin(shard_id); j < dedup.bucket_begin(shard_id + 1); ++j) {
+                size_t id = dedup.buckets()[j];
+                uint64_t index = dedup.keys()[id];
+                if (index >= items.meta.vocabulary_size) {
+                    return ps::Status::Error("embedding index out of range " +
+                          std::to_string(index) + " " + std::to_string(items.meta.vocabulary_size));
+                }
+                if (hot) {
+                    int node_id = HotKeyDirectory::pick(*hot, index, alive_nodes, salt);
+                    if (node_id != -1) {
+                        auto& node = data.hot_node(node_id);
+                        node.indices[k].push_back(index);
+                        offsets[id] = {node_id, shard_id, node.cursor};
+                        node.cursor += line_size;
+                        continue;
+                    }
+                }
+                shard.indices.push_back(partitioner.index(index, shard_id));
+                offsets[id] = {-1, shard_id, shard.cursor};
                 shard.cursor += line_size;
             }
+            shard.num_indices.push_back(shard.indices.size());
         }
+    }
+    if (_index_codec.enabled()) {
         for (auto& shard: data.shards) {
-            shard.num_indices.push_back(shard.indices.size());
+            size_t begin = 0;
+            for (size_t num_indices: shard.num_indices) {
+                IndexCodec::encode(shard.indices.data() + begin,
+                      num_indices - begin, shard.encoded_indices);
+                begin = num_indices;
+            }
         }
     }
+    return ps::Status();
+}
 
-    for (auto& p: rt.nodes()) {
-        int node_id = p.first;
-        int32_t shard_num = data.node_shards[node_id].size();
-        int32_t block_num = block_items.size();
-        reqs.emplace_back(node_id, block_num * shard_num * 24);
-        auto& req = reqs.back();
-        req << block_items[0].batch_id << shard_num << block_num;
-        bool hit_node = false;
-        for (int32_t shard_id: data.node_shards[node_id]) {
-            auto& shard = data.shards[shard_id];
-            req << shard_id;
+bool EmbeddingPullOperator::serialize_request(const core::vector<EmbeddingPullItems>& block_items,
+        EmbeddingPullRequestData& data, int node_id, ps::PSRequest& req) {
+    int32_t shard_num = data.node_shards[node_id].size();
+    int32_t block_num = block_items.size();
+    req << block_items[0].batch_id << data.placement_version << shard_num << block_num << _wire.category;
+    bool hit_node = false;
+    for (int32_t shard_id: data.node_shards[node_id]) {
+        auto& shard = data.shards[shard_id];
+        req << shard_id;
+        if (_index_codec.enabled()) {
+            ps::ps_serialize(req.lazy(), _compress_info, ps::vector_rpc_view(shard.encoded_indices));
+        } else {
             ps::ps_serialize(req.lazy(), _compress_info, ps::vector_rpc_view(shard.indices));
-            uint64_t offset = 0;
-            for (int i = 0; i < block_num; ++i) {
-                size_t num_indices = shard.num_indices[i];
-                req << block_items[i].variable_id << block_items[i].meta << num_indices - offset;
-                offset = num_indices;
+        }
+        uint64_t offset = 0;
+        for (int i = 0; i < block_num; ++i) {
+            size_t num_indices = shard.num_indices[i];
+            req << block_items[i].variable_id << block_items[i].meta << num_indices - offset;
+            offset = num_indices;
+        }
+        
+        if (!shard.indices.empty()) {
+            hit_node = true;
+        }
+    }
+    if (_read_only && _hot_key_top_k) {
+        auto& node = data.hot_node(node_id);
+        req << node_id;
+        for (int i = 0; i < block_num; ++i) {
+            const EmbeddingPullItems& items = block_items[i];
+            uint64_t known = 0;
+            if (items.hot_keys) {
+                core::shared_lock_guard<core::RWSpinLock> guard(items.hot_keys->lock);
+                known = items.hot_keys->node_count(items.variable_id, node_id);
             }
-            
-            if (!shard.indices.empty()) {
+            req << items.variable_id << items.meta << known << node.indices[i].size();
+            ps::ps_serialize(req.lazy(), _compress_info, ps::vector_rpc_view(node.indices[i]));
+            if (!node.indices[i].empty()) {
                 hit_node = true;
             }
         }
-        if (!hit_node) {
-            reqs.pop_back();
-        }
     }
-    data.waiting_reqs = reqs.size();
-    return ps::Status();
+    return hit_node;
 }
 
 void EmbeddingPullOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
@@ -119,18 +208,18 @@ void EmbeddingPullOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::P
     VTIMER(1, embedding_pull, apply_request, ms);
         
     auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
-    core::shared_lock_guard<EmbeddingStorage> l(st);
+    ProfiledSharedLockGuard<EmbeddingStorage> l(st, st.storage_lock_stats);
     int64_t batch_id;
     req >> batch_id;
     {
-        core::lock_guard<core::RWSpinLock> pl(st.pending_mutex);
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
         if (st.batch_id < batch_id) {
             size_t delta = batch_id - st.batch_id - 1;
             if (delta < 1024) {
                 while (st.pending.size() <= delta) {
                     st.pending.emplace_back();
                 }
-                st.pending[delta].push_back({psmeta, std::move(req)});
+                st.pending[delta].push_back({psmeta, std::move(req), std::chrono::steady_clock::now()});
             } else {
                 ps::PSResponse resp(req);
                 resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
@@ -148,13 +237,23 @@ void EmbeddingPullOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::P
 /// TODO: check context version 
 void EmbeddingPullOperator::apply_request_pull(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
         const ps::TableDescriptor& table, core::Dealer* dealer) {
+    EMBEDDING_LATENCY(pull_apply_request);
     static thread_local size_t buffer_size = 0;
     auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
     
     bool error = false;
+    bool replica_miss = false;
+    static thread_local size_t requests = 0;
+    bool sample = _hot_key_top_k && ++requests % HotKeyCounter::SAMPLE_INTERVAL == 0;
+    int32_t global_shard_num = table.runtime_info->global_shard_num();
     BinaryArchive indices;
-    int32_t shard_num, block_num;
-    req >> shard_num >> block_num;
+    int32_t placement_version, shard_num, block_num, wire_category;
+    req >> placement_version >> shard_num >> block_num >> wire_category;
+    if (placement_version != st.placement_version.load()) {
+        send_error_response(psmeta, req, dealer, ps::Status::NoReplica("shard placement changed"));
+        return;
+    }
+    WirePrecision wire(wire_category);
     ps::PSResponse resp(req, 4 + shard_num * 8);
     resp << shard_num;
     while (shard_num--) {
@@ -165,45 +264,164 @@ void EmbeddingPullOperator::apply_request_pull(const ps::PSMessageMeta& psmeta,
         core::BinaryArchive weights(true);
         weights.reserve(buffer_size);
         auto& shard = *(st.get(shard_id));
-        core::shared_lock_guard<core::RWSpinLock> guard(shard._lock);
+        ProfiledSharedLockGuard<core::RWSpinLock> guard(shard._lock, st.shard_lock_stats);
+        if (placement_version != st.placement_version.load()) {
+            // INSTALL dropped the shard after the check above
+            send_error_response(psmeta, req, dealer, ps::Status::NoReplica("shard placement changed"));
+            return;
+        }
         EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);;
         for (int i = 0; i < block_num; ++i) {
             uint32_t variable_id;
             EmbeddingVariableMeta meta;
             uint64_t num_indices;
             req >> variable_id >> meta >> num_indices;
-            weights.prepare_write(num_indices * meta.line_size());
-            if (ht.contains(variable_id) && meta == ht.meta(variable_id)) {
-                const uint64_t* pindices = reinterpret_cast<const uint64_t*>(indices.cursor());
+            const uint64_t* pindices = reinterpret_cast<const uint64_t*>(indices.cursor());
+            size_t indices_size = num_indices * sizeof(uint64_t);
+            size_t remaining = indices.end() - indices.cursor();
+            if (_index_codec.enabled()) {
+                // decode one block at a time
+                static thread_local core::vector<uint64_t> decoded;
+                decoded.resize(std::min<size_t>(num_indices, remaining));
+                const char* next = decoded.size() < num_indices ? nullptr :
+                      IndexCodec::decode(indices.cursor(), indices.end(), num_indices, decoded.data());
+                indices_size = next ? next - indices.cursor() : remaining + 1;
+                pindices = decoded.data();
+            }
+            if (indices_size > remaining || num_indices > remaining) {
+                send_error_response(psmeta, req, dealer, ps::Status::Error("malformed request indices"));
+                return;
+            }
+            size_t wire_line_size = wire.line_size(meta.datatype, meta.embedding_dim);
+            weights.prepare_write(num_indices * wire_line_size);
+            std::shared_ptr<const IndexedShardFile> mapped;
+            if (_read_only) {
+                mapped = st.mapped.find(shard_id, variable_id);
+                if (mapped && !(mapped->meta() == meta)) {
+                    mapped = nullptr;
+                }
+            }
+            if (mapped || (ht.contains(variable_id) && meta == ht.meta(variable_id))) {
+                // Reduced precision is converted from a full precision staging buffer.
+                static thread_local core::vector<char> full;
+                char* out = weights.end();
+                if (wire.enabled()) {
+                    full.resize(num_indices * meta.line_size());
+                    out = full.data();
+                }
                 bool should_persist = false;
-                if (_read_only) {
-                    ht[variable_id].get_weights(pindices, num_indices, weights.end());
+                if (mapped) {
+                    mapped->get_weights(pindices, num_indices, out);
+                } else if (_read_only) {
+                    ht[variable_id].get_weights(pindices, num_indices, out);
                 } else {
+                    if (st.migration.active()) {
+                        st.migration.record(shard_id, variable_id, pindices, num_indices);
+                    }
                     VariableAsyncTask async_task(variable_id, st.async_tasks, shard._lock);
-                    ht[variable_id].pull_weights(pindices, num_indices, weights.end(), async_task);
+                    ht[variable_id].pull_weights(pindices, num_indices, out, async_task);
                     should_persist = ht[variable_id].should_persist();
                     if (async_task) {
                         VariableAsyncTaskThreadPool::singleton().submit(std::move(async_task));
                     }
                 }
+                if (wire.enabled()) {
+                    meta.datatype.invoke(WirePrecision::Encoder(), wire,
+                          full.data(), num_indices * meta.embedding_dim, weights.end());
+                }
+                if (sample) {
+                    static thread_local core::vector<uint64_t> global_indices;
+                    global_indices.resize(num_indices);
+                    ShardPartitioner partitioner = meta.partitioner(global_shard_num);
+                    for (size_t j = 0; j < num_indices; ++j) {
+                        global_indices[j] = partitioner.key(pindices[j], shard_id);
+                    }
+                    st.hot_keys.counter(variable_id, _hot_key_top_k).record(global_indices.data(), num_indices);
+                }
                 resp << should_persist;
             } else {
                 error = true;
             }
-            indices.advance_cursor(num_indices * sizeof(uint64_t));
-            weights.advance_end(num_indices * meta.line_size());
+            indices.advance_cursor(indices_size);
+            weights.advance_end(num_indices * wire_line_size);
         }
         buffer_size = std::max(buffer_size, weights.capacity());
         ps::ps_serialize(resp.lazy(), _compress_info, std::move(weights));
     }
+    if (_read_only && _hot_key_top_k) {
+        int32_t node_id;
+        req >> node_id;
+        resp << node_id;
+        core::BinaryArchive weights(true);
+        for (int i = 0; i < block_num; ++i) {
+            uint32_t variable_id;
+            EmbeddingVariableMeta meta;
+            uint64_t known, num_indices;
+            req >> variable_id >> meta >> known >> num_indices;
+            ps::ps_deserialize(req.lazy(), _compress_info, indices);
+            const uint64_t* pindices = reinterpret_cast<const uint64_t*>(indices.cursor());
+            if (num_indices > size_t(indices.end() - indices.cursor()) / sizeof(uint64_t)) {
+                send_error_response(psmeta, req, dealer, ps::Status::Error("malformed request indices"));
+                return;
+            }
+
+            // new keys of the replica for the client directory
+            std::shared_ptr<const HotKeyReplica> replica = st.hot_keys.replica(variable_id);
+            uint64_t count = replica ? replica->keys.size() : 0;
+            uint64_t begin = known <= count ? known : 0;
+            resp << begin << count;
+            for (uint64_t j = begin; j < count; ++j) {
+                resp << replica->keys[j];
+            }
+
+            size_t wire_line_size = wire.line_size(meta.datatype, meta.embedding_dim);
+            size_t line_size = meta.line_size();
+            weights.prepare_write(num_indices * wire_line_size);
+            if (replica && replica->meta == meta) {
+                static thread_local core::vector<char> full;
+                char* out = weights.end();
+                if (wire.enabled()) {
+                    full.resize(num_indices * line_size);
+                    out = full.data();
+                }
+                for (size_t j = 0; j < num_indices; ++j) {
+                    auto it = replica->offsets.find(pindices[j]);
+                    if (it == replica->offsets.end()) {
+                        replica_miss = true;
+                    } else {
+                        memcpy(out + j * line_size, replica->weights.data() + it->second, line_size);
+                    }
+                }
+                if (wire.enabled()) {
+                    meta.datatype.invoke(WirePrecision::Encoder(), wire,
+                          full.data(), num_indices * meta.embedding_dim, weights.end());
+                }
+            } else if (num_indices) {
+                replica_miss = true;
+            }
+            weights.advance_end(num_indices * wire_line_size);
+        }
+        ps::ps_serialize(resp.lazy(), _compress_info, std::move(weights));
+    }
     if (error) {
         resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
         resp << ps::Status::InvalidConfig("client server variable meta not match");
+    } else if (replica_miss) {
+        resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
+        resp << ps::Status::Error("hot key replica not found");
     }
     resp << psmeta;
     dealer->send_response(std::move(resp.rpc_response()));
 }
 
+void EmbeddingPullOperator::send_error_response(const ps::PSMessageMeta& psmeta,
+        ps::PSRequest& req, core::Dealer* dealer, const ps::Status& status) {
+    ps::PSResponse resp(req);
+    resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
+    resp << status << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+}
+
 ps::Status EmbeddingPullOperator::apply_response(ps::PSResponse& resp, EmbeddingPullRequestData& data, void* result) {
     static thread_local core::Accumulator<core::SumAggregator<size_t>> acc_indices("pull_indices");
     static thread_local core::Accumulator<core::SumAggregator<size_t>> acc_unique("pull_unique");
@@ -212,6 +430,7 @@ ps::Status EmbeddingPullOperator::apply_response(ps::PSResponse& resp, Embedding
     
     auto& block_items = *static_cast<core::vector<EmbeddingPullResults>*>(result);
     VTIMER(1, embedding_pull, apply_response, ms);
+    EMBEDDING_LATENCY(pull_apply_response);
     int32_t shard_num;
     resp >> shard_num;
     while (shard_num--) {
@@ -226,24 +445,53 @@ ps::Status EmbeddingPullOperator::apply_response(ps::PSResponse& resp, Embedding
         }
         ps_deserialize(resp.lazy(), _compress_info, data.shards[shard_id].weights);
     }
+    if (_read_only && _hot_key_top_k) {
+        int32_t node_id;
+        resp >> node_id;
+        static thread_local core::vector<uint64_t> tail;
+        for (size_t k = 0; k < block_items.size(); ++k) {
+            uint64_t begin, count;
+            resp >> begin >> count;
+            tail.resize(count - begin);
+            for (uint64_t& index: tail) {
+                resp >> index;
+            }
+            const EmbeddingPullItems& items = data.block_items[k];
+            // begin == 0 may be a rebuilt replica
+            if (items.hot_keys && _hot_key_top_k && (count != begin || begin == 0)) {
+                core::lock_guard<core::RWSpinLock> guard(items.hot_keys->lock);
+                items.hot_keys->learn(items.variable_id, node_id, begin, tail.data(), count);
+            }
+        }
+        ps_deserialize(resp.lazy(), _compress_info, data.hot_node(node_id).weights);
+    }
 
     --data.waiting_reqs;
-    int32_t global_shard_num = data.shards.size();
     if (data.waiting_reqs == 0) {
         for (size_t k = 0; k < block_items.size(); ++k) {
+            const IndexDedup& dedup = data.block_dedups[k];
             auto& offsets = data.block_offsets[k];
             const EmbeddingPullResults& items = block_items[k];
-            size_t line_size = data.block_items[k].meta.line_size();
-            for (size_t i = 0; i < items.n; ++i) {     
-                int32_t shard_id = items.indices[i] % global_shard_num;
-                size_t offset = offsets.at(items.indices[i]);
-                const char* p = data.shards[shard_id].weights.cursor() + offset;
-                memcpy(items.weights + i * line_size, p, line_size);
+            const EmbeddingVariableMeta& meta = data.block_items[k].meta;
+            size_t line_size = meta.line_size();
+            auto source = [&](size_t i) -> const char* {
+                const EmbeddingPullRequestData::RowOffset& row = offsets[dedup.inverse()[i]];
+                if (row.node_id != -1) {
+                    return data.hot_nodes.at(row.node_id).weights.cursor() + row.offset;
+                }
+                return data.shards[row.shard_id].weights.cursor() + row.offset;
+            };
+            if (_wire.enabled()) {
+                scatter_rows(items.weights, items.n, line_size, source, [&](const char* in, char* out) {
+                    meta.datatype.invoke(WirePrecision::Decoder(), _wire, in, meta.embedding_dim, out);
+                });
+            } else {
+                scatter_rows(items.weights, items.n, line_size, source);
             }
 
             if (core::pico_is_evaluate_performance()) {
                 acc_indices.write(items.n);
-                acc_unique.write(offsets.size());
+                acc_unique.write(dedup.size());
             }
 
         }
@@ -5,6 +5,9 @@
 #include <pico-ps/operator/PullOperator.h>
 #include <pico-ps/operator/UDFOperator.h>
 #include "EmbeddingStorage.h"
+#include "HalfFloat.h"
+#include "IndexCodec.h"
+#include "IndexDedup.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -18,7 +21,8 @@ struct EmbeddingPullItems {
     uint64_t n = 0;
 
     int64_t batch_id = 0;
-    
+
+    HotKeyDirectory* hot_keys = nullptr; // only used by read only pull
 };
 
 struct EmbeddingPullResults {
@@ -34,15 +38,35 @@ struct EmbeddingPullRequestData {
         size_t cursor = 0;
         core::vector<uint64_t> num_indices; // prefix count
         ps::RpcVector<uint64_t> indices;
+        ps::RpcVector<char> encoded_indices;
         BinaryArchive weights;
     };
+
+    // hot keys served by the replicas of a node
+    struct HotNodeData {
+        size_t cursor = 0;
+        core::vector<ps::RpcVector<uint64_t>> indices; // global indices of each block
+        BinaryArchive weights;
+    };
+
+    // where the weights of a unique key are in the response
+    struct RowOffset {
+        int node_id = -1; // hot node serving the key, -1 if served by its shard
+        int32_t shard_id = -1;
+        size_t offset = 0;
+    };
     
     EmbeddingPullRequestData() {}
     
     void init(size_t shard_num, size_t block_num);
 
+    HotNodeData& hot_node(int node_id);
+
     size_t waiting_reqs = 0;
-    core::vector<EasyHashMap<uint64_t, size_t>> block_offsets;
+    int32_t placement_version = 0;
+    core::vector<IndexDedup> block_dedups;
+    core::vector<core::vector<RowOffset>> block_offsets; // by the numbers of the unique keys
+    std::unordered_map<int, HotNodeData> hot_nodes;
     core::vector<EmbeddingPullItems> block_items;
     std::unordered_map<int, core::vector<int32_t>> node_shards;
     core::vector<ShardData> shards;
@@ -57,6 +81,23 @@ public:
         if (config.has("read_only")) {
             _read_only = config["read_only"].as<bool>();
         }
+        if (config.has("request_index_codec")) {
+            _index_codec = IndexCodec(config["request_index_codec"].as<std::string>());
+        }
+        // the varint index codec requires sorted indices
+        _sort_indices = _index_codec.enabled();
+        if (config.has("sort_request_indices")) {
+            _sort_indices = _sort_indices || config["sort_request_indices"].as<bool>();
+        }
+        if (config.has("hot_key_top_k")) {
+            _hot_key_top_k = config["hot_key_top_k"].as<size_t>();
+        }
+        if (config.has("pull_wire_precision")) {
+            _wire = WirePrecision(config["pull_wire_precision"].as<std::string>());
+        }
+        if (config.has("storage_id")) {
+            _placement = SharedShardPlacement::storage(config["storage_id"].as<int32_t>());
+        }
     }
 
     ~EmbeddingPullOperator() override {}
@@ -72,14 +113,30 @@ public:
     void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
           const ps::TableDescriptor& table, core::Dealer* dealer) override;
 
+    ps::Status prepare_request(core::vector<EmbeddingPullItems>& block_items,
+          ps::RuntimeInfo& rt, EmbeddingPullRequestData& data);
+
+    // Return false if no index is sent to the node.
+    bool serialize_request(const core::vector<EmbeddingPullItems>& block_items,
+          EmbeddingPullRequestData& data, int node_id, ps::PSRequest& req);
+
     /// TODO: check context version 
     void apply_request_pull(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
           const ps::TableDescriptor& table, core::Dealer* dealer);
 
     ps::Status apply_response(ps::PSResponse& resp, EmbeddingPullRequestData& data, void* result) override;
 
+    // Reply an error instead of the weights, e.g. the indices are truncated.
+    void send_error_response(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          core::Dealer* dealer, const ps::Status& status);
+
 protected:
     bool _read_only = false;
+    IndexCodec _index_codec;
+    bool _sort_indices = false;
+    size_t _hot_key_top_k = 0;
+    WirePrecision _wire; // only used by client, server follows the request
+    std::shared_ptr<SharedShardPlacement> _placement; // only used by client
     ps::CompressInfo _compress_info;
     ps::PickAlgo _algo;
 };
@@ -1,10 +1,12 @@
 #include "EmbeddingPushOperator.h"
 
+#include <random>
 #include <pico-ps/common/EasyHashMap.h>
 #include <pico-ps/operator/PushOperator.h>
 #include "EmbeddingStorage.h"
 #include "EmbeddingPullOperator.h"
 #include "RpcView.h"
+#include "LatencyHistogram.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -23,53 +25,134 @@ void EmbeddingPushRequestData::init(size_t shard_num) {
         shard.indices.clear();
         shard.gradients.clear();
         shard.counts.clear();
+        shard.encoded.clear();
+        shard.encoded_indices.clear();
     }
 }
 
 template<class T>
 void EmbeddingPushRequestData::operator()(TypeCase<T>, EmbeddingPushItems& items) {
-    offsets.clear();
-    size_t shard_num = shards.size();
-    for (ShardData& shard: shards) {
+    ShardPartitioner partitioner = items.meta.partitioner(shards.size());
+    size_t line_size = items.meta.line_size();
+    dedup.dedup(items.indices, items.n, partitioner, shards.size(), sort_indices);
+    rows.resize(dedup.size());
+    for (size_t shard_id = 0; shard_id < shards.size(); ++shard_id) {
+        ShardData& shard = shards[shard_id];
         shard.indices_base = shard.indices.size();
         shard.gradients_base = shard.gradients.size();
+        for (size_t j = dedup.bucket_begin(shard_id); j < dedup.bucket_begin(shard_id + 1); ++j) {
+            size_t id = dedup.buckets()[j];
+            rows[id] = shard.indices.size() - shard.indices_base;
+            shard.indices.push_back(partitioner.index(dedup.keys()[id], shard_id));
+            shard.counts.push_back(0);
+        }
+        shard.gradients.resize(shard.gradients_base + (shard.indices.size() - shard.indices_base) * line_size);
     }
-    size_t line_size = items.meta.line_size();
     const char* gradients = items.gradients;
     for (size_t i = 0; i < items.n; ++i) {
-        uint64_t index = items.indices[i];
-        auto& shard = shards[index % shard_num];
-        if (offsets.count(index)) {
-            size_t offset = offsets.at(index);
-            T* sum = reinterpret_cast<T*>(shard.gradients.data() +
-                    shard.gradients_base + offset * line_size);
+        size_t id = dedup.inverse()[i];
+        auto& shard = shards[dedup.shard(id)];
+        size_t row = rows[id];
+        char* line = shard.gradients.data() + shard.gradients_base + row * line_size;
+        if (shard.counts[shard.indices_base + row]++ == 0) {
+            memcpy(line, gradients, line_size);
+        } else {
+            T* sum = reinterpret_cast<T*>(line);
             const T* grad = reinterpret_cast<const T*>(gradients);
             for (size_t j = 0; j < items.meta.embedding_dim; ++j) {
                 sum[j] += grad[j];
             }
-            ++shard.counts[shard.indices_base + offset];
-        } else {
-            offsets.force_emplace(index, shard.indices.size() - shard.indices_base);
-            shard.indices.push_back(index / shard_num);
-            shard.gradients.insert(shard.gradients.end(), gradients, gradients + line_size);
-            shard.counts.push_back(1);
         }
         gradients += line_size;
     }
+    if (codec && codec->enabled()) {
+        if (error_feedback) {
+            auto& residuals = GradientResiduals::singleton().variable(items.variable_id, error_feedback_rows);
+            core::lock_guard<core::RWSpinLock> guard(residuals.lock);
+            encode_gradients<T>(items, &residuals);
+        } else {
+            encode_gradients<T>(items, nullptr);
+        }
+    }
     for (ShardData& shard: shards) {
         shard.num_indices.push_back(shard.indices.size());
     }
 }
 
+template<class T>
+void EmbeddingPushRequestData::encode_gradients(EmbeddingPushItems& items,
+      GradientResiduals::Variable* residuals) {
+    size_t shard_num = shards.size();
+    ShardPartitioner partitioner = items.meta.partitioner(shard_num);
+    size_t dim = items.meta.embedding_dim;
+    size_t encoded_line_size = codec->encoded_line_size(dim);
+    for (size_t shard_id = 0; shard_id < shard_num; ++shard_id) {
+        ShardData& shard = shards[shard_id];
+        size_t n = shard.indices.size() - shard.indices_base;
+        size_t encoded_base = shard.encoded.size();
+        shard.encoded.resize(encoded_base + n * encoded_line_size);
+        const T* grad = reinterpret_cast<const T*>(shard.gradients.data() + shard.gradients_base);
+        char* out = shard.encoded.data() + encoded_base;
+        for (size_t i = 0; i < n; ++i) {
+            T* residual = nullptr;
+            if (residuals) {
+                uint64_t index = partitioner.key(shard.indices[shard.indices_base + i], shard_id);
+                residual = residuals->line<T>(index, dim);
+            }
+            codec->encode(grad, dim, residual, out);
+            grad += dim;
+            out += encoded_line_size;
+        }
+    }
+}
+
 
 ps::Status EmbeddingPushOperator::generate_request(core::vector<EmbeddingPushItems>& block_items,
         ps::RuntimeInfo& rt, EmbeddingPushRequestData& data, std::vector<ps::PSRequest>& reqs) {
     VTIMER(1, embedding_push, generate_push_request, ms);
+    EMBEDDING_LATENCY(push_generate_request);
+    CHECK_STATUS_RETURN(prepare_request(block_items, rt, data));
+    for (auto& p: data.node_shards) {
+        int32_t shard_num = p.second.size();
+        int32_t block_num = block_items.size();
+        reqs.emplace_back(p.first, 12 + shard_num * block_num * 12);
+        serialize_request(block_items, data, p.second, reqs.back());
+    }
+    return ps::Status();
+}
+
+uint64_t EmbeddingPushOperator::new_push_id() {
+    static std::atomic<uint64_t> next = {[]() {
+        std::random_device rd;
+        return (uint64_t(rd()) << 32) ^ rd();
+    }()};
+    uint64_t push_id = next.fetch_add(1);
+    return push_id ? push_id : next.fetch_add(1);
+}
+
+ps::Status EmbeddingPushOperator::prepare_request(core::vector<EmbeddingPushItems>& block_items,
+        ps::RuntimeInfo& rt, EmbeddingPushRequestData& data) {
     int32_t global_shard_num = rt.global_shard_num();
+    ShardPlacement placement = _placement ? _placement->get() : ShardPlacement();
+    uint64_t push_id = block_items.empty() ? 0 : block_items[0].push_id;
+    if (push_id && push_id == data.push_id && data.shards.size() == size_t(global_shard_num)) {
+        // A retry only resends the shards with the new placement. They are not encoded
+        // again, so the error feedback residuals take in the gradients once.
+        data.placement_version = placement.version;
+        data.node_shards = placement.nodes(rt);
+        return ps::Status();
+    }
     data.init(global_shard_num);
+    data.push_id = 0;
     if (global_shard_num <= 0) {
         return ps::Status::NoReplica("no shard");
     }
+    data.codec = &_codec;
+    data.error_feedback = _error_feedback;
+    data.error_feedback_rows = _error_feedback_rows;
+    data.sort_indices = _sort_indices;
+    data.placement_version = placement.version;
+    data.node_shards = placement.nodes(rt);
     
     for (EmbeddingPushItems& items: block_items) {
         for (size_t i = 0; i < items.n; ++i) {
@@ -80,87 +163,211 @@ ps::Status EmbeddingPushOperator::generate_request(core::vector<EmbeddingPushIte
         }
         items.meta.datatype.invoke(data, items);
     }
+    if (_index_codec.enabled()) {
+        // encode once, a shard may be sent to all of its replicas.
+        for (auto& shard: data.shards) {
+            size_t begin = 0;
+            for (size_t num_indices: shard.num_indices) {
+                IndexCodec::encode(shard.indices.data() + begin,
+                      num_indices - begin, shard.encoded_indices);
+                begin = num_indices;
+            }
+        }
+    }
+    data.push_id = push_id;
+    return ps::Status();
+}
 
-    for (auto& p: rt.nodes()) {
-        int32_t shard_num = p.second.size();
-        int32_t block_num = block_items.size();
-        reqs.emplace_back(p.first, 8 + shard_num * block_num * 12);
-        auto& req = reqs.back();
-        req << shard_num << block_num;
-        for (int32_t shard_id: p.second) {
-            auto& shard = data.shards[shard_id];
-            req << shard_id;
+void EmbeddingPushOperator::serialize_request(const core::vector<EmbeddingPushItems>& block_items,
+        EmbeddingPushRequestData& data, const core::vector<int32_t>& shard_ids, ps::PSRequest& req) {
+    int32_t shard_num = shard_ids.size();
+    int32_t block_num = block_items.size();
+    req << data.placement_version << data.push_id << shard_num << block_num;
+    for (int32_t shard_id: shard_ids) {
+        auto& shard = data.shards[shard_id];
+        req << shard_id;
+        if (_index_codec.enabled()) {
+            serialize(req.lazy(), _compress_info, RpcView<char>(shard.encoded_indices));
+        } else {
             serialize(req.lazy(), _compress_info, RpcView<uint64_t>(shard.indices));
+        }
+        if (_codec.enabled()) {
+            serialize(req.lazy(), _compress_info, RpcView<char>(shard.encoded));
+        } else {
             serialize(req.lazy(), _compress_info, RpcView<char>(shard.gradients));
-            serialize(req.lazy(), _compress_info, RpcView<uint64_t>(shard.counts));
-            uint64_t offset = 0;
-            for (int i = 0; i < block_num; ++i) {
-                size_t num_indices = shard.num_indices[i];
-                req << block_items[i].variable_id << block_items[i].meta << num_indices - offset;
-                offset = num_indices;
-            }
+        }
+        serialize(req.lazy(), _compress_info, RpcView<uint64_t>(shard.counts));
+        uint64_t offset = 0;
+        for (int i = 0; i < block_num; ++i) {
+            size_t num_indices = shard.num_indices[i];
+            req << block_items[i].variable_id << block_items[i].meta << num_indices - offset;
+            offset = num_indices;
         }
     }
-    return ps::Status();
 }
 
 void EmbeddingPushOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
         const ps::TableDescriptor& table, core::Dealer* dealer) {
     VTIMER(1, embedding_push, apply_request, ms);
+    EMBEDDING_LATENCY(push_apply_request);
 
     auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
-    core::shared_lock_guard<EmbeddingStorage> l(st);
-
-    int32_t shard_num, block_num;
-    req >> shard_num >> block_num;
-    
+    ProfiledSharedLockGuard<EmbeddingStorage> l(st, st.storage_lock_stats);
     core::vector<data_block_t> holders;
+    ps::Status status = apply_request_push(req, st, holders);
+    // send_response must after copying lazy archive
+    ps::PSResponse resp(req);
+    if (!status.ok()) {
+        resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
+        resp << status;
+    }
+    resp << psmeta;
+    dealer->send_response(std::move(resp.rpc_response()));
+    // the shards applied by a rejected request still hold the buffers
+    core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+    for (data_block_t& holder: holders) {
+        st.holders.push_back(std::move(holder));
+    }
+}
+
+ps::Status EmbeddingPushOperator::apply_request_push(ps::PSRequest& req,
+        EmbeddingStorage& st, core::vector<data_block_t>& holders) {
+    int32_t placement_version, shard_num, block_num;
+    uint64_t push_id;
+    req >> placement_version >> push_id >> shard_num >> block_num;
+    if (placement_version != st.placement_version.load()) {
+        return ps::Status::NoReplica("shard placement changed");
+    }
+    // Parse and check the whole request before applying anything.
+    struct PushBlock {
+        int32_t shard_id;
+        uint32_t variable_id;
+        EmbeddingVariableMeta meta;
+        const uint64_t* indices;
+        uint64_t n;
+        const char* gradients;
+        const uint64_t* counts;
+    };
+    core::vector<PushBlock> blocks;
     while (shard_num--) {
         int32_t shard_id;
         req >> shard_id;
         RpcView<uint64_t> view_indices;
+        RpcView<char> view_encoded_indices;
         RpcView<char> view_gradients;
         RpcView<uint64_t> view_counts;
-        deserialize(req.lazy(), _compress_info, view_indices);
+        if (_index_codec.enabled()) {
+            deserialize(req.lazy(), _compress_info, view_encoded_indices);
+        } else {
+            deserialize(req.lazy(), _compress_info, view_indices);
+        }
         deserialize(req.lazy(), _compress_info, view_gradients);
         deserialize(req.lazy(), _compress_info, view_counts);
-        uint64_t* indices = view_indices.data;
-        char* gradients = view_gradients.data;
-        uint64_t* counts = view_counts.data;
+        const uint64_t* indices = view_indices.data;
+        const char* encoded_indices = view_encoded_indices.data;
+        const char* encoded_end = encoded_indices + view_encoded_indices.size;
+        const char* gradients = view_gradients.data;
+        const uint64_t* counts = view_counts.data;
+        // rows left in the views
+        size_t num_rows = _index_codec.enabled() ? view_counts.size : std::min(view_indices.size, view_counts.size);
+        size_t gradients_size = view_gradients.size;
 
-        auto& shard = *(st.get(shard_id));
-        core::shared_lock_guard<ps::ShardData> sl(shard);
-        EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);;
         for (int i = 0; i < block_num; ++i) {
-            uint32_t variable_id;
-            EmbeddingVariableMeta meta;
-            uint64_t num_indices;
-            req >> variable_id >> meta >> num_indices;
-            SCHECK(ht.contains(variable_id) && meta == ht.meta(variable_id));
-            VariableAsyncTask async_task(variable_id, st.async_tasks, shard._lock);
-            ht[variable_id].push_gradients(indices, num_indices, gradients, counts, async_task);
-            if (async_task) {
-                VariableAsyncTaskThreadPool::singleton().submit(std::move(async_task));
+            PushBlock block;
+            block.shard_id = shard_id;
+            req >> block.variable_id >> block.meta >> block.n;
+            size_t line_size = _codec.enabled() ?
+                  _codec.encoded_line_size(block.meta.embedding_dim) : block.meta.line_size();
+            if (block.n > num_rows || (line_size && block.n > gradients_size / line_size)) {
+                return ps::Status::Error("malformed push request");
+            }
+            if (_index_codec.enabled()) {
+                // decoded indices are held until update_weights like the request buffers.
+                data_block_t decoded(block.n * sizeof(uint64_t));
+                uint64_t* decoded_indices = reinterpret_cast<uint64_t*>(decoded.data);
+                indices = decoded_indices;
+                encoded_indices = IndexCodec::decode(encoded_indices, encoded_end, block.n, decoded_indices);
+                if (encoded_indices == nullptr) {
+                    return ps::Status::Error("malformed request indices");
+                }
+                holders.push_back(std::move(decoded));
             }
-            indices += num_indices;
-            gradients += num_indices * meta.line_size();
-            counts += num_indices;
+            block.indices = indices;
+            block.gradients = gradients;
+            block.counts = counts;
+            if (_codec.enabled() && block.n) {
+                // decoded gradients are held until update_weights like the request buffers.
+                data_block_t decoded(block.n * block.meta.line_size());
+                block.meta.datatype.invoke(_codec, gradients, block.n,
+                      block.meta.embedding_dim, reinterpret_cast<char*>(decoded.data));
+                block.gradients = reinterpret_cast<char*>(decoded.data);
+                holders.push_back(std::move(decoded));
+            }
+            gradients += block.n * line_size;
+            gradients_size -= block.n * line_size;
+            indices += block.n;
+            counts += block.n;
+            num_rows -= block.n;
+            blocks.push_back(block);
         }
         holders.push_back(std::move(view_indices.holder));
+        holders.push_back(std::move(view_encoded_indices.holder));
         holders.push_back(std::move(view_gradients.holder));
         holders.push_back(std::move(view_counts.holder));
     }
-    // send_response must after copying lazy archive
-    ps::PSResponse resp(req);
-    resp << psmeta;
-    dealer->send_response(std::move(resp.rpc_response()));
-    core::lock_guard<core::RWSpinLock> pl(st.pending_mutex);
-    for (data_block_t& holder: holders) {
-        st.holders.push_back(std::move(holder));
+
+    std::unordered_set<int32_t> applied_shards;
+    if (push_id) {
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+        for (const PushBlock& block: blocks) {
+            std::pair<uint64_t, int32_t> push(push_id, block.shard_id);
+            if (st.applied_pushes.count(push) || st.last_applied_pushes.count(push)) {
+                // resent after a placement change, this node applied the shard before.
+                applied_shards.insert(block.shard_id);
+            }
+        }
+    }
+    // The blocks of a shard are applied under one lock, all or none of them. A shard being
+    // moved out is rejected after its last SYNC, the client resends it to the new node.
+    ps::Status status;
+    for (size_t begin = 0, end = 0; begin < blocks.size(); begin = end) {
+        int32_t shard_id = blocks[begin].shard_id;
+        while (end < blocks.size() && blocks[end].shard_id == shard_id) {
+            ++end;
+        }
+        if (applied_shards.count(shard_id)) {
+            continue;
+        }
+        auto& shard = *(st.get(shard_id));
+        ProfiledSharedLockGuard<ps::ShardData> sl(shard, st.shard_lock_stats);
+        // INSTALL drops the shard after changing the version, both are checked with the shard locked.
+        if (st.migration.frozen(shard_id) || placement_version != st.placement_version.load()) {
+            status = ps::Status::NoReplica("shard is moving: " + std::to_string(shard_id));
+            continue;
+        }
+        EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);;
+        for (size_t i = begin; i < end; ++i) {
+            const PushBlock& block = blocks[i];
+            SCHECK(ht.contains(block.variable_id) && block.meta == ht.meta(block.variable_id));
+            if (st.migration.active()) {
+                st.migration.record(shard_id, block.variable_id, block.indices, block.n);
+            }
+            VariableAsyncTask async_task(block.variable_id, st.async_tasks, shard._lock);
+            ht[block.variable_id].push_gradients(block.indices, block.n, block.gradients, block.counts, async_task);
+            if (async_task) {
+                VariableAsyncTaskThreadPool::singleton().submit(std::move(async_task));
+            }
+        }
+        if (push_id) {
+            core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+            st.applied_pushes.emplace(push_id, shard_id);
+        }
     }
+    return status;
 }
 
 ps::Status EmbeddingPushOperator::apply_response(ps::PSResponse& resp, EmbeddingPushRequestData&, void* result) {
+    EMBEDDING_LATENCY(push_apply_response);
     SCHECK(result == nullptr) << "return no result!";
     SCHECK(resp.archive().is_exhausted());
     return ps::Status();
@@ -5,6 +5,9 @@
 #include <pico-ps/operator/PushOperator.h>
 #include "EmbeddingStorage.h"
 #include "EmbeddingPullOperator.h"
+#include "GradientCodec.h"
+#include "IndexCodec.h"
+#include "IndexDedup.h"
 #include "RpcView.h"
 
 namespace paradigm4 {
@@ -21,6 +24,8 @@ public:
     const uint64_t* indices = nullptr;
     uint64_t n = 0;
     const char* gradients = nullptr;
+    // Same for the retries of a push, the request uses the id of the first block, 0 if none.
+    uint64_t push_id = 0;
 };
 
 struct EmbeddingPushRequestData {
@@ -31,16 +36,28 @@ struct EmbeddingPushRequestData {
         ps::RpcVector<uint64_t> indices;
         ps::RpcVector<char> gradients;
         ps::RpcVector<uint64_t> counts;
+        ps::RpcVector<char> encoded; // gradients encoded by codec
+        ps::RpcVector<char> encoded_indices;
     };
     
-    EmbeddingPushRequestData(): offsets(-1) {}
-
     void init(size_t shard_num);
 
+    // Gradients of the same index are summed, the indices of each shard are sorted if sort_indices.
     template<class T>
     void operator()(TypeCase<T>, EmbeddingPushItems& items);
 
-    EasyHashMap<uint64_t, size_t> offsets;
+    template<class T>
+    void encode_gradients(EmbeddingPushItems& items, GradientResiduals::Variable* residuals);
+
+    const GradientCodec* codec = nullptr;
+    bool error_feedback = false;
+    size_t error_feedback_rows = 0;
+    bool sort_indices = false;
+    int32_t placement_version = 0;
+    uint64_t push_id = 0; // the shards are prepared for this push
+    std::unordered_map<int, core::vector<int32_t>> node_shards; // all replicas
+    IndexDedup dedup;
+    core::vector<size_t> rows; // row of each unique key in the block of its shard
     core::vector<ShardData> shards;
 };
 
@@ -50,6 +67,30 @@ public:
     EmbeddingPushOperator(const Configure& config):
           ps::UDFOperator<core::vector<EmbeddingPushItems>, EmbeddingPushRequestData>(config) {
         initialize_compress_info(config, "EmbeddingPushOperator", _compress_info);
+        if (config.has("push_gradient_codec")) {
+            size_t topk = 0;
+            if (config.has("push_gradient_topk")) {
+                topk = config["push_gradient_topk"].as<size_t>();
+            }
+            _codec = GradientCodec(config["push_gradient_codec"].as<std::string>(), topk);
+        }
+        if (config.has("request_index_codec")) {
+            _index_codec = IndexCodec(config["request_index_codec"].as<std::string>());
+        }
+        // the varint index codec requires sorted indices
+        _sort_indices = _index_codec.enabled();
+        if (config.has("sort_request_indices")) {
+            _sort_indices = _sort_indices || config["sort_request_indices"].as<bool>();
+        }
+        if (config.has("push_error_feedback")) {
+            _error_feedback = config["push_error_feedback"].as<bool>();
+        }
+        if (config.has("push_error_feedback_rows")) {
+            _error_feedback_rows = config["push_error_feedback_rows"].as<size_t>();
+        }
+        if (config.has("storage_id")) {
+            _placement = SharedShardPlacement::storage(config["storage_id"].as<int32_t>());
+        }
     }
 
     virtual ~EmbeddingPushOperator() {}
@@ -59,18 +100,39 @@ public:
 
     bool read_only() override { return false; }
 
+    // Unique in all the workers with a high probability.
+    static uint64_t new_push_id();
+
     ps::Status generate_request(core::vector<EmbeddingPushItems>& block_items,
           ps::RuntimeInfo& rt, EmbeddingPushRequestData& data, std::vector<ps::PSRequest>& reqs) override;
 
     void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
           const ps::TableDescriptor& table, core::Dealer* dealer) override;
 
+    // Aggregate the gradients of all blocks by shard, once for all the retries of a push.
+    ps::Status prepare_request(core::vector<EmbeddingPushItems>& block_items,
+          ps::RuntimeInfo& rt, EmbeddingPushRequestData& data);
+
+    void serialize_request(const core::vector<EmbeddingPushItems>& block_items,
+          EmbeddingPushRequestData& data, const core::vector<int32_t>& shard_ids, ps::PSRequest& req);
+
+    // Hold a shared lock of storage. The holders must be kept until update_weights.
+    // Apply nothing and return NoReplica if the request has an old shard placement,
+    // or an error if the request is malformed. The shards of the push applied before are
+    // skipped, and NoReplica is returned after applying the others if a shard is moving.
+    ps::Status apply_request_push(ps::PSRequest& req, EmbeddingStorage& st, core::vector<data_block_t>& holders);
+
 
     ps::Status apply_response(ps::PSResponse& resp, EmbeddingPushRequestData&, void* result) override;
 
 protected:
-
     ps::CompressInfo _compress_info;
+    GradientCodec _codec;
+    IndexCodec _index_codec;
+    bool _sort_indices = false;
+    bool _error_feedback = false;
+    size_t _error_feedback_rows = 1 << 20;
+    std::shared_ptr<SharedShardPlacement> _placement; // only used by client
 };
 
 
@@ -0,0 +1,70 @@
+#include "EmbeddingPushPullOperator.h"
+
+#include "LatencyHistogram.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+ps::Status EmbeddingPushPullOperator::generate_request(EmbeddingPushPullItems& items,
+        ps::RuntimeInfo& rt, EmbeddingPushPullRequestData& data, std::vector<ps::PSRequest>& reqs) {
+    VTIMER(1, embedding_push_pull, generate_request, ms);
+    EMBEDDING_LATENCY(push_pull_generate_request);
+    if (items.pull.empty()) {
+        return ps::Status::Error("no pull items");
+    }
+    CHECK_STATUS_RETURN(_push.prepare_request(items.push, rt, data.push));
+    CHECK_STATUS_RETURN(_pull.prepare_request(items.pull, rt, data.pull));
+    // Push is sent to all replicas, so every node gets a request.
+    for (auto& p: data.push.node_shards) {
+        int32_t shard_num = p.second.size();
+        int32_t block_num = items.push.size() + items.pull.size();
+        reqs.emplace_back(p.first, 16 + shard_num * block_num * 24);
+        auto& req = reqs.back();
+        _push.serialize_request(items.push, data.push, p.second, req);
+        _pull.serialize_request(items.pull, data.pull, p.first, req);
+        if (_counter) {
+            _counter->add(p.first);
+        }
+    }
+    data.pull.waiting_reqs = reqs.size();
+    return ps::Status();
+}
+
+void EmbeddingPushPullOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
+    VTIMER(1, embedding_push_pull, apply_request, ms);
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    ps::Status status;
+    {
+        EMBEDDING_LATENCY(push_apply_request);
+        ProfiledSharedLockGuard<EmbeddingStorage> l(st, st.storage_lock_stats);
+        core::vector<data_block_t> holders;
+        status = _push.apply_request_push(req, st, holders);
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+        for (data_block_t& holder: holders) {
+            st.holders.push_back(std::move(holder));
+        }
+    }
+    // Counted even if rejected, a rejected push is counted again when it is sent again.
+    // This may be the last push waited by the store of the last batch.
+    _store.apply_fused_push(table, dealer);
+    if (!status.ok()) {
+        ps::PSResponse resp(req);
+        resp.rpc_response().set_error_code(core::RpcErrorCodeType::ELOGICERROR);
+        resp << status << psmeta;
+        dealer->send_response(std::move(resp.rpc_response()));
+        return;
+    }
+    // The rest of the request is a pull request, it may be parked until the store.
+    _pull.apply_request(psmeta, req, table, dealer);
+}
+
+ps::Status EmbeddingPushPullOperator::apply_response(ps::PSResponse& resp,
+        EmbeddingPushPullRequestData& data, void* result) {
+    return _pull.apply_response(resp, data.pull, result);
+}
+
+}
+}
+}
@@ -0,0 +1,66 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_PUSH_PULL_OPERATOR_H
+#define PARADIGM4_HYPEREMBEDDING_EMBEDDING_PUSH_PULL_OPERATOR_H
+
+#include <pico-ps/operator/UDFOperator.h>
+#include "EmbeddingStorage.h"
+#include "EmbeddingPullOperator.h"
+#include "EmbeddingPushOperator.h"
+#include "EmbeddingStoreOperator.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// push gradients of batch N and pull weights of batch N + 1 in one request.
+struct EmbeddingPushPullItems {
+    core::vector<EmbeddingPushItems> push;
+    core::vector<EmbeddingPullItems> pull;
+};
+
+struct EmbeddingPushPullRequestData {
+    EmbeddingPushRequestData push;
+    EmbeddingPullRequestData pull;
+};
+
+// The server applies the push part at once, and the pull part is parked in pending
+// like a normal pull request, so the response is sent after the store of batch N.
+// There is no push response, so the requests are counted by the stores, and the store
+// of batch N waits for the push parts of batch N.
+class EmbeddingPushPullOperator: public ps::UDFOperator<EmbeddingPushPullItems, EmbeddingPushPullRequestData> {
+public:
+    EmbeddingPushPullOperator(const Configure& config):
+          ps::UDFOperator<EmbeddingPushPullItems, EmbeddingPushPullRequestData>(config),
+          _push(config), _pull(config), _store(config) {
+        if (config.has("storage_id")) {
+            _counter = FusedPushCounter::storage(config["storage_id"].as<int32_t>());
+        }
+    }
+
+    ~EmbeddingPushPullOperator() override {}
+
+    EmbeddingPushPullOperator(EmbeddingPushPullOperator&&) = default;
+    EmbeddingPushPullOperator& operator=(EmbeddingPushPullOperator&&) = default;
+
+    bool read_only() override { return false; }
+
+    ps::Status generate_request(EmbeddingPushPullItems& items,
+          ps::RuntimeInfo& rt, EmbeddingPushPullRequestData& data, std::vector<ps::PSRequest>& reqs) override;
+
+    void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req,
+          const ps::TableDescriptor& table, core::Dealer* dealer) override;
+
+    ps::Status apply_response(ps::PSResponse& resp, EmbeddingPushPullRequestData& data, void* result) override;
+
+protected:
+    EmbeddingPushOperator _push;
+    EmbeddingPullOperator _pull;
+    EmbeddingStoreOperator _store;
+    std::shared_ptr<FusedPushCounter> _counter; // only used by client
+};
+
+
+}
+}
+}
+
+#endif
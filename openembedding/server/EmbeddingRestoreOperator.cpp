@@ -3,6 +3,7 @@
 #include <pico-ps/operator/RestoreOperator.h>
 #include "EmbeddingVariable.h"
 #include "EmbeddingShardFile.h"
+#include "EmbeddingIndexedFile.h"
 #include "EmbeddingStorage.h"
 
 namespace paradigm4 {
@@ -108,10 +109,29 @@ void EmbeddingRestoreOperator::apply_coordinated_restore_response(ps::PSResponse
 void EmbeddingRestoreOperator::restore(const core::URIConfig& uri, ps::RuntimeInfo& rt, ps::Storage* storage) {
     auto& st = *static_cast<EmbeddingStorage*>(storage);
     core::shared_lock_guard<EmbeddingStorage> l(st);
+    // Indexed files are mapped again like the direct load.
+    if (uri.storage_type() != core::FileSystemType::HDFS) {
+        bool indexed = false;
+        for (auto& path: core::FileSystem::get_file_list(uri.uri())) {
+            if (!IndexedShardFile::match(path)) {
+                continue;
+            }
+            indexed = true;
+            auto file = std::make_shared<IndexedShardFile>();
+            SCHECK(file->open(core::URIConfig(path).name())) << path;
+            SCHECK(file->footer().shard_num == rt.global_shard_num()) << path;
+            if (rt.local_shards().count(file->footer().shard_id)) {
+                st.mapped.install(std::move(file));
+            }
+        }
+        if (indexed) {
+            return;
+        }
+    }
     FileReader reader;
     SCHECK(reader.open(uri));
     EmbeddingShardDataMeta shard;
-    while (reader.read(shard)) {
+    while (read_shard_meta(reader, shard)) {
         for (int32_t shard_id : rt.local_shards()) {
             st.write_shard(shard_id, [&](boost::any& any) {
                 EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&any);
@@ -121,6 +141,7 @@ void EmbeddingRestoreOperator::restore(const core::URIConfig& uri, ps::RuntimeIn
                 variable.load_config(config);
             });
         }
+        ShardPartitioner partitioner = shard.meta.partitioner(rt.global_shard_num());
         std::vector<uint64_t> indices, local_indices;
         std::vector<char> weights, states, local_weights;
         uint64_t cursor = 0, n = 0;
@@ -135,8 +156,8 @@ void EmbeddingRestoreOperator::restore(const core::URIConfig& uri, ps::RuntimeIn
 
             for (size_t i = 0; i < n; ++i) {
                 uint64_t key = shard.get_index(indices[i]);
-                int32_t shard_id = key % rt.global_shard_num();
-                uint64_t index = key / rt.global_shard_num();
+                int32_t shard_id = partitioner.shard(key);
+                uint64_t index = partitioner.index(key, shard_id);
                 if (rt.local_shards().count(shard_id) > 0) {
                     st.write_shard(shard_id, [&](boost::any& any) {
                         EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&any);
@@ -149,6 +170,7 @@ void EmbeddingRestoreOperator::restore(const core::URIConfig& uri, ps::RuntimeIn
             cursor += n;
         }
     }
+    SCHECK(!reader.error()) << "truncated model file: " << uri.uri();
 }
 
 
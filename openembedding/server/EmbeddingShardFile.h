@@ -2,6 +2,8 @@
 #ifndef PARADIGM4_HYPEREMBEDDING_EMBEDDING_SHRAD_FILE_H
 #define PARADIGM4_HYPEREMBEDDING_EMBEDDING_SHRAD_FILE_H
 
+#include <cstdio>
+#include <lz4frame.h>
 #include <pico-core/FileSystem.h>
 #include <pico-core/ShellUtility.h>
 #include "Meta.h"
@@ -21,16 +23,144 @@ struct EmbeddingShardDataMeta {
     PICO_SERIALIZATION(variable_id, meta, config, shard_id, shard_num, state_line_size, num_items);
 
     uint64_t get_index(uint64_t index)const {
-        return index * shard_num + shard_id;
+        return meta.partitioner(shard_num).key(index, shard_id);
+    }
+};
+
+// Streaming lz4 frame on top of another FILE, used by the files ending with ".lz4".
+class Lz4File {
+public:
+    static constexpr const char* SUFFIX = ".lz4";
+
+    static bool match(const std::string& name) {
+        std::string suffix = SUFFIX;
+        return name.size() >= suffix.size() &&
+              name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    static core::shared_ptr<FILE> open_write(core::shared_ptr<FILE> file) {
+        if (!file) {
+            return nullptr;
+        }
+        WriteCookie* cookie = new WriteCookie();
+        cookie->file = std::move(file);
+        SCHECK(!LZ4F_isError(LZ4F_createCompressionContext(&cookie->ctx, LZ4F_VERSION)));
+        cookie->out.resize(LZ4F_HEADER_SIZE_MAX);
+        size_t n = LZ4F_compressBegin(cookie->ctx, cookie->out.data(), cookie->out.size(), nullptr);
+        SCHECK(!LZ4F_isError(n)) << LZ4F_getErrorName(n);
+        SCHECK(fwrite(cookie->out.data(), 1, n, cookie->file.get()) == n);
+        cookie_io_functions_t io = {nullptr, &write, nullptr, &close_write};
+        return wrap(fopencookie(cookie, "w", io));
+    }
+
+    static core::shared_ptr<FILE> open_read(core::shared_ptr<FILE> file) {
+        if (!file) {
+            return nullptr;
+        }
+        ReadCookie* cookie = new ReadCookie();
+        cookie->file = std::move(file);
+        SCHECK(!LZ4F_isError(LZ4F_createDecompressionContext(&cookie->ctx, LZ4F_VERSION)));
+        cookie->in.resize(BUFFER_SIZE);
+        cookie_io_functions_t io = {&read, nullptr, nullptr, &close_read};
+        return wrap(fopencookie(cookie, "r", io));
+    }
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    struct WriteCookie {
+        core::shared_ptr<FILE> file;
+        LZ4F_cctx* ctx = nullptr;
+        std::vector<char> out;
+    };
+
+    struct ReadCookie {
+        core::shared_ptr<FILE> file;
+        LZ4F_dctx* ctx = nullptr;
+        std::vector<char> in;
+        size_t begin = 0;
+        size_t end = 0;
+        size_t hint = 1; // of the last LZ4F_decompress, 0 at the end of the frame
+    };
+
+    static core::shared_ptr<FILE> wrap(FILE* fp) {
+        SCHECK(fp);
+        setvbuf(fp, nullptr, _IOFBF, BUFFER_SIZE);
+        return core::shared_ptr<FILE>(fp, [](FILE* fp) { fclose(fp); });
+    }
+
+    static ssize_t write(void* c, const char* buf, size_t size) {
+        WriteCookie& cookie = *static_cast<WriteCookie*>(c);
+        cookie.out.resize(LZ4F_compressBound(size, nullptr));
+        size_t n = LZ4F_compressUpdate(cookie.ctx, cookie.out.data(), cookie.out.size(), buf, size, nullptr);
+        if (LZ4F_isError(n) || fwrite(cookie.out.data(), 1, n, cookie.file.get()) != n) {
+            return 0;
+        }
+        return size;
+    }
+
+    static int close_write(void* c) {
+        std::unique_ptr<WriteCookie> cookie(static_cast<WriteCookie*>(c));
+        cookie->out.resize(LZ4F_compressBound(0, nullptr));
+        size_t n = LZ4F_compressEnd(cookie->ctx, cookie->out.data(), cookie->out.size(), nullptr);
+        bool ok = !LZ4F_isError(n) && fwrite(cookie->out.data(), 1, n, cookie->file.get()) == n;
+        LZ4F_freeCompressionContext(cookie->ctx);
+        return ok ? 0 : EOF;
+    }
+
+    static ssize_t read(void* c, char* buf, size_t size) {
+        ReadCookie& cookie = *static_cast<ReadCookie*>(c);
+        size_t done = 0;
+        while (done < size) {
+            if (cookie.begin == cookie.end) {
+                cookie.begin = 0;
+                cookie.end = fread(cookie.in.data(), 1, cookie.in.size(), cookie.file.get());
+                if (cookie.end == 0) {
+                    if (cookie.hint != 0) {
+                        // a truncated file is not a shorter valid one
+                        SLOG(WARNING) << "lz4 frame not ended";
+                        return -1;
+                    }
+                    break;
+                }
+            }
+            size_t dst_size = size - done;
+            size_t src_size = cookie.end - cookie.begin;
+            size_t ret = LZ4F_decompress(cookie.ctx, buf + done, &dst_size,
+                  cookie.in.data() + cookie.begin, &src_size, nullptr);
+            if (LZ4F_isError(ret)) {
+                SLOG(WARNING) << "lz4 decompress failed: " << LZ4F_getErrorName(ret);
+                return -1;
+            }
+            cookie.hint = ret;
+            cookie.begin += src_size;
+            done += dst_size;
+        }
+        return done;
+    }
+
+    static int close_read(void* c) {
+        std::unique_ptr<ReadCookie> cookie(static_cast<ReadCookie*>(c));
+        LZ4F_freeDecompressionContext(cookie->ctx);
+        return 0;
     }
 };
 
 class FileReader {
 public:
-    bool open(const core::URIConfig& uri) {
+    static constexpr size_t LARGE_BUFFER_SIZE = 1 << 24;
+
+    // buffer_size != 0 sets the buffer of the file for large sequential reads.
+    bool open(const core::URIConfig& uri, size_t buffer_size = 0) {
         std::string hadoop_bin;
         uri.config().get_val(core::URI_HADOOP_BIN, hadoop_bin);
         _file = core::ShellUtility::open_read(uri.name(), "", hadoop_bin);
+        if (_file && buffer_size) {
+            setvbuf(_file.get(), nullptr, _IOFBF, buffer_size);
+        }
+        if (Lz4File::match(uri.name())) {
+            _file = Lz4File::open_read(std::move(_file));
+        }
         _archive.reset(_file);
         return _file;
     }
@@ -46,6 +176,11 @@ public:
         return _archive.read_raw_uncheck(buffer, n * sizeof(T));
     }
 
+    // A failed read is the end of the file unless the file is corrupted, e.g. a truncated lz4 frame.
+    bool error() const {
+        return _file && ferror(_file.get());
+    }
+
 private:
     core::shared_ptr<FILE> _file;
     core::BinaryFileArchive _archive;
@@ -62,6 +197,9 @@ public:
         std::string hadoop_bin;
         uri.config().get_val(core::URI_HADOOP_BIN, hadoop_bin);
         _file = core::ShellUtility::open_write(uri.name(), "", hadoop_bin);
+        if (Lz4File::match(uri.name())) {
+            _file = Lz4File::open_write(std::move(_file));
+        }
         _archive.reset(_file);
         return _file;
     }
@@ -85,6 +223,38 @@ private:
     core::BinaryFileArchive _archive;
 };
 
+// Shard metas are written after a magic and a version since the partition is a part of
+// EmbeddingVariableMeta (model version 0.3). The shard metas of model version 0.2 start
+// with variable_id and are read with the modulo partition.
+constexpr uint32_t SHARD_META_MAGIC = 0xEBD5F11E;
+constexpr uint32_t SHARD_META_VERSION = 1;
+
+inline void write_shard_meta(FileWriter& writer, const EmbeddingShardDataMeta& shard) {
+    writer.write(SHARD_META_MAGIC);
+    writer.write(SHARD_META_VERSION);
+    writer.write(shard);
+}
+
+inline bool read_shard_meta(FileReader& reader, EmbeddingShardDataMeta& shard) {
+    uint32_t head = 0;
+    if (!reader.read(head)) {
+        return false;
+    }
+    if (head == SHARD_META_MAGIC) {
+        uint32_t version = 0;
+        SCHECK(reader.read(version) && version == SHARD_META_VERSION)
+              << "unsupported shard meta version " << version;
+        return reader.read(shard);
+    }
+    shard = EmbeddingShardDataMeta();
+    shard.variable_id = head;
+    EmbeddingVariableMeta& meta = shard.meta;
+    return reader.read(meta.datatype) && reader.read(meta.embedding_dim) &&
+          reader.read(meta.vocabulary_size) && reader.read(shard.config) &&
+          reader.read(shard.shard_id) && reader.read(shard.shard_num) &&
+          reader.read(shard.state_line_size) && reader.read(shard.num_items);
+}
+
 
 }
 }
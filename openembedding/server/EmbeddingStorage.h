@@ -3,6 +3,12 @@
 
 #include "Meta.h"
 #include "EmbeddingVariable.h"
+#include "HotKeys.h"
+#include "ShardPlacement.h"
+#include "EmbeddingIndexedFile.h"
+#include "LatencyHistogram.h"
+#include "LockProfiler.h"
+#include "CheckpointFlusher.h"
 #include <pico-ps/operator/StorageOperator.h>
 
 namespace paradigm4 {
@@ -18,12 +24,15 @@ public:
         if (variable_id >= _variables.size()) {
             _variables.resize(variable_id + 1);
             _metas.resize(variable_id + 1);
+            _update_latencies.resize(variable_id + 1);
         }
         if (_variables[variable_id]) {
             return false;
         } 
         if (variable) {
             _metas[variable_id] = meta;
+            _update_latencies[variable_id] = &LatencyHistograms::singleton().get(
+                  "update_weights_" + std::to_string(variable_id));
             _variables[variable_id] = std::move(variable);
             _variable_ids.push_back(variable_id);
             return true;
@@ -40,6 +49,12 @@ public:
         return *_variables[variable_id];
     }
 
+    // Keeps the variable alive after the shard is cleared, e.g. while dumping.
+    std::shared_ptr<EmbeddingVariableBase> share(uint32_t variable_id) {
+        SCHECK(contains(variable_id)) << variable_id;
+        return _variables[variable_id];
+    }
+
     const std::vector<uint32_t>& variable_ids()const {
         return _variable_ids;
     }
@@ -49,6 +64,12 @@ public:
         return _metas[variable_id];
     }
 
+    // Looked up once, the store records it with the shards locked.
+    LatencyHistogram& update_latency(uint32_t variable_id) {
+        SCHECK(contains(variable_id)) << variable_id;
+        return *_update_latencies[variable_id];
+    }
+
     EmbeddingVariableBase& get(uint32_t variable_id, const EmbeddingVariableMeta& meta) {
         if (!contains(variable_id)) {
             auto pvar = EmbeddingVariableBase::create(meta.datatype, meta.embedding_dim);
@@ -62,11 +83,13 @@ private:
     std::vector<uint32_t> _variable_ids;
     std::vector<EmbeddingVariableMeta> _metas;
     std::vector<std::shared_ptr<EmbeddingVariableBase>> _variables;
+    std::vector<LatencyHistogram*> _update_latencies;
 };
 
 struct PendingRequest {
     ps::PSMessageMeta psmeta;
     ps::PSRequest request;
+    std::chrono::steady_clock::time_point pending_time; // for the pending latency
 };
 
 class EmbeddingStorage : public ps::ShardStorage  {
@@ -78,12 +101,18 @@ public:
         for (const auto& id : shard_id) {
             create_shard(id);
         }
+        CheckpointFlusher::singleton().add_storage(this);
+    }
+
+    ~EmbeddingStorage() {
+        CheckpointFlusher::singleton().remove_storage(this);
     }
 
     void clear() override {
         for (auto& shard : _shards) {
             shard.second->data = shard_type();
         }
+        mapped.clear();
     }
 
     virtual bool create_shard(int32_t shard_id) override {
@@ -98,14 +127,52 @@ public:
         return true;
     }
 
-    //no use
-    virtual size_t shard_size(int32_t) override {
-        return 0;
+    virtual size_t shard_size(int32_t shard_id) override {
+        EmbeddingMemoryUsage usage;
+        for (auto& pair: variables_memory_usage(shard_id)) {
+            usage += pair.second;
+        }
+        return usage.num_items;
     }
 
-    //no use
-    virtual size_t shard_memory_usage(int32_t) override {
-        return 0;
+    virtual size_t shard_memory_usage(int32_t shard_id) override {
+        EmbeddingMemoryUsage usage;
+        for (auto& pair: variables_memory_usage(shard_id)) {
+            usage += pair.second;
+        }
+        return usage.total();
+    }
+
+    // Variables lock their new weights, the other rows change only with the shard locked.
+    std::map<uint32_t, EmbeddingMemoryUsage> variables_memory_usage(int32_t shard_id) {
+        std::map<uint32_t, EmbeddingMemoryUsage> result;
+        auto it = _shards.find(shard_id);
+        if (it == _shards.end()) {
+            return result;
+        }
+        auto& shard = *it->second;
+        core::shared_lock_guard<core::RWSpinLock> guard(shard._lock);
+        EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
+        for (uint32_t variable_id: ht.variable_ids()) {
+            ht[variable_id].memory_usage(result[variable_id]);
+        }
+        return result;
+    }
+
+    // Request buffers of pushes held until the next store.
+    uint64_t holders_memory_usage() {
+        core::lock_guard<ProfiledRWSpinLock> pl(pending_mutex);
+        uint64_t result = 0;
+        for (data_block_t& holder: holders) {
+            result += holder.length;
+        }
+        return result;
+    }
+
+    // All the workers voted for the store and the pushes counted by the votes are applied.
+    // Hold the pending mutex.
+    bool store_ready()const {
+        return !votes.empty() && votes.size() >= store_workers && fused_pushes >= voted_fused_pushes;
     }
 
     virtual ps::ShardIterator* get_shard_iterator(int32_t, int32_t) override {
@@ -117,11 +184,50 @@ public:
         return this->_mtx;
     }
 
-    core::RWSpinLock pending_mutex;
+    // Shards of this node after online migration.
+    std::unordered_set<int32_t> local_shards(ps::RuntimeInfo& rt) {
+        core::shared_lock_guard<core::RWSpinLock> guard(placement_lock);
+        return placement.local_shards(rt);
+    }
+
+    bool owns(ps::RuntimeInfo& rt, int32_t shard_id) {
+        core::shared_lock_guard<core::RWSpinLock> guard(placement_lock);
+        return placement.owns(rt, shard_id);
+    }
+
+    // Contention of the storage lock and the shard locks taken by pull, push and store.
+    LockStats& storage_lock_stats = LockProfiler::singleton().stats("storage");
+    LockStats& shard_lock_stats = LockProfiler::singleton().stats("shard");
+
+    ProfiledRWSpinLock pending_mutex{"pending"};
     int64_t batch_id = 0;
-    std::atomic<size_t> async_tasks = {0};
+    AsyncTaskCounter async_tasks;
     core::deque<core::vector<PendingRequest>> pending;
     core::vector<data_block_t> holders;
+    size_t store_workers = 0;
+    core::vector<PendingRequest> votes; // store requests responded after the update
+    uint64_t fused_pushes = 0; // push_pull requests received
+    uint64_t voted_fused_pushes = 0; // push_pull requests counted by the votes
+    // Shards of the pushes applied in this and the last batch by (push_id, shard_id), a push
+    // resent after a placement change only applies the shards this node has not accepted.
+    struct AppliedPushHash {
+        size_t operator()(const std::pair<uint64_t, int32_t>& push)const {
+            return std::hash<uint64_t>()(push.first * 0x9E3779B97F4A7C15ull + push.second);
+        }
+    };
+    std::unordered_set<std::pair<uint64_t, int32_t>, AppliedPushHash> applied_pushes;
+    std::unordered_set<std::pair<uint64_t, int32_t>, AppliedPushHash> last_applied_pushes;
+    HotKeys hot_keys;
+
+    core::RWSpinLock placement_lock;
+    ShardPlacement placement;
+    std::atomic<int32_t> placement_version = {0}; // requests of other versions are rejected
+    MigrationTracker migration;
+    MappedShards mapped;
+
+    // Bumped after persisting a model, the checkpoint flusher is idle while caught up.
+    std::atomic<uint64_t> persist_version = {0};
+    std::atomic<uint64_t> flushed_version = {0};
 };
 
 
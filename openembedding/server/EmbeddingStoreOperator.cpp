@@ -5,70 +5,136 @@
 #include "EmbeddingStorage.h"
 #include "EmbeddingPullOperator.h"
 #include "RpcView.h"
+#include "LatencyHistogram.h"
 #include "PersistManager.h"
 
 namespace paradigm4 {
 namespace pico {
 namespace embedding {
 
-ps::Status EmbeddingStoreOperator::generate_request(int&,
+ps::Status EmbeddingStoreOperator::generate_request(int& worker_num,
         ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) {
     VTIMER(1, embedding_push, generate_push_request, ms);
+    EMBEDDING_LATENCY(store_generate_request);
     for (auto& node: rt.nodes()) {
         reqs.emplace_back(node.first);
+        uint64_t fused_pushes = _counter ? _counter->take(node.first) : 0;
+        reqs.back() << worker_num << fused_pushes;
     }
     return ps::Status();
 }
 
 void EmbeddingStoreOperator::apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
         const ps::TableDescriptor& table, core::Dealer* dealer) {
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    int32_t worker_num;
+    uint64_t fused_pushes;
+    req >> worker_num >> fused_pushes;
+    core::vector<PendingRequest> votes;
+    {
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+        st.store_workers = std::max(worker_num, 1);
+        st.voted_fused_pushes += fused_pushes;
+        st.votes.push_back({psmeta, std::move(req), std::chrono::steady_clock::now()});
+        if (!st.store_ready()) {
+            return;
+        }
+        votes = std::move(st.votes);
+        st.votes.clear();
+    }
+    update_weights(votes, table, dealer);
+}
+
+void EmbeddingStoreOperator::apply_fused_push(const ps::TableDescriptor& table, core::Dealer* dealer) {
+    auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
+    core::vector<PendingRequest> votes;
+    {
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+        st.fused_pushes += 1;
+        if (!st.store_ready()) {
+            return;
+        }
+        votes = std::move(st.votes);
+        st.votes.clear();
+    }
+    update_weights(votes, table, dealer);
+}
+
+void EmbeddingStoreOperator::update_weights(core::vector<PendingRequest>& votes,
+        const ps::TableDescriptor& table, core::Dealer* dealer) {
     VTIMER(1, embedding_update, apply_request, ms);
-    ps::PSResponse resp(req);
-    resp << psmeta;
+    EMBEDDING_LATENCY(store_apply_request);
+    static LatencyHistogram& vote_latency = LatencyHistograms::singleton().get("store_vote");
+    for (PendingRequest& vote: votes) {
+        vote_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - vote.pending_time).count());
+    }
+    auto send_responses = [&votes, dealer]() {
+        for (PendingRequest& vote: votes) {
+            ps::PSResponse resp(vote.request);
+            resp << vote.psmeta;
+            dealer->send_response(std::move(resp.rpc_response()));
+        }
+    };
     auto& rt = *table.runtime_info;
     auto& st = *(static_cast<EmbeddingStorage*>(table.storage.get()));
-    core::shared_lock_guard<EmbeddingStorage> l(st); 
-    VariableAsyncTask::wait(st.async_tasks);
+    ProfiledSharedLockGuard<EmbeddingStorage> l(st, st.storage_lock_stats); 
+    {
+        EMBEDDING_LATENCY(async_task_wait);
+        st.async_tasks.wait();
+    }
 
-#ifdef USE_DCPMM
-    VariableAsyncTaskThreadPool::singleton().initialize_batch_task();
-#endif
+    // All the pushes of this batch are applied, and the next pushes wait for the pulls
+    // released by this store, so all the holders are released.
+    core::vector<data_block_t> holders;
+    {
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
+        holders = std::move(st.holders);
+        st.holders.clear();
+    }
 
-    for (int32_t shard_id: rt.local_shards()) {
+    std::unordered_set<int32_t> local_shards = st.local_shards(rt);
+    std::unordered_map<int32_t, uint64_t> hold_starts;
+    for (int32_t shard_id: local_shards) {
         auto& shard = *(st.get(shard_id));
-        shard.lock(); // TODO: use guard
+        hold_starts[shard_id] = profiled_lock(shard, st.shard_lock_stats); // TODO: use guard
     }
+    // The shards being migrated are read after this update.
+    st.migration.begin_copy();
 
     if (_early_return) {
-        dealer->send_response(std::move(resp.rpc_response()));
+        send_responses();
     }
     
-    for (int32_t shard_id: rt.local_shards()) {
+    for (int32_t shard_id: local_shards) {
         auto& shard = *(st.get(shard_id));
         EmbeddingShard& ht = *boost::any_cast<EmbeddingShard>(&shard.data);
         for (uint32_t variable_id: ht.variable_ids()) {
+            LatencyTimer timer(ht.update_latency(variable_id));
             ht[variable_id].update_weights();
         }
-        shard.unlock();
+        profiled_unlock(shard, st.shard_lock_stats, hold_starts[shard_id]);
     }
 
     if (!_early_return) {
-        dealer->send_response(std::move(resp.rpc_response()));
+        send_responses();
     }
     core::vector<PendingRequest> reqs;
     {
-        core::lock_guard<core::RWSpinLock> pl(st.pending_mutex);
-        // Store and push should not happen at the same time, otherwise holders.clear() will cause error.
-        st.holders.clear();
-        
+        core::lock_guard<ProfiledRWSpinLock> pl(st.pending_mutex);
         if (!st.pending.empty()) {
             reqs = std::move(st.pending.front());
             st.pending.pop_front();
         }
         st.batch_id += 1;
+        st.last_applied_pushes.swap(st.applied_pushes);
+        st.applied_pushes.clear();
     }
     // Start processing the pull requests of batch_id + 1.
+    static LatencyHistogram& pending_latency = LatencyHistograms::singleton().get("pull_pending");
     for (PendingRequest& pend: reqs) {
+        pending_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - pend.pending_time).count());
         ps::Status status;
         if (status.ok()) {
             _pull.apply_request_pull(pend.psmeta, pend.request, table, dealer);
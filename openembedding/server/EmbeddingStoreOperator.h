@@ -11,7 +11,41 @@ namespace paradigm4 {
 namespace pico {
 namespace embedding {
 
+// push_pull requests sent to each node since the last store, shared by the operators of a storage.
+class FusedPushCounter {
+public:
+    void add(int node_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        ++_counts[node_id];
+    }
+
+    uint64_t take(int node_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        uint64_t count = _counts[node_id];
+        _counts[node_id] = 0;
+        return count;
+    }
+
+    static std::shared_ptr<FusedPushCounter> storage(int32_t storage_id) {
+        static core::RWSpinLock lock;
+        static std::unordered_map<int32_t, std::shared_ptr<FusedPushCounter>> storages;
+        core::lock_guard<core::RWSpinLock> guard(lock);
+        std::shared_ptr<FusedPushCounter>& counter = storages[storage_id];
+        if (counter == nullptr) {
+            counter = std::make_shared<FusedPushCounter>();
+        }
+        return counter;
+    }
+
+private:
+    core::RWSpinLock _lock;
+    std::unordered_map<int, uint64_t> _counts;
+};
 
+// Every worker sends a store with the number of workers and the push_pull requests it sent
+// to the node since its last store. A push_pull has no push response, so the weights are
+// updated after all the workers voted and all the counted pushes are applied, and then
+// all the votes are responded. Store and push should not happen at the same time.
 class EmbeddingStoreOperator : public ps::UDFOperator<int, int> {
 public:
     EmbeddingStoreOperator(const Configure& config):
@@ -19,6 +53,9 @@ public:
         if (config.has("update_early_return")) {
             _early_return = config["update_early_return"].as<bool>();
         }
+        if (config.has("storage_id")) {
+            _counter = FusedPushCounter::storage(config["storage_id"].as<int32_t>());
+        }
     }
 
     virtual ~EmbeddingStoreOperator() {}
@@ -28,17 +65,27 @@ public:
 
     bool read_only() override { return false; }
 
-    ps::Status generate_request(int&,
+    // The item is the number of workers.
+    ps::Status generate_request(int& worker_num,
           ps::RuntimeInfo& rt, int&, std::vector<ps::PSRequest>& reqs) override;
 
     void apply_request(const ps::PSMessageMeta& psmeta, ps::PSRequest& req, 
           const ps::TableDescriptor& table, core::Dealer* dealer) override;
 
+    // Count a received push_pull request after its push is applied or rejected.
+    // Updates the weights if this is the last push waited by the store.
+    void apply_fused_push(const ps::TableDescriptor& table, core::Dealer* dealer);
+
     ps::Status apply_response(ps::PSResponse& resp, int&, void* result) override;
 
 protected:
+    // Update the weights and respond the votes of the store.
+    void update_weights(core::vector<PendingRequest>& votes,
+          const ps::TableDescriptor& table, core::Dealer* dealer);
+
     EmbeddingPullOperator _pull;
     bool _early_return = true;
+    std::shared_ptr<FusedPushCounter> _counter; // only used by client
 };
 
 
@@ -0,0 +1,277 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_GRADIENT_CODEC_H
+#define PARADIGM4_HYPEREMBEDDING_GRADIENT_CODEC_H
+
+#include <numeric>
+#include <unordered_map>
+#include <pico-core/SpinLock.h>
+#include <pico-core/pico_log.h>
+#include "DataType.h"
+#include "HalfFloat.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Lossy codecs for the aggregated gradients of push requests.
+// Each row is encoded independently, the encoded line size only depends on embedding_dim.
+class GradientCodec {
+public:
+    enum Category {
+        NONE = 0,
+        BF16 = 1,
+        INT8 = 2, // float scale + int8 per value
+        TOPK = 3, // (uint32 position, float value) of the k largest magnitudes
+    };
+
+    GradientCodec() {}
+
+    GradientCodec(const std::string& category, size_t topk): _topk(topk) {
+        if (category.empty() || category == "none") {
+            _category = NONE;
+        } else if (category == "bf16") {
+            _category = BF16;
+        } else if (category == "int8") {
+            _category = INT8;
+        } else if (category == "topk") {
+            _category = TOPK;
+        } else {
+            SLOG(FATAL) << "unknown gradient codec: " << category;
+        }
+    }
+
+    bool enabled()const {
+        return _category != NONE;
+    }
+
+    size_t topk(size_t dim)const {
+        return std::max<size_t>(1, std::min(_topk, dim));
+    }
+
+    size_t encoded_line_size(size_t dim)const {
+        switch (_category) {
+        case BF16:
+            return dim * sizeof(uint16_t);
+        case INT8:
+            return sizeof(float) + dim * sizeof(int8_t);
+        case TOPK:
+            return topk(dim) * (sizeof(uint32_t) + sizeof(float));
+        default:
+            return dim * sizeof(float);
+        }
+    }
+
+    // The residual is accumulated into the encoded gradient and then replaced by
+    // what the codec dropped (error feedback). residual can be nullptr.
+    template<class T>
+    void encode(const T* gradient, size_t dim, T* residual, char* out)const {
+        static thread_local core::vector<float> line;
+        line.resize(dim);
+        if (residual) {
+            for (size_t j = 0; j < dim; ++j) {
+                residual[j] += gradient[j];
+                line[j] = residual[j];
+            }
+        } else {
+            for (size_t j = 0; j < dim; ++j) {
+                line[j] = gradient[j];
+            }
+        }
+        encode_line(line.data(), dim, out);
+        if (residual) {
+            for (size_t j = 0; j < dim; ++j) {
+                residual[j] -= line[j];
+            }
+        }
+    }
+
+    // Decode n rows for DataType::invoke.
+    template<class T>
+    void operator()(TypeCase<T>, const char* in, size_t n, size_t dim, char* out)const {
+        static thread_local core::vector<float> line;
+        line.resize(dim);
+        T* gradients = reinterpret_cast<T*>(out);
+        size_t encoded_size = encoded_line_size(dim);
+        for (size_t i = 0; i < n; ++i) {
+            decode_line(in, dim, line.data());
+            for (size_t j = 0; j < dim; ++j) {
+                gradients[j] = line[j];
+            }
+            in += encoded_size;
+            gradients += dim;
+        }
+    }
+
+private:
+    // line is overwritten by the decoded value.
+    void encode_line(float* line, size_t dim, char* out)const {
+        switch (_category) {
+        case BF16:
+            for (size_t j = 0; j < dim; ++j) {
+                uint16_t value = float_to_bf16(line[j]);
+                memcpy(out + j * sizeof(uint16_t), &value, sizeof(uint16_t));
+                line[j] = bf16_to_float(value);
+            }
+            break;
+        case INT8: {
+            float max_abs = 0;
+            for (size_t j = 0; j < dim; ++j) {
+                max_abs = std::max(max_abs, std::abs(line[j]));
+            }
+            float scale = max_abs / 127;
+            memcpy(out, &scale, sizeof(float));
+            int8_t* values = reinterpret_cast<int8_t*>(out + sizeof(float));
+            for (size_t j = 0; j < dim; ++j) {
+                int8_t value = 0;
+                if (scale > 0) {
+                    value = static_cast<int8_t>(std::max(-127.0f,
+                          std::min(127.0f, std::round(line[j] / scale))));
+                }
+                values[j] = value;
+                line[j] = value * scale;
+            }
+            break;
+        }
+        case TOPK: {
+            static thread_local core::vector<uint32_t> order;
+            size_t k = topk(dim);
+            order.resize(dim);
+            std::iota(order.begin(), order.end(), 0);
+            std::nth_element(order.begin(), order.begin() + (k - 1), order.end(),
+                  [line](uint32_t a, uint32_t b) { return std::abs(line[a]) > std::abs(line[b]); });
+            std::sort(order.begin(), order.begin() + k);
+            char* values = out + k * sizeof(uint32_t);
+            size_t p = 0;
+            for (size_t j = 0; j < dim; ++j) {
+                if (p < k && order[p] == j) {
+                    memcpy(out + p * sizeof(uint32_t), &order[p], sizeof(uint32_t));
+                    memcpy(values + p * sizeof(float), &line[j], sizeof(float));
+                    ++p;
+                } else {
+                    line[j] = 0;
+                }
+            }
+            break;
+        }
+        default:
+            memcpy(out, line, dim * sizeof(float));
+        }
+    }
+
+    void decode_line(const char* in, size_t dim, float* line)const {
+        switch (_category) {
+        case BF16:
+            for (size_t j = 0; j < dim; ++j) {
+                uint16_t value;
+                memcpy(&value, in + j * sizeof(uint16_t), sizeof(uint16_t));
+                line[j] = bf16_to_float(value);
+            }
+            break;
+        case INT8: {
+            float scale;
+            memcpy(&scale, in, sizeof(float));
+            const int8_t* values = reinterpret_cast<const int8_t*>(in + sizeof(float));
+            for (size_t j = 0; j < dim; ++j) {
+                line[j] = values[j] * scale;
+            }
+            break;
+        }
+        case TOPK: {
+            size_t k = topk(dim);
+            const char* values = in + k * sizeof(uint32_t);
+            std::fill_n(line, dim, 0.0f);
+            for (size_t p = 0; p < k; ++p) {
+                uint32_t j;
+                memcpy(&j, in + p * sizeof(uint32_t), sizeof(uint32_t));
+                SCHECK(j < dim);
+                memcpy(&line[j], values + p * sizeof(float), sizeof(float));
+            }
+            break;
+        }
+        default:
+            memcpy(line, in, dim * sizeof(float));
+        }
+    }
+
+    Category _category = NONE;
+    size_t _topk = 0;
+};
+
+// Worker side error feedback residuals of each variable, keyed by the global index.
+// At most max_rows residuals are kept for a variable, a new row evicts a row not used
+// since the clock hand passed it last time, and its residual is dropped.
+class GradientResiduals {
+public:
+    struct Variable {
+        explicit Variable(size_t max_rows): max_rows(std::max<size_t>(1, max_rows)) {}
+
+        // not thread safe, hold lock
+        template<class T>
+        T* line(uint64_t index, size_t dim) {
+            size_t line_size = dim * sizeof(T);
+            auto it = slots.find(index);
+            if (it != slots.end()) {
+                referenced[it->second] = true;
+                return reinterpret_cast<T*>(buffer.data() + it->second * line_size);
+            }
+            size_t slot = keys.size();
+            if (slot < max_rows) {
+                keys.push_back(index);
+                referenced.push_back(true);
+                buffer.resize((slot + 1) * line_size);
+            } else {
+                while (referenced[hand]) {
+                    referenced[hand] = false;
+                    hand = (hand + 1) % keys.size();
+                }
+                slot = hand;
+                hand = (hand + 1) % keys.size();
+                slots.erase(keys[slot]);
+                keys[slot] = index;
+                referenced[slot] = true;
+                ++evicted;
+            }
+            slots.emplace(index, slot);
+            T* residual = reinterpret_cast<T*>(buffer.data() + slot * line_size);
+            std::fill_n(residual, dim, T(0));
+            return residual;
+        }
+
+        size_t num_rows()const {
+            return keys.size();
+        }
+
+        core::RWSpinLock lock;
+        size_t max_rows;
+        size_t hand = 0;
+        size_t evicted = 0;
+        std::unordered_map<uint64_t, size_t> slots;
+        core::vector<uint64_t> keys;
+        core::vector<uint8_t> referenced;
+        core::vector<char> buffer;
+    };
+
+    static GradientResiduals& singleton() {
+        static GradientResiduals residuals;
+        return residuals;
+    }
+
+    // max_rows is used when the variable is first seen.
+    Variable& variable(uint32_t variable_id, size_t max_rows) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::unique_ptr<Variable>& variable = _variables[variable_id];
+        if (variable == nullptr) {
+            variable = std::make_unique<Variable>(max_rows);
+        }
+        return *variable;
+    }
+
+private:
+    core::RWSpinLock _lock;
+    std::unordered_map<uint32_t, std::unique_ptr<Variable>> _variables;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_HALF_FLOAT_H
+#define PARADIGM4_HYPEREMBEDDING_HALF_FLOAT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#if defined(__SSE2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+#include <pico-core/pico_log.h>
+#include "DataType.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// bfloat16 keeps the float32 exponent, so no range check is needed.
+// Round to nearest even, keep NaN as quiet NaN.
+inline uint16_t float_to_bf16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7FFFFFFFu) > 0x7F800000u) {
+        return static_cast<uint16_t>((bits >> 16) | 0x40u);
+    }
+    bits += 0x7FFFu + ((bits >> 16) & 1u);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float bf16_to_float(uint16_t value) {
+    uint32_t bits = static_cast<uint32_t>(value) << 16;
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// IEEE half, round to nearest even, overflow to inf.
+// NaN is quiet and keeps the high payload bits like F16C.
+inline uint16_t float_to_fp16(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t abs = bits & 0x7FFFFFFFu;
+    if (abs > 0x7F800000u) {
+        return static_cast<uint16_t>(sign | 0x7E00u | ((abs >> 13) & 0x3FFu));
+    }
+    if (abs == 0x7F800000u) {
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+    if (abs >= 0x477FF000u) { // >= 65520.0f
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+    if (abs < 0x38800000u) { // < 2^-14, subnormal
+        float f;
+        memcpy(&f, &abs, sizeof(f));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(f * 16777216.0f)));
+    }
+    abs += 0xC8000FFFu + ((abs >> 13) & 1u); // rebias exponent and round
+    return static_cast<uint16_t>(sign | (abs >> 13));
+}
+
+inline float fp16_to_float(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1Fu;
+    uint32_t mantissa = value & 0x3FFu;
+    uint32_t bits;
+    if (exponent == 0) {
+        float f = mantissa * 5.9604644775390625e-8f; // 2^-24
+        memcpy(&bits, &f, sizeof(bits));
+        bits |= sign;
+    } else if (exponent == 0x1Fu) {
+        // NaN is quiet like F16C
+        bits = sign | 0x7F800000u | ((mantissa ? mantissa | 0x200u : 0u) << 13);
+    } else {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+inline void floats_to_bf16(const float* in, size_t n, uint16_t* out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i bias = _mm_set1_epi32(0x7FFF);
+    const __m128i abs_mask = _mm_set1_epi32(0x7FFFFFFF);
+    const __m128i inf = _mm_set1_epi32(0x7F800000);
+    const __m128i quiet = _mm_set1_epi32(0x400000);
+    for (; i + 4 <= n; i += 4) {
+        __m128i bits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i lsb = _mm_and_si128(_mm_srli_epi32(bits, 16), one);
+        __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(lsb, bias));
+        __m128i nan = _mm_cmpgt_epi32(_mm_and_si128(bits, abs_mask), inf);
+        bits = _mm_or_si128(_mm_and_si128(nan, _mm_or_si128(bits, quiet)),
+              _mm_andnot_si128(nan, rounded));
+        // sign extend the high half so that the signed pack is exact.
+        bits = _mm_srai_epi32(bits, 16);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(bits, bits));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = float_to_bf16(in[i]);
+    }
+}
+
+inline void bf16_to_floats(const uint16_t* in, size_t n, float* out) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i half = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(zero, half));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = bf16_to_float(in[i]);
+    }
+}
+
+inline void floats_to_fp16(const float* in, size_t n, uint16_t* out) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), half);
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = float_to_fp16(in[i]);
+    }
+}
+
+inline void fp16_to_floats(const uint16_t* in, size_t n, float* out) {
+    size_t i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(half));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = fp16_to_float(in[i]);
+    }
+}
+
+// Precision of the weights in pull responses, requested by the client.
+// The storage datatype is not changed.
+class WirePrecision {
+public:
+    enum Category {
+        RAW = 0,
+        BF16 = 1,
+        FP16 = 2,
+    };
+
+    explicit WirePrecision(int32_t category = RAW): category(category) {}
+
+    WirePrecision(const std::string& str) {
+        if (str.empty() || str == "raw") {
+            category = RAW;
+        } else if (str == "bf16") {
+            category = BF16;
+        } else if (str == "fp16") {
+            category = FP16;
+        } else {
+            SLOG(FATAL) << "unknown wire precision: " << str;
+        }
+    }
+
+    bool enabled()const {
+        return category != RAW;
+    }
+
+    size_t line_size(DataType datatype, size_t embedding_dim)const {
+        return enabled() ? embedding_dim * sizeof(uint16_t) : datatype.size() * embedding_dim;
+    }
+
+    void encode(const float* in, size_t n, char* out)const {
+        uint16_t* half = reinterpret_cast<uint16_t*>(out);
+        if (category == BF16) {
+            floats_to_bf16(in, n, half);
+        } else {
+            floats_to_fp16(in, n, half);
+        }
+    }
+
+    template<class T>
+    void encode(const T* in, size_t n, char* out)const {
+        static thread_local core::vector<float> values;
+        values.assign(in, in + n);
+        encode(values.data(), n, out);
+    }
+
+    void decode(const char* in, size_t n, float* out)const {
+        const uint16_t* half = reinterpret_cast<const uint16_t*>(in);
+        if (category == BF16) {
+            bf16_to_floats(half, n, out);
+        } else {
+            fp16_to_floats(half, n, out);
+        }
+    }
+
+    template<class T>
+    void decode(const char* in, size_t n, T* out)const {
+        static thread_local core::vector<float> values;
+        values.resize(n);
+        decode(in, n, values.data());
+        std::copy_n(values.data(), n, out);
+    }
+
+    // For DataType::invoke.
+    struct Encoder {
+        template<class T>
+        void operator()(TypeCase<T>, const WirePrecision& wire, const char* in, size_t n, char* out) {
+            wire.encode(reinterpret_cast<const T*>(in), n, out);
+        }
+    };
+
+    struct Decoder {
+        template<class T>
+        void operator()(TypeCase<T>, const WirePrecision& wire, const char* in, size_t n, char* out) {
+            wire.decode(in, n, reinterpret_cast<T*>(out));
+        }
+    };
+
+    int32_t category = RAW;
+};
+
+}
+}
+}
+
+#endif
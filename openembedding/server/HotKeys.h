@@ -0,0 +1,217 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_HOT_KEYS_H
+#define PARADIGM4_HYPEREMBEDDING_HOT_KEYS_H
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <pico-core/SpinLock.h>
+#include <pico-core/pico_log.h>
+#include <pico-ps/common/EasyHashMap.h>
+#include "Meta.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Approximate pull counts of the indices owned by a server.
+// When a stripe is full all of its counts are halved, so rarely pulled keys are dropped.
+class HotKeyCounter {
+public:
+    static constexpr size_t STRIPES = 16;
+    static constexpr size_t SAMPLE_INTERVAL = 8; // count one out of SAMPLE_INTERVAL pull requests
+
+    explicit HotKeyCounter(size_t capacity)
+        : _stripe_capacity(std::max<size_t>(capacity * 4 / STRIPES, 64)) {}
+
+    void record(const uint64_t* indices, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Stripe& stripe = _stripes[(indices[i] * 0x9E3779B97F4A7C15ull) >> 60];
+            core::lock_guard<core::RWSpinLock> guard(stripe.lock);
+            if (stripe.counts.size() >= _stripe_capacity && !stripe.counts.count(indices[i])) {
+                halve(stripe);
+            }
+            ++stripe.counts[indices[i]];
+        }
+    }
+
+    // (index, count) in descending count.
+    core::vector<std::pair<uint64_t, uint64_t>> top(size_t k) {
+        core::vector<std::pair<uint64_t, uint64_t>> result;
+        for (Stripe& stripe: _stripes) {
+            core::shared_lock_guard<core::RWSpinLock> guard(stripe.lock);
+            result.insert(result.end(), stripe.counts.begin(), stripe.counts.end());
+        }
+        auto greater = [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+            return a.second > b.second;
+        };
+        k = std::min(k, result.size());
+        std::partial_sort(result.begin(), result.begin() + k, result.end(), greater);
+        result.resize(k);
+        return result;
+    }
+
+    void decay() {
+        for (Stripe& stripe: _stripes) {
+            core::lock_guard<core::RWSpinLock> guard(stripe.lock);
+            halve(stripe);
+        }
+    }
+
+private:
+    struct Stripe {
+        core::RWSpinLock lock;
+        std::unordered_map<uint64_t, uint64_t> counts;
+    };
+
+    static void halve(Stripe& stripe) {
+        for (auto it = stripe.counts.begin(); it != stripe.counts.end();) {
+            it->second /= 2;
+            if (it->second == 0) {
+                it = stripe.counts.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    size_t _stripe_capacity;
+    Stripe _stripes[STRIPES];
+};
+
+// Read only rows of hot keys replicated to every server.
+// keys only grows, so a prefix learned by a client is always served.
+struct HotKeyReplica {
+    HotKeyReplica(): offsets(-1) {}
+
+    EmbeddingVariableMeta meta;
+    core::vector<uint64_t> keys;
+    EasyHashMap<uint64_t, size_t> offsets; // index --> byte offset in weights
+    core::vector<char> weights;
+};
+
+// Server side hot key states of a storage.
+class HotKeys {
+public:
+    HotKeyCounter& counter(uint32_t variable_id, size_t capacity) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::unique_ptr<HotKeyCounter>& counter = _counters[variable_id];
+        if (counter == nullptr) {
+            counter = std::make_unique<HotKeyCounter>(capacity);
+        }
+        return *counter;
+    }
+
+    std::shared_ptr<const HotKeyReplica> replica(uint32_t variable_id) {
+        core::shared_lock_guard<core::RWSpinLock> guard(_lock);
+        auto it = _replicas.find(variable_id);
+        return it == _replicas.end() ? nullptr : it->second;
+    }
+
+    void set_replica(uint32_t variable_id, std::shared_ptr<const HotKeyReplica> replica) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _replicas[variable_id] = std::move(replica);
+    }
+
+    void clear(uint32_t variable_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _counters.erase(variable_id);
+        _replicas.erase(variable_id);
+    }
+
+private:
+    core::RWSpinLock _lock;
+    std::unordered_map<uint32_t, std::unique_ptr<HotKeyCounter>> _counters;
+    std::unordered_map<uint32_t, std::shared_ptr<const HotKeyReplica>> _replicas;
+};
+
+// Client side view of the hot key replicas, learned from read only pull responses.
+class HotKeyDirectory {
+public:
+    struct Variable {
+        Variable(): positions(-1) {}
+        core::vector<uint64_t> keys;
+        EasyHashMap<uint64_t, size_t> positions; // index --> position in keys
+        std::unordered_map<int, size_t> node_counts; // prefix length of keys held by node
+    };
+
+    // not thread safe, hold lock
+    Variable* find(uint32_t variable_id) {
+        auto it = _variables.find(variable_id);
+        return it == _variables.end() ? nullptr : &it->second;
+    }
+
+    // not thread safe, hold lock
+    size_t node_count(uint32_t variable_id, int node_id) {
+        Variable* variable = find(variable_id);
+        if (variable == nullptr) {
+            return 0;
+        }
+        auto it = variable->node_counts.find(node_id);
+        return it == variable->node_counts.end() ? 0 : it->second;
+    }
+
+    // not thread safe, hold lock
+    // A node holding a replica of index, or -1.
+    static int pick(Variable& variable, uint64_t index,
+          const std::unordered_set<int>& alive_nodes, size_t salt) {
+        auto it = variable.positions.find(index);
+        if (it == variable.positions.end()) {
+            return -1;
+        }
+        size_t position = it->second;
+        size_t candidates = 0;
+        for (auto& pair: variable.node_counts) {
+            if (pair.second > position && alive_nodes.count(pair.first)) {
+                ++candidates;
+            }
+        }
+        if (candidates == 0) {
+            return -1;
+        }
+        size_t selected = (index + salt) % candidates;
+        for (auto& pair: variable.node_counts) {
+            if (pair.second > position && alive_nodes.count(pair.first)) {
+                if (selected-- == 0) {
+                    return pair.first;
+                }
+            }
+        }
+        return -1;
+    }
+
+    // not thread safe, hold lock
+    // tail is the keys in [begin, count) of the node.
+    void learn(uint32_t variable_id, int node_id, size_t begin, const uint64_t* tail, size_t count) {
+        Variable& variable = _variables[variable_id];
+        if (begin < variable.node_counts[node_id]) {
+            // the replicas have been rebuilt, forget everything.
+            variable = Variable();
+        }
+        for (size_t i = begin; i < count; ++i) {
+            uint64_t index = tail[i - begin];
+            if (i < variable.keys.size()) {
+                if (variable.keys[i] != index) {
+                    SLOG(WARNING) << "hot key replicas of variable " << variable_id << " not consistent";
+                    variable = Variable();
+                    return;
+                }
+            } else {
+                variable.positions.force_emplace(index, variable.keys.size());
+                variable.keys.push_back(index);
+            }
+        }
+        variable.node_counts[node_id] = count;
+    }
+
+    core::RWSpinLock lock;
+
+private:
+    std::unordered_map<uint32_t, Variable> _variables;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_INDEX_CODEC_H
+#define PARADIGM4_HYPEREMBEDDING_INDEX_CODEC_H
+
+#include <cstdint>
+#include <string>
+#include <pico-core/pico_log.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Codec for the shard local index lists of pull and push requests.
+// Each block is sorted by the client and encoded as delta + LEB128 varint,
+// the first delta of a block is relative to 0.
+class IndexCodec {
+public:
+    enum Category {
+        NONE = 0,
+        VARINT = 1,
+    };
+
+    IndexCodec() {}
+
+    IndexCodec(const std::string& category) {
+        if (category.empty() || category == "none") {
+            _category = NONE;
+        } else if (category == "varint") {
+            _category = VARINT;
+        } else {
+            SLOG(FATAL) << "unknown index codec: " << category;
+        }
+    }
+
+    bool enabled()const {
+        return _category != NONE;
+    }
+
+    // indices must be sorted, append to out.
+    template<class Vector>
+    static void encode(const uint64_t* indices, size_t n, Vector& out) {
+        size_t base = out.size();
+        out.resize(base + n * MAX_VARINT_SIZE);
+        uint8_t* begin = reinterpret_cast<uint8_t*>(out.data() + base);
+        uint8_t* p = begin;
+        uint64_t last = 0;
+        for (size_t i = 0; i < n; ++i) {
+            SCHECK(indices[i] >= last) << "indices not sorted";
+            uint64_t delta = indices[i] - last;
+            last = indices[i];
+            while (delta >= 0x80) {
+                *p++ = static_cast<uint8_t>(delta | 0x80);
+                delta >>= 7;
+            }
+            *p++ = static_cast<uint8_t>(delta);
+        }
+        out.resize(base + (p - begin));
+    }
+
+    // Decode n indices from [in, end), return the end of the consumed input,
+    // or nullptr if the input is truncated or not a valid encoding.
+    static const char* decode(const char* in, const char* end, size_t n, uint64_t* out) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in);
+        const uint8_t* last_byte = reinterpret_cast<const uint8_t*>(end);
+        uint64_t last = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t delta = 0;
+            int shift = 0;
+            while (true) {
+                if (p == last_byte || shift >= 64) {
+                    return nullptr;
+                }
+                uint64_t bits = *p & 0x7F;
+                if (shift == 63 && bits > 1) {
+                    return nullptr;
+                }
+                delta |= bits << shift;
+                shift += 7;
+                if (!(*p++ & 0x80)) {
+                    break;
+                }
+            }
+            if (last + delta < last) {
+                return nullptr;
+            }
+            last += delta;
+            out[i] = last;
+        }
+        return reinterpret_cast<const char*>(p);
+    }
+
+private:
+    static constexpr size_t MAX_VARINT_SIZE = 10;
+    Category _category = NONE;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_INDEX_DEDUP_H
+#define PARADIGM4_HYPEREMBEDDING_INDEX_DEDUP_H
+
+#include <algorithm>
+#include "ShardPartition.h"
+#include "RequestThreads.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Dedups the indices of a request by LSD radix sort of (key, position) pairs, instead of
+// building a hash map per call. The unique keys are numbered in the order first seen,
+// inverse()[i] is the number of indices[i]. The keys can be bucketed by shard at the same
+// time, in the order first seen or in key order. Large batches are sorted by threads.
+// Reuse the object between calls to keep the buffers.
+class IndexDedup {
+public:
+    static constexpr size_t RADIX_BITS = 8;
+    static constexpr size_t RADIX = 1 << RADIX_BITS;
+    static constexpr size_t SORT_MIN_INDICES = 256; // std::sort below
+    static constexpr size_t PARALLEL_MIN_INDICES = 1 << 16;
+
+    void dedup(const uint64_t* indices, size_t n) {
+        _entries.resize(n);
+        uint64_t all_or = 0, all_and = -1;
+        for (size_t i = 0; i < n; ++i) {
+            _entries[i] = {indices[i], i};
+            all_or |= indices[i];
+            all_and &= indices[i];
+        }
+        sort_entries(all_or ^ all_and);
+
+        // Mark the first position of each key with the rank of the key,
+        // then number the keys by the first positions.
+        static constexpr size_t NPOS = -1;
+        _inverse.assign(n, NPOS);
+        size_t num_keys = 0;
+        for (size_t j = 0; j < n; ++j) {
+            if (j == 0 || _entries[j].key != _entries[j - 1].key) {
+                _inverse[_entries[j].pos] = num_keys++;
+            }
+        }
+        _keys.resize(num_keys);
+        _sorted.resize(num_keys);
+        size_t id = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (_inverse[i] != NPOS) {
+                _sorted[_inverse[i]] = id;
+                _keys[id++] = indices[i];
+            }
+        }
+        size_t rank = 0;
+        for (size_t j = 0; j < n; ++j) {
+            if (j != 0 && _entries[j].key != _entries[j - 1].key) {
+                ++rank;
+            }
+            _inverse[_entries[j].pos] = _sorted[rank];
+        }
+    }
+
+    // Also buckets the unique keys by shard, in key order if sorted.
+    void dedup(const uint64_t* indices, size_t n,
+          const ShardPartitioner& partitioner, int32_t shard_num, bool sorted) {
+        dedup(indices, n);
+        size_t num_keys = _keys.size();
+        _shards.resize(num_keys);
+        _shard_begin.assign(shard_num + 1, 0);
+        for (size_t id = 0; id < num_keys; ++id) {
+            _shards[id] = partitioner.shard(_keys[id]);
+            ++_shard_begin[_shards[id] + 1];
+        }
+        for (int32_t shard_id = 0; shard_id < shard_num; ++shard_id) {
+            _shard_begin[shard_id + 1] += _shard_begin[shard_id];
+        }
+        _cursors.assign(_shard_begin.begin(), _shard_begin.end() - 1);
+        _buckets.resize(num_keys);
+        for (size_t j = 0; j < num_keys; ++j) {
+            size_t id = sorted ? _sorted[j] : j;
+            _buckets[_cursors[_shards[id]]++] = id;
+        }
+    }
+
+    size_t size()const {
+        return _keys.size();
+    }
+
+    const uint64_t* keys()const {
+        return _keys.data();
+    }
+
+    const size_t* inverse()const {
+        return _inverse.data();
+    }
+
+    // Numbers of the unique keys in key order.
+    const size_t* sorted()const {
+        return _sorted.data();
+    }
+
+    // Shard of the unique key with the number.
+    int32_t shard(size_t id)const {
+        return _shards[id];
+    }
+
+    // Numbers of the unique keys of a shard are [bucket_begin(s), bucket_begin(s + 1)) of buckets().
+    size_t bucket_begin(int32_t shard_id)const {
+        return _shard_begin[shard_id];
+    }
+
+    const size_t* buckets()const {
+        return _buckets.data();
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint64_t pos;
+    };
+
+    // Stable sort of the entries by key, digits same in all the keys are skipped.
+    void sort_entries(uint64_t diff) {
+        size_t n = _entries.size();
+        if (n < SORT_MIN_INDICES) {
+            std::sort(_entries.begin(), _entries.end(), [](const Entry& a, const Entry& b) {
+                return a.key < b.key || (a.key == b.key && a.pos < b.pos);
+            });
+            return;
+        }
+        size_t parts = n >= PARALLEL_MIN_INDICES ? RequestThreads::num_threads() : 1;
+        size_t part_size = (n + parts - 1) / parts;
+        _buffer.resize(n);
+        _counts.resize(parts * RADIX);
+        for (size_t shift = 0; shift < 64; shift += RADIX_BITS) {
+            if (((diff >> shift) & (RADIX - 1)) == 0) {
+                continue;
+            }
+            auto part_range = [n, part_size](size_t part) {
+                return std::make_pair(std::min(n, part * part_size), std::min(n, (part + 1) * part_size));
+            };
+            RequestThreads::run(parts, [&](size_t part) {
+                size_t* counts = _counts.data() + part * RADIX;
+                std::fill_n(counts, RADIX, 0);
+                auto range = part_range(part);
+                for (size_t i = range.first; i < range.second; ++i) {
+                    ++counts[(_entries[i].key >> shift) & (RADIX - 1)];
+                }
+            });
+            // a digit goes after the smaller digits and the same digit of the former parts
+            size_t offset = 0;
+            for (size_t digit = 0; digit < RADIX; ++digit) {
+                for (size_t part = 0; part < parts; ++part) {
+                    size_t count = _counts[part * RADIX + digit];
+                    _counts[part * RADIX + digit] = offset;
+                    offset += count;
+                }
+            }
+            RequestThreads::run(parts, [&](size_t part) {
+                size_t* cursors = _counts.data() + part * RADIX;
+                auto range = part_range(part);
+                for (size_t i = range.first; i < range.second; ++i) {
+                    _buffer[cursors[(_entries[i].key >> shift) & (RADIX - 1)]++] = _entries[i];
+                }
+            });
+            _entries.swap(_buffer);
+        }
+    }
+
+    core::vector<Entry> _entries;
+    core::vector<Entry> _buffer;
+    core::vector<size_t> _counts;
+    core::vector<uint64_t> _keys;
+    core::vector<size_t> _inverse;
+    core::vector<size_t> _sorted;
+    core::vector<int32_t> _shards;
+    core::vector<size_t> _shard_begin;
+    core::vector<size_t> _cursors;
+    core::vector<size_t> _buckets;
+};
+
+}
+}
+}
+
+#endif
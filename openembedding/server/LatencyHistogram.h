@@ -0,0 +1,172 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_LATENCY_HISTOGRAM_H
+#define PARADIGM4_HYPEREMBEDDING_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <pico-core/Archive.h>
+#include <pico-core/PicoJsonNode.h>
+#include <pico-core/RWSpinLock.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Counts of a latency histogram in microseconds, mergeable between threads and nodes.
+// Buckets are log linear like HdrHistogram: SUB_BUCKETS buckets per power of two,
+// so percentiles are within 1 / SUB_BUCKETS of the recorded latencies.
+struct LatencyCounts {
+    static constexpr size_t SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BITS) * SUB_BUCKETS + SUB_BUCKETS;
+
+    static size_t bucket(uint64_t us) {
+        if (us < SUB_BUCKETS) {
+            return us;
+        }
+        size_t shift = 63 - __builtin_clzll(us) - SUB_BITS;
+        return shift * SUB_BUCKETS + (us >> shift);
+    }
+
+    // The largest latency in the bucket.
+    static uint64_t bucket_max(size_t bucket) {
+        if (bucket < 2 * SUB_BUCKETS) {
+            return bucket;
+        }
+        size_t shift = bucket / SUB_BUCKETS - 1;
+        return ((bucket % SUB_BUCKETS + SUB_BUCKETS + 1) << shift) - 1;
+    }
+
+    core::vector<uint64_t> counts = core::vector<uint64_t>(size_t(BUCKETS));
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    uint64_t total()const {
+        uint64_t result = 0;
+        for (uint64_t count: counts) {
+            result += count;
+        }
+        return result;
+    }
+
+    uint64_t percentile(double q)const {
+        uint64_t rank = std::ceil(q * total());
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank && seen > 0) {
+                return std::min(bucket_max(i), max);
+            }
+        }
+        return 0;
+    }
+
+    LatencyCounts& operator+=(const LatencyCounts& other) {
+        for (size_t i = 0; i < counts.size() && i < other.counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        sum += other.sum;
+        max = std::max(max, other.max);
+        return *this;
+    }
+
+    core::PicoJsonNode to_json_node()const {
+        uint64_t count = total();
+        core::PicoJsonNode json;
+        json.add("count", count);
+        json.add("mean_us", count ? sum / count : 0);
+        json.add("p50_us", percentile(0.5));
+        json.add("p90_us", percentile(0.9));
+        json.add("p99_us", percentile(0.99));
+        json.add("p999_us", percentile(0.999));
+        json.add("max_us", max);
+        return json;
+    }
+
+    PICO_SERIALIZATION(counts, sum, max);
+};
+
+// Lock free, a record is a few relaxed atomic adds.
+class LatencyHistogram {
+public:
+    void record(uint64_t us) {
+        _counts[LatencyCounts::bucket(us)].fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = _max.load(std::memory_order_relaxed);
+        while (us > max && !_max.compare_exchange_weak(max, us, std::memory_order_relaxed));
+    }
+
+    LatencyCounts counts()const {
+        LatencyCounts result;
+        for (size_t i = 0; i < LatencyCounts::BUCKETS; ++i) {
+            result.counts[i] = _counts[i].load(std::memory_order_relaxed);
+        }
+        result.sum = _sum.load(std::memory_order_relaxed);
+        result.max = _max.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    std::atomic<uint64_t> _counts[LatencyCounts::BUCKETS] = {};
+    std::atomic<uint64_t> _sum = {0};
+    std::atomic<uint64_t> _max = {0};
+};
+
+// Histograms of this process by name, never removed.
+class LatencyHistograms {
+public:
+    static LatencyHistograms& singleton() {
+        static LatencyHistograms histograms;
+        return histograms;
+    }
+
+    LatencyHistogram& get(const std::string& name) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::unique_ptr<LatencyHistogram>& histogram = _histograms[name];
+        if (!histogram) {
+            histogram = std::make_unique<LatencyHistogram>();
+        }
+        return *histogram;
+    }
+
+    std::map<std::string, LatencyCounts> counts() {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::map<std::string, LatencyCounts> result;
+        for (auto& pair: _histograms) {
+            result[pair.first] = pair.second->counts();
+        }
+        return result;
+    }
+
+private:
+    core::RWSpinLock _lock;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> _histograms;
+};
+
+// Records the latency of a scope.
+class LatencyTimer {
+public:
+    explicit LatencyTimer(LatencyHistogram& histogram)
+        : _histogram(histogram), _start(std::chrono::steady_clock::now()) {}
+
+    ~LatencyTimer() {
+        _histogram.record(std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - _start).count());
+    }
+
+private:
+    LatencyHistogram& _histogram;
+    std::chrono::steady_clock::time_point _start;
+};
+
+#define EMBEDDING_LATENCY(name) \
+    static paradigm4::pico::embedding::LatencyHistogram& name##_latency_histogram = \
+          paradigm4::pico::embedding::LatencyHistograms::singleton().get(#name); \
+    paradigm4::pico::embedding::LatencyTimer name##_latency_timer(name##_latency_histogram)
+
+}
+}
+}
+
+#endif
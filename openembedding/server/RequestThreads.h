@@ -0,0 +1,48 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_REQUEST_THREADS_H
+#define PARADIGM4_HYPEREMBEDDING_REQUEST_THREADS_H
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <pico-core/ThreadGroup.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Threads shared by the requests of this process to split the loops of large batches,
+// e.g. dedup of the indices and scatter of the pulled weights.
+class RequestThreads {
+public:
+    static constexpr size_t MAX_THREADS = 8;
+
+    static size_t num_threads() {
+        size_t hardware_threads = std::thread::hardware_concurrency();
+        return hardware_threads < 2 ? 2 : hardware_threads > MAX_THREADS ? MAX_THREADS : hardware_threads;
+    }
+
+    // Calls fn(part) for the parts, part 0 in this thread.
+    template<class F>
+    static void run(size_t parts, F fn) {
+        std::vector<core::AsyncReturn> asyncs;
+        for (size_t part = 1; part < parts; ++part) {
+            asyncs.push_back(threads().async_exec([&fn, part](int) { fn(part); }));
+        }
+        fn(0);
+        for (core::AsyncReturn& async: asyncs) {
+            async.wait();
+        }
+    }
+
+private:
+    static core::ThreadGroup& threads() {
+        static core::ThreadGroup group(num_threads() - 1);
+        return group;
+    }
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_SCATTER_ROWS_H
+#define PARADIGM4_HYPEREMBEDDING_SCATTER_ROWS_H
+
+#include <cstring>
+#include <functional>
+#include "RequestThreads.h"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// The rows are scattered by threads for large outputs, with non-temporal stores
+// for outputs much larger than the cache, which would only evict the pulled rows.
+constexpr size_t PARALLEL_SCATTER_BYTES = 1 << 20;
+constexpr size_t STREAM_SCATTER_BYTES = 32 << 20;
+
+inline bool can_stream(const char* out, size_t line_size) {
+#if defined(__SSE2__)
+    return reinterpret_cast<uintptr_t>(out) % 16 == 0 && line_size % 16 == 0;
+#else
+    return false;
+#endif
+}
+
+// out and size are aligned by 16 bytes.
+inline void stream_copy(char* out, const char* in, size_t size) {
+#if defined(__SSE2__)
+    for (size_t i = 0; i < size; i += 16) {
+        __m128i line = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_stream_si128(reinterpret_cast<__m128i*>(out + i), line);
+    }
+#else
+    memcpy(out, in, size);
+#endif
+}
+
+inline void stream_fence() {
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+}
+
+// Writes the n rows of out from the rows at source(i), copied or converted by decode(in, out).
+template<class Source>
+void scatter_rows(char* out, size_t n, size_t line_size, Source source,
+      const std::function<void(const char*, char*)>& decode = nullptr) {
+    size_t bytes = n * line_size;
+    size_t parts = bytes >= PARALLEL_SCATTER_BYTES ? RequestThreads::num_threads() : 1;
+    bool stream = bytes >= STREAM_SCATTER_BYTES && !decode && can_stream(out, line_size);
+    RequestThreads::run(parts, [&](size_t part) {
+        size_t begin = n * part / parts;
+        size_t end = n * (part + 1) / parts;
+        for (size_t i = begin; i < end; ++i) {
+            const char* p = source(i);
+            if (decode) {
+                decode(p, out + i * line_size);
+            } else if (stream) {
+                stream_copy(out + i * line_size, p, line_size);
+            } else {
+                memcpy(out + i * line_size, p, line_size);
+            }
+        }
+        if (stream) {
+            stream_fence();
+        }
+    });
+}
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_SHARD_PLACEMENT_H
+#define PARADIGM4_HYPEREMBEDDING_SHARD_PLACEMENT_H
+
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <pico-core/SpinLock.h>
+#include <pico-core/pico_log.h>
+#include <pico-ps/operator/StorageOperator.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// A shard replica moved from one node to another by online migration.
+struct ShardMove {
+    int32_t shard_id = -1;
+    int from = -1;
+    int to = -1;
+    PICO_SERIALIZATION(shard_id, from, to);
+};
+
+// Shard replicas moved after create_storage, on top of the placement in RuntimeInfo.
+// version is increased by every move, requests carry the version of the client.
+class ShardPlacement {
+public:
+    void move(int32_t shard_id, int from, int to) {
+        ++version;
+        for (auto it = moves.begin(); it != moves.end(); ++it) {
+            if (it->shard_id == shard_id && it->to == from) {
+                if (it->from == to) {
+                    moves.erase(it);
+                } else {
+                    it->to = to;
+                }
+                return;
+            }
+        }
+        moves.push_back({shard_id, from, to});
+    }
+
+    // client
+    void pick_one_replica(std::vector<int>& selected_nodes)const {
+        for (const ShardMove& m: moves) {
+            if (selected_nodes[m.shard_id] == m.from) {
+                selected_nodes[m.shard_id] = m.to;
+            }
+        }
+    }
+
+    // client, shards of all nodes.
+    std::unordered_map<int, core::vector<int32_t>> nodes(ps::RuntimeInfo& rt)const {
+        std::unordered_map<int, core::vector<int32_t>> result;
+        for (auto& p: rt.nodes()) {
+            auto& shards = result[p.first];
+            for (int32_t shard_id: p.second) {
+                if (!moved_from(shard_id, p.first)) {
+                    shards.push_back(shard_id);
+                }
+            }
+        }
+        for (const ShardMove& m: moves) {
+            result[m.to].push_back(m.shard_id);
+        }
+        return result;
+    }
+
+    // server
+    bool owns(ps::RuntimeInfo& rt, int32_t shard_id)const {
+        if (rt.local_shards().count(shard_id)) {
+            return !moved_from(shard_id, rt.node_id());
+        }
+        for (const ShardMove& m: moves) {
+            if (m.shard_id == shard_id && m.to == rt.node_id()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // server
+    std::unordered_set<int32_t> local_shards(ps::RuntimeInfo& rt)const {
+        std::unordered_set<int32_t> result;
+        for (int32_t shard_id: rt.local_shards()) {
+            if (!moved_from(shard_id, rt.node_id())) {
+                result.insert(shard_id);
+            }
+        }
+        for (const ShardMove& m: moves) {
+            if (m.to == rt.node_id()) {
+                result.insert(m.shard_id);
+            }
+        }
+        return result;
+    }
+
+    int32_t version = 0;
+    std::vector<ShardMove> moves;
+    PICO_SERIALIZATION(version, moves);
+
+private:
+    bool moved_from(int32_t shard_id, int node_id)const {
+        for (const ShardMove& m: moves) {
+            if (m.shard_id == shard_id && m.from == node_id) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Client side placement of a storage, shared by all handlers of the storage.
+class SharedShardPlacement {
+public:
+    ShardPlacement get() {
+        core::shared_lock_guard<core::RWSpinLock> guard(_lock);
+        return _placement;
+    }
+
+    void update(const ShardPlacement& placement) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        if (placement.version > _placement.version) {
+            _placement = placement;
+        }
+    }
+
+    static std::shared_ptr<SharedShardPlacement> storage(int32_t storage_id) {
+        static core::RWSpinLock lock;
+        static std::unordered_map<int32_t, std::shared_ptr<SharedShardPlacement>> storages;
+        core::lock_guard<core::RWSpinLock> guard(lock);
+        std::shared_ptr<SharedShardPlacement>& placement = storages[storage_id];
+        if (placement == nullptr) {
+            placement = std::make_shared<SharedShardPlacement>();
+        }
+        return placement;
+    }
+
+private:
+    core::RWSpinLock _lock;
+    ShardPlacement _placement;
+};
+
+// Indices changed in the shards being copied to another node, resent when switching.
+// The copy of a shard begins at the store after start, so the pushes pending at start
+// are either in the copied rows or recorded.
+class MigrationTracker {
+public:
+    // (variable_id, indices) sorted by variable_id, the rows to copy.
+    typedef std::vector<std::pair<uint32_t, core::vector<uint64_t>>> Keys;
+
+    bool active()const {
+        return _active.load(std::memory_order_relaxed);
+    }
+
+    void start(int32_t shard_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _shards[shard_id] = Shard();
+        _active.store(true, std::memory_order_relaxed);
+    }
+
+    void stop(int32_t shard_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _shards.erase(shard_id);
+        _active.store(!_shards.empty(), std::memory_order_relaxed);
+    }
+
+    // Called by the store after updating the weights, with the shards locked.
+    void begin_copy() {
+        if (!active()) {
+            return;
+        }
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        for (auto& it: _shards) {
+            it.second.copying = true;
+        }
+    }
+
+    // The keys listed by list() at the first call after begin_copy, nullptr before.
+    // Call with the shard locked, list() runs without the tracker locked.
+    template<class F>
+    std::shared_ptr<const Keys> keys(int32_t shard_id, F list) {
+        {
+            core::lock_guard<core::RWSpinLock> guard(_lock);
+            auto it = _shards.find(shard_id);
+            if (it == _shards.end() || !it->second.copying) {
+                return nullptr;
+            }
+            if (it->second.keys) {
+                return it->second.keys;
+            }
+        }
+        std::shared_ptr<const Keys> keys = std::make_shared<const Keys>(list());
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        auto it = _shards.find(shard_id);
+        if (it == _shards.end()) {
+            return nullptr;
+        }
+        if (!it->second.keys) {
+            it->second.keys = keys;
+        }
+        return it->second.keys;
+    }
+
+    void record(int32_t shard_id, uint32_t variable_id, const uint64_t* indices, size_t n) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        auto it = _shards.find(shard_id);
+        if (it != _shards.end()) {
+            it->second.changed[variable_id].insert(indices, indices + n);
+        }
+    }
+
+    // Pushes to a frozen shard are rejected until stop, set by the last SYNC before INSTALL.
+    void freeze(int32_t shard_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        _shards[shard_id].frozen = true;
+        _active.store(true, std::memory_order_relaxed);
+    }
+
+    bool frozen(int32_t shard_id) {
+        if (!active()) {
+            return false;
+        }
+        core::shared_lock_guard<core::RWSpinLock> guard(_lock);
+        auto it = _shards.find(shard_id);
+        return it != _shards.end() && it->second.frozen;
+    }
+
+    // variable_id --> changed indices since the last take.
+    std::unordered_map<uint32_t, std::unordered_set<uint64_t>> take(int32_t shard_id) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::unordered_map<uint32_t, std::unordered_set<uint64_t>> result;
+        auto it = _shards.find(shard_id);
+        if (it != _shards.end()) {
+            result.swap(it->second.changed);
+        }
+        return result;
+    }
+
+private:
+    struct Shard {
+        bool copying = false;
+        bool frozen = false;
+        std::shared_ptr<const Keys> keys;
+        std::unordered_map<uint32_t, std::unordered_set<uint64_t>> changed;
+    };
+
+    std::atomic<bool> _active = {false};
+    core::RWSpinLock _lock;
+    std::unordered_map<int32_t, Shard> _shards;
+};
+
+}
+}
+}
+
+#endif
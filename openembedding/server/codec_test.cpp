@@ -0,0 +1,511 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <random>
+#include "GradientCodec.h"
+#include "HalfFloat.h"
+#include "IndexCodec.h"
+#include "EmbeddingShardFile.h"
+#include "EmbeddingIndexedFile.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+std::vector<float> random_gradients(size_t n, size_t dim) {
+    std::mt19937 gen(42);
+    std::normal_distribution<float> dist(0, 1);
+    std::vector<float> gradients(n * dim);
+    for (float& value: gradients) {
+        value = dist(gen);
+    }
+    return gradients;
+}
+
+std::vector<float> round_trip(const GradientCodec& codec, const std::vector<float>& gradients, size_t dim) {
+    size_t n = gradients.size() / dim;
+    size_t encoded_line_size = codec.encoded_line_size(dim);
+    std::vector<char> encoded(n * encoded_line_size);
+    for (size_t i = 0; i < n; ++i) {
+        codec.encode(gradients.data() + i * dim, dim, (float*)nullptr, encoded.data() + i * encoded_line_size);
+    }
+    std::vector<float> decoded(n * dim);
+    codec(TypeCase<float>(), encoded.data(), n, dim, reinterpret_cast<char*>(decoded.data()));
+    return decoded;
+}
+
+TEST(GradientCodec, BF16RoundTrip) {
+    size_t dim = 16;
+    GradientCodec codec("bf16", 0);
+    EXPECT_EQ(dim * 2, codec.encoded_line_size(dim));
+    std::vector<float> gradients = random_gradients(100, dim);
+    std::vector<float> decoded = round_trip(codec, gradients, dim);
+    for (size_t i = 0; i < gradients.size(); ++i) {
+        EXPECT_NEAR(gradients[i], decoded[i], std::abs(gradients[i]) / 128);
+    }
+}
+
+TEST(GradientCodec, Int8RoundTrip) {
+    size_t dim = 16;
+    GradientCodec codec("int8", 0);
+    EXPECT_EQ(sizeof(float) + dim, codec.encoded_line_size(dim));
+    std::vector<float> gradients = random_gradients(100, dim);
+    std::vector<float> decoded = round_trip(codec, gradients, dim);
+    for (size_t i = 0; i < gradients.size(); i += dim) {
+        float max_abs = 0;
+        for (size_t j = 0; j < dim; ++j) {
+            max_abs = std::max(max_abs, std::abs(gradients[i + j]));
+        }
+        for (size_t j = 0; j < dim; ++j) {
+            EXPECT_NEAR(gradients[i + j], decoded[i + j], max_abs / 127 / 2 * 1.001);
+        }
+    }
+    std::vector<float> zeros(dim, 0);
+    EXPECT_EQ(zeros, round_trip(codec, zeros, dim));
+}
+
+TEST(GradientCodec, TopkRoundTrip) {
+    size_t dim = 16;
+    GradientCodec codec("topk", 4);
+    EXPECT_EQ(4 * (sizeof(uint32_t) + sizeof(float)), codec.encoded_line_size(dim));
+    std::vector<float> gradients = random_gradients(100, dim);
+    std::vector<float> decoded = round_trip(codec, gradients, dim);
+    for (size_t i = 0; i < gradients.size(); i += dim) {
+        std::vector<float> sorted(dim);
+        for (size_t j = 0; j < dim; ++j) {
+            sorted[j] = std::abs(gradients[i + j]);
+        }
+        std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+        size_t kept = 0;
+        for (size_t j = 0; j < dim; ++j) {
+            if (decoded[i + j] != 0) {
+                EXPECT_EQ(gradients[i + j], decoded[i + j]);
+                EXPECT_GE(std::abs(gradients[i + j]), sorted[3]);
+                ++kept;
+            }
+        }
+        EXPECT_EQ(4, kept);
+    }
+    // k larger than dim keeps all
+    std::vector<float> small = random_gradients(3, 2);
+    EXPECT_EQ(small, round_trip(GradientCodec("topk", 8), small, 2));
+}
+
+TEST(GradientCodec, ErrorFeedback) {
+    size_t dim = 8;
+    GradientCodec codec("topk", 1);
+    std::vector<float> gradient = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<float> residual(dim, 0);
+    std::vector<char> encoded(codec.encoded_line_size(dim));
+    std::vector<float> sum(dim, 0), decoded(dim);
+    for (int step = 0; step < 100; ++step) {
+        codec.encode(gradient.data(), dim, residual.data(), encoded.data());
+        codec(TypeCase<float>(), encoded.data(), 1, dim, reinterpret_cast<char*>(decoded.data()));
+        for (size_t j = 0; j < dim; ++j) {
+            sum[j] += decoded[j];
+            // nothing is lost, the dropped values are kept in the residual
+            EXPECT_FLOAT_EQ(gradient[j] * (step + 1), sum[j] + residual[j]);
+        }
+    }
+}
+
+TEST(GradientResiduals, BoundedRows) {
+    GradientResiduals::Variable residuals(4);
+    for (uint64_t index = 0; index < 4; ++index) {
+        residuals.line<float>(index, 2)[0] = index + 1;
+    }
+    EXPECT_EQ(4, residuals.num_rows());
+    // all referenced, the clock evicts the first row
+    float* line = residuals.line<float>(100, 2);
+    EXPECT_EQ(0, line[0]);
+    EXPECT_EQ(0, line[1]);
+    EXPECT_EQ(4, residuals.num_rows());
+    EXPECT_EQ(1, residuals.evicted);
+    EXPECT_EQ(0, residuals.slots.count(0));
+    // row 1 is used again, so row 2 is evicted next
+    EXPECT_EQ(2, residuals.line<float>(1, 2)[0]);
+    residuals.line<float>(101, 2);
+    EXPECT_EQ(0, residuals.slots.count(2));
+    EXPECT_EQ(1, residuals.slots.count(1));
+    EXPECT_EQ(4, residuals.line<float>(3, 2)[0]);
+}
+
+float float_of(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint32_t bits_of(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Random values of all exponents, and the special values.
+std::vector<float> half_float_inputs() {
+    std::mt19937 gen(7);
+    std::vector<float> values;
+    for (int i = 0; i < 4096; ++i) {
+        values.push_back(float_of(gen()));
+    }
+    for (uint32_t bits: {0x00000000u, 0x80000000u, 0x7F800000u, 0xFF800000u, 0x7FC00000u,
+          0x7F800001u, 0xFFBFFFFFu, 0x00000001u, 0x807FFFFFu, 0x7F7FFFFFu, 0x33800000u,
+          0x33C00000u, 0x38800000u, 0x387FFFFFu, 0x477FEFFFu, 0x477FF000u, 0x3F808000u}) {
+        values.push_back(float_of(bits));
+    }
+    for (float value: {1.0f, -2.5f, 65504.0f, 65519.0f, 65520.0f, 1e10f, 5.9604645e-8f, 1e-40f}) {
+        values.push_back(value);
+    }
+    return values;
+}
+
+// The vectorized loops equal the scalar conversions at every length, the tail included.
+TEST(HalfFloat, SimdEqualsScalar) {
+    std::vector<float> in = half_float_inputs();
+    for (size_t n: {size_t(0), size_t(1), size_t(3), size_t(4), size_t(7), size_t(9), size_t(17), in.size()}) {
+        std::vector<uint16_t> half(n);
+        std::vector<float> out(n);
+        floats_to_bf16(in.data(), n, half.data());
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(float_to_bf16(in[i]), half[i]) << std::hex << bits_of(in[i]);
+        }
+        bf16_to_floats(half.data(), n, out.data());
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(bits_of(bf16_to_float(half[i])), bits_of(out[i])) << std::hex << half[i];
+        }
+        floats_to_fp16(in.data(), n, half.data());
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(float_to_fp16(in[i]), half[i]) << std::hex << bits_of(in[i]);
+        }
+        fp16_to_floats(half.data(), n, out.data());
+        for (size_t i = 0; i < n; ++i) {
+            ASSERT_EQ(bits_of(fp16_to_float(half[i])), bits_of(out[i])) << std::hex << half[i];
+        }
+    }
+    // every half, signaling NaNs included
+    std::vector<uint16_t> halves(1 << 16);
+    for (size_t i = 0; i < halves.size(); ++i) {
+        halves[i] = i;
+    }
+    std::vector<float> out(halves.size());
+    bf16_to_floats(halves.data(), halves.size(), out.data());
+    for (size_t i = 0; i < halves.size(); ++i) {
+        ASSERT_EQ(bits_of(bf16_to_float(halves[i])), bits_of(out[i])) << std::hex << halves[i];
+    }
+    fp16_to_floats(halves.data(), halves.size(), out.data());
+    for (size_t i = 0; i < halves.size(); ++i) {
+        ASSERT_EQ(bits_of(fp16_to_float(halves[i])), bits_of(out[i])) << std::hex << halves[i];
+    }
+}
+
+TEST(HalfFloat, RoundToNearestEven) {
+    // halfway between two bf16 values, to the even one
+    EXPECT_EQ(0x3F80, float_to_bf16(float_of(0x3F808000u)));
+    EXPECT_EQ(0x3F82, float_to_bf16(float_of(0x3F818000u)));
+    EXPECT_EQ(0x3F81, float_to_bf16(float_of(0x3F808001u)));
+    EXPECT_EQ(0xBF80, float_to_bf16(float_of(0xBF808000u)));
+    // 1 + 2^-11 and 1 + 3 * 2^-11 are halfway between two fp16 values
+    EXPECT_EQ(0x3C00, float_to_fp16(1.0f + 0.00048828125f));
+    EXPECT_EQ(0x3C02, float_to_fp16(1.0f + 3 * 0.00048828125f));
+    EXPECT_EQ(0x3C01, float_to_fp16(float_of(0x3F801001u)));
+}
+
+TEST(HalfFloat, NanAndInf) {
+    EXPECT_EQ(0x7F80, float_to_bf16(INFINITY));
+    EXPECT_EQ(0xFF80, float_to_bf16(-INFINITY));
+    EXPECT_EQ(0x7C00, float_to_fp16(INFINITY));
+    EXPECT_EQ(0xFC00, float_to_fp16(-INFINITY));
+    EXPECT_TRUE(std::isinf(bf16_to_float(0x7F80)));
+    EXPECT_TRUE(std::isinf(fp16_to_float(0xFC00)));
+    // a signaling NaN with a low payload is still a NaN, not an infinity
+    for (uint32_t bits: {0x7FC00000u, 0x7F800001u, 0xFF800001u}) {
+        uint16_t bf16 = float_to_bf16(float_of(bits));
+        uint16_t fp16 = float_to_fp16(float_of(bits));
+        EXPECT_TRUE(std::isnan(bf16_to_float(bf16))) << std::hex << bits;
+        EXPECT_TRUE(std::isnan(fp16_to_float(fp16))) << std::hex << bits;
+        EXPECT_EQ(bits >> 31, bf16 >> 15u);
+        EXPECT_EQ(bits >> 31, fp16 >> 15u);
+    }
+}
+
+TEST(HalfFloat, Subnormal) {
+    // float subnormals keep their bits in bf16
+    EXPECT_EQ(0x0001, float_to_bf16(float_of(0x00010000u)));
+    EXPECT_EQ(float_of(0x00010000u), bf16_to_float(0x0001));
+    // fp16 subnormals are multiples of 2^-24, rounded to nearest even
+    float min = 5.9604644775390625e-8f;
+    EXPECT_EQ(0x0001, float_to_fp16(min));
+    EXPECT_EQ(0x0000, float_to_fp16(min / 2));
+    EXPECT_EQ(0x0002, float_to_fp16(min * 1.5f));
+    EXPECT_EQ(0x8001, float_to_fp16(-min));
+    EXPECT_EQ(0x03FF, float_to_fp16(min * 1023));
+    EXPECT_EQ(0x0400, float_to_fp16(min * 1024)); // the smallest normal
+    EXPECT_EQ(0x0400, float_to_fp16(float_of(0x387FFFFFu))); // rounded up to normal
+    EXPECT_EQ(min, fp16_to_float(0x0001));
+    EXPECT_EQ(-min * 1023, fp16_to_float(0x83FF));
+    EXPECT_EQ(0x0000, float_to_fp16(1e-10f));
+}
+
+TEST(HalfFloat, Overflow) {
+    EXPECT_EQ(0x7BFF, float_to_fp16(65504.0f));
+    EXPECT_EQ(0x7BFF, float_to_fp16(65519.0f));
+    EXPECT_EQ(0x7C00, float_to_fp16(65520.0f));
+    EXPECT_EQ(0xFC00, float_to_fp16(-1e10f));
+    EXPECT_EQ(65504.0f, fp16_to_float(0x7BFF));
+    // the largest float rounds up to the bf16 infinity
+    EXPECT_EQ(0x7F80, float_to_bf16(float_of(0x7F7FFFFFu)));
+    EXPECT_EQ(0x7F7F, float_to_bf16(float_of(0x7F7F7FFFu)));
+}
+
+TEST(IndexCodec, RoundTrip) {
+    std::vector<uint64_t> indices = {0, 0, 1, 127, 128, 300, 16383, 16384, 1ull << 35, -2ull, -1ull};
+    std::vector<char> encoded;
+    IndexCodec::encode(indices.data(), indices.size(), encoded);
+    std::vector<uint64_t> decoded(indices.size());
+    const char* end = encoded.data() + encoded.size();
+    EXPECT_EQ(end, IndexCodec::decode(encoded.data(), end, indices.size(), decoded.data()));
+    EXPECT_EQ(indices, decoded);
+
+    // blocks are appended and decoded one after another
+    std::vector<uint64_t> second = {5, 6, 1000000};
+    size_t first_size = encoded.size();
+    IndexCodec::encode(second.data(), second.size(), encoded);
+    end = encoded.data() + encoded.size();
+    const char* next = IndexCodec::decode(encoded.data(), end, indices.size(), decoded.data());
+    EXPECT_EQ(encoded.data() + first_size, next);
+    decoded.resize(second.size());
+    EXPECT_EQ(end, IndexCodec::decode(next, end, second.size(), decoded.data()));
+    EXPECT_EQ(second, decoded);
+}
+
+TEST(IndexCodec, Truncated) {
+    std::vector<uint64_t> indices = {1, 200, 1ull << 40};
+    std::vector<char> encoded;
+    IndexCodec::encode(indices.data(), indices.size(), encoded);
+    std::vector<uint64_t> decoded(indices.size());
+    for (size_t size = 0; size < encoded.size(); ++size) {
+        EXPECT_EQ(nullptr, IndexCodec::decode(encoded.data(), encoded.data() + size, indices.size(), decoded.data()));
+    }
+    // more indices than encoded
+    decoded.resize(indices.size() + 1);
+    EXPECT_EQ(nullptr, IndexCodec::decode(encoded.data(), encoded.data() + encoded.size(), decoded.size(), decoded.data()));
+}
+
+TEST(IndexCodec, Malformed) {
+    uint64_t decoded[2];
+    // more than 64 bits
+    std::vector<char> too_long(11, char(0x80));
+    too_long.back() = 1;
+    EXPECT_EQ(nullptr, IndexCodec::decode(too_long.data(), too_long.data() + too_long.size(), 1, decoded));
+    std::vector<char> overflow_bits(10, char(0xFF));
+    overflow_bits.back() = 2;
+    EXPECT_EQ(nullptr, IndexCodec::decode(overflow_bits.data(), overflow_bits.data() + overflow_bits.size(), 1, decoded));
+    // the sum of the deltas overflows
+    std::vector<uint64_t> max = {-1ull};
+    std::vector<char> encoded;
+    IndexCodec::encode(max.data(), 1, encoded);
+    IndexCodec::encode(max.data(), 1, encoded);
+    EXPECT_EQ(nullptr, IndexCodec::decode(encoded.data(), encoded.data() + encoded.size(), 2, decoded));
+}
+
+TEST(ShardFile, ReadsOldMeta) {
+    std::string path = "/tmp/openembedding_shard_meta_test";
+    EmbeddingShardDataMeta shard;
+    shard.variable_id = 3;
+    shard.meta.datatype = DataType("float32");
+    shard.meta.embedding_dim = 4;
+    shard.meta.vocabulary_size = 100;
+    shard.meta.partition = ShardPartition("range");
+    shard.config = "{}";
+    shard.shard_id = 1;
+    shard.shard_num = 2;
+    shard.state_line_size = 8;
+    shard.num_items = 5;
+    {
+        FileWriter writer;
+        ASSERT_TRUE(writer.open(core::URIConfig(path)));
+        // model version 0.2
+        writer.write(shard.variable_id);
+        writer.write(shard.meta.datatype);
+        writer.write(shard.meta.embedding_dim);
+        writer.write(shard.meta.vocabulary_size);
+        writer.write(shard.config);
+        writer.write(shard.shard_id);
+        writer.write(shard.shard_num);
+        writer.write(shard.state_line_size);
+        writer.write(shard.num_items);
+        write_shard_meta(writer, shard);
+    }
+    FileReader reader;
+    ASSERT_TRUE(reader.open(core::URIConfig(path)));
+    EmbeddingShardDataMeta old;
+    ASSERT_TRUE(read_shard_meta(reader, old));
+    EXPECT_EQ(3u, old.variable_id);
+    EXPECT_EQ(ShardPartition("modulo"), old.meta.partition);
+    EXPECT_EQ(100u, old.meta.vocabulary_size);
+    EXPECT_EQ("{}", old.config);
+    EXPECT_EQ(2, old.shard_num);
+    EXPECT_EQ(5u, old.num_items);
+    EmbeddingShardDataMeta current;
+    ASSERT_TRUE(read_shard_meta(reader, current));
+    EXPECT_EQ(shard.meta, current.meta);
+    EXPECT_EQ(5u, current.num_items);
+    EXPECT_FALSE(read_shard_meta(reader, current));
+    std::remove(path.c_str());
+}
+
+EmbeddingShardDataMeta lz4_shard(int32_t shard_id, uint64_t num_items) {
+    EmbeddingShardDataMeta shard;
+    shard.variable_id = 1;
+    shard.meta.datatype = DataType("float32");
+    shard.meta.embedding_dim = 8;
+    shard.meta.vocabulary_size = 1 << 20;
+    shard.shard_id = shard_id;
+    shard.shard_num = 2;
+    shard.num_items = num_items;
+    return shard;
+}
+
+// Reads the file the way the loaders do, true if it ends without error and matches the rows.
+bool read_lz4_file(const std::string& path, const std::vector<float>& rows) {
+    FileReader reader;
+    if (!reader.open(core::URIConfig(path))) {
+        return false;
+    }
+    EmbeddingShardDataMeta shard;
+    std::vector<float> read;
+    while (read_shard_meta(reader, shard)) {
+        std::vector<float> values(shard.num_items * shard.meta.embedding_dim);
+        if (!reader.read(values.data(), values.size())) {
+            return false;
+        }
+        read.insert(read.end(), values.begin(), values.end());
+    }
+    return !reader.error() && read == rows;
+}
+
+TEST(ShardFile, Lz4RoundTrip) {
+    std::string path = "/tmp/openembedding_lz4_test" + std::string(Lz4File::SUFFIX);
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    std::vector<float> rows;
+    {
+        FileWriter writer;
+        ASSERT_TRUE(writer.open(core::URIConfig(path)));
+        for (int32_t shard_id = 0; shard_id < 2; ++shard_id) {
+            EmbeddingShardDataMeta shard = lz4_shard(shard_id, 20000);
+            std::vector<float> values(shard.num_items * shard.meta.embedding_dim);
+            for (float& value: values) {
+                value = uniform(gen);
+            }
+            write_shard_meta(writer, shard);
+            writer.write(values.data(), values.size());
+            rows.insert(rows.end(), values.begin(), values.end());
+        }
+    }
+    EXPECT_TRUE(read_lz4_file(path, rows));
+
+    std::vector<char> bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    ASSERT_GT(bytes.size(), 100u);
+    // cut in the rows, in the end mark, before the end mark and after the frame header
+    for (size_t size: {bytes.size() / 2, bytes.size() - 1, bytes.size() - 4, size_t(7)}) {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), size);
+        }
+        EXPECT_FALSE(read_lz4_file(path, rows)) << size;
+    }
+    std::remove(path.c_str());
+}
+
+TEST(ModelMeta, ReadsOldVersion) {
+    core::PicoJsonNode json;
+    ASSERT_TRUE(json.load(R"({"model_sign": "m", "version": "0.2", "variables": [{"datatype": "float32",
+          "embedding_dim": 4, "vocabulary_size": 100, "storage_name": "s"}]})"));
+    ModelOfflineMeta model_meta;
+    ASSERT_TRUE(model_meta.from_json_node(json));
+    ASSERT_EQ(1u, model_meta.variables.size());
+    EXPECT_EQ(ShardPartition("modulo"), model_meta.variables[0].meta.partition);
+}
+
+TEST(ModelMeta, CheckpointKind) {
+    ModelOfflineMeta model_meta;
+    model_meta.model_sign = "m";
+    core::PicoJsonNode json = model_meta.to_json_node();
+    ModelOfflineMeta loaded;
+    ASSERT_TRUE(loaded.from_json_node(json));
+    EXPECT_EQ("", loaded.checkpoint);
+    model_meta.checkpoint = "delta";
+    json = model_meta.to_json_node();
+    ASSERT_TRUE(loaded.from_json_node(json));
+    EXPECT_EQ("delta", loaded.checkpoint);
+}
+
+void write_indexed_file(const std::string& path) {
+    EmbeddingVariableMeta meta;
+    meta.datatype = DataType("float32");
+    meta.embedding_dim = 2;
+    meta.vocabulary_size = 100;
+    IndexedShardFile::Footer footer;
+    footer.shard_num = 1;
+    footer.num_items = 2;
+    footer.line_size = meta.line_size();
+    std::vector<float> rows = {1, 2, 3, 4};
+    std::vector<uint64_t> indices = {3, 7};
+    FileWriter writer;
+    ASSERT_TRUE(writer.open(core::URIConfig(path)));
+    writer.write(rows.data(), rows.size());
+    IndexedShardFile::write_tail(writer, footer, indices.data(), meta);
+}
+
+void patch_indexed_footer(const std::string& path, uint64_t num_items) {
+    FILE* fp = fopen(path.c_str(), "r+b");
+    ASSERT_TRUE(fp);
+    IndexedShardFile::Footer footer;
+    fseek(fp, -static_cast<long>(sizeof(footer)), SEEK_END);
+    ASSERT_EQ(1u, fread(&footer, sizeof(footer), 1, fp));
+    footer.num_items = num_items;
+    fseek(fp, -static_cast<long>(sizeof(footer)), SEEK_END);
+    ASSERT_EQ(1u, fwrite(&footer, sizeof(footer), 1, fp));
+    fclose(fp);
+}
+
+TEST(IndexedShardFile, CheckLayout) {
+    std::string path = "/tmp/openembedding_indexed_test" + std::string(IndexedShardFile::SUFFIX);
+    write_indexed_file(path);
+    {
+        IndexedShardFile file;
+        ASSERT_TRUE(file.open(path));
+        std::vector<uint64_t> indices = {7, 5};
+        std::vector<float> weights(4);
+        file.get_weights(indices.data(), indices.size(), reinterpret_cast<char*>(weights.data()));
+        EXPECT_EQ(std::vector<float>({3, 4, 0, 0}), weights);
+    }
+    // the indices overlap the meta
+    patch_indexed_footer(path, 3);
+    {
+        IndexedShardFile file;
+        EXPECT_FALSE(file.open(path));
+    }
+    // the sizes overflow
+    patch_indexed_footer(path, 1ull << 61);
+    {
+        IndexedShardFile file;
+        EXPECT_FALSE(file.open(path));
+    }
+    std::remove(path.c_str());
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include "EmbeddingHotKeyOperator.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+core::vector<char> row(float value) {
+    core::vector<char> result(sizeof(float));
+    memcpy(result.data(), &value, sizeof(float));
+    return result;
+}
+
+// The refresh after update_weights installs the updated rows of the replicated keys.
+TEST(EmbeddingHotKeys, RefreshRows) {
+    EmbeddingHotKeys collected;
+    EmbeddingHotKeys::Variable& variable = collected.variables[3];
+    variable.keys = {7, 2};
+    variable.rows[7] = row(1.5);
+    variable.rows[2] = row(2.5);
+    collected.merge(0);
+    ASSERT_FALSE(collected.empty());
+    EXPECT_EQ(core::vector<uint64_t>({7, 2}), variable.keys);
+
+    // the next update, the owners return the new rows
+    variable.rows[7] = row(3.5);
+    variable.counts[9] = 100;
+    variable.rows[9] = row(0);
+    collected.merge(0);
+    EXPECT_EQ(core::vector<uint64_t>({7, 2}), variable.keys);
+    EXPECT_EQ(row(3.5), variable.rows.at(7));
+    EXPECT_EQ(row(2.5), variable.rows.at(2));
+}
+
+// New keys are the most pulled candidates found by their owners, appended after the old keys.
+TEST(EmbeddingHotKeys, MergeCandidates) {
+    EmbeddingHotKeys collected;
+    EmbeddingHotKeys::Variable& variable = collected.variables[0];
+    variable.keys = {5};
+    variable.rows[5] = row(5);
+    for (uint64_t key: {1, 2, 3, 4}) {
+        variable.counts[key] = key * 10;
+        variable.rows[key] = row(key);
+    }
+    variable.counts[8] = 1000; // owner not found
+    variable.counts[5] = 500;
+    collected.merge(3);
+    EXPECT_EQ(core::vector<uint64_t>({5, 4, 3}), variable.keys);
+}
+
+// A variable is not installed if the owner of a replicated key did not return its row.
+TEST(EmbeddingHotKeys, MissingOwner) {
+    EmbeddingHotKeys collected;
+    collected.variables[1].keys = {5, 6};
+    collected.variables[1].rows[5] = row(5);
+    collected.variables[2].counts[1] = 1;
+    collected.merge(2);
+    EXPECT_FALSE(collected.variables.count(1));
+    EXPECT_TRUE(collected.empty());
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
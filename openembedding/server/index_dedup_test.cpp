@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_map>
+#include "IndexDedup.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+std::vector<uint64_t> random_indices(size_t n, uint64_t range, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::vector<uint64_t> indices(n);
+    for (uint64_t& index: indices) {
+        index = range ? gen() % range : gen();
+    }
+    return indices;
+}
+
+// Checks the dedup against a hash map numbering the keys in the order first seen.
+void check_dedup(const IndexDedup& dedup, const std::vector<uint64_t>& indices) {
+    std::unordered_map<uint64_t, size_t> ids;
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        auto it = ids.emplace(indices[i], keys.size()).first;
+        if (it->second == keys.size()) {
+            keys.push_back(indices[i]);
+        }
+        ASSERT_EQ(it->second, dedup.inverse()[i]);
+    }
+    ASSERT_EQ(keys.size(), dedup.size());
+    for (size_t id = 0; id < keys.size(); ++id) {
+        ASSERT_EQ(keys[id], dedup.keys()[id]);
+    }
+    for (size_t j = 1; j < keys.size(); ++j) {
+        ASSERT_LT(keys[dedup.sorted()[j - 1]], keys[dedup.sorted()[j]]);
+    }
+}
+
+void check_buckets(const IndexDedup& dedup, const ShardPartitioner& partitioner,
+      int32_t shard_num, bool sorted) {
+    size_t total = 0;
+    for (int32_t shard_id = 0; shard_id < shard_num; ++shard_id) {
+        for (size_t j = dedup.bucket_begin(shard_id); j < dedup.bucket_begin(shard_id + 1); ++j) {
+            size_t id = dedup.buckets()[j];
+            ASSERT_EQ(shard_id, dedup.shard(id));
+            ASSERT_EQ(shard_id, partitioner.shard(dedup.keys()[id]));
+            if (j > dedup.bucket_begin(shard_id)) {
+                size_t prev = dedup.buckets()[j - 1];
+                if (sorted) {
+                    ASSERT_LT(dedup.keys()[prev], dedup.keys()[id]);
+                } else {
+                    ASSERT_LT(prev, id);
+                }
+            }
+            ++total;
+        }
+    }
+    ASSERT_EQ(dedup.size(), total);
+}
+
+void test_dedup(size_t n) {
+    IndexDedup dedup; // reused between the calls
+    int32_t shard_num = 7;
+    ShardPartitioner partitioner(ShardPartition(ShardPartition::HASH), shard_num, 0);
+    // small ranges skip the digits same in all the keys
+    for (uint64_t range: {10ull, 1000000ull, 0ull}) {
+        std::vector<uint64_t> indices = random_indices(n, range, n + range);
+        dedup.dedup(indices.data(), indices.size());
+        check_dedup(dedup, indices);
+        for (bool sorted: {true, false}) {
+            dedup.dedup(indices.data(), indices.size(), partitioner, shard_num, sorted);
+            check_dedup(dedup, indices);
+            check_buckets(dedup, partitioner, shard_num, sorted);
+        }
+    }
+}
+
+TEST(IndexDedup, Empty) {
+    test_dedup(0);
+    test_dedup(1);
+}
+
+TEST(IndexDedup, StdSort) {
+    test_dedup(IndexDedup::SORT_MIN_INDICES - 1);
+}
+
+TEST(IndexDedup, RadixSort) {
+    test_dedup(IndexDedup::SORT_MIN_INDICES);
+    test_dedup(5000);
+}
+
+TEST(IndexDedup, ParallelRadixSort) {
+    test_dedup(IndexDedup::PARALLEL_MIN_INDICES);
+    test_dedup(IndexDedup::PARALLEL_MIN_INDICES * 3 + 1);
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
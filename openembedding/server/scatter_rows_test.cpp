@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+#include "ScatterRows.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// The pulled rows of each shard in a buffer, row i of the output is the row of keys[i].
+struct ShardRows {
+    std::vector<std::vector<float>> shards;
+    std::vector<uint64_t> keys;
+    size_t dim = 0;
+
+    ShardRows(size_t shard_num, size_t n, size_t dim, uint64_t seed)
+        : shards(shard_num), keys(n), dim(dim) {
+        std::mt19937_64 gen(seed);
+        size_t num_keys = n / 2 + 1;
+        for (uint64_t& key: keys) {
+            key = gen() % num_keys; // duplicated keys share their rows
+        }
+        for (uint64_t key = 0; key < num_keys; key += shard_num) {
+            for (size_t shard_id = 0; shard_id < shard_num; ++shard_id) {
+                for (size_t j = 0; j < dim; ++j) {
+                    shards[shard_id].push_back(key + shard_id + j * 0.5f);
+                }
+            }
+        }
+    }
+
+    const char* row(size_t i) const {
+        size_t shard_num = shards.size();
+        const float* shard = shards[keys[i] % shard_num].data();
+        return reinterpret_cast<const char*>(shard + keys[i] / shard_num * dim);
+    }
+};
+
+void check_scatter(size_t shard_num, size_t n, size_t dim) {
+    ShardRows rows(shard_num, n, dim, shard_num * n + dim);
+    size_t line_size = dim * sizeof(float);
+    auto source = [&rows](size_t i) { return rows.row(i); };
+    std::vector<float> serial(n * dim), scattered(n * dim);
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(serial.data() + i * dim, rows.row(i), line_size);
+    }
+    scatter_rows(reinterpret_cast<char*>(scattered.data()), n, line_size, source);
+    ASSERT_EQ(serial, scattered) << shard_num << ' ' << n << ' ' << dim;
+
+    auto decode = [dim](const char* in, char* out) {
+        const float* row = reinterpret_cast<const float*>(in);
+        for (size_t j = 0; j < dim; ++j) {
+            reinterpret_cast<float*>(out)[j] = -row[j];
+        }
+    };
+    for (size_t i = 0; i < n; ++i) {
+        decode(rows.row(i), reinterpret_cast<char*>(serial.data() + i * dim));
+    }
+    scatter_rows(reinterpret_cast<char*>(scattered.data()), n, line_size, source, decode);
+    ASSERT_EQ(serial, scattered) << shard_num << ' ' << n << ' ' << dim;
+}
+
+// Outputs below the parallel size, scattered by threads, and streamed if aligned.
+TEST(ScatterRows, SerialEqualsParallel) {
+    for (size_t shard_num: {1, 3, 8}) {
+        for (size_t dim: {3, 16}) {
+            check_scatter(shard_num, 1000, dim);
+            check_scatter(shard_num, 100000, dim);
+            check_scatter(shard_num, STREAM_SCATTER_BYTES / (dim * sizeof(float)) + 1, dim);
+        }
+    }
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
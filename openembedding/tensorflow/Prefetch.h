@@ -2,6 +2,7 @@
 #define PARADIGM4_HYPEREMBEDDING_COMMON_PREFETCH_H
 
 #include <unordered_map>
+#include <vector>
 
 #include "ThreadPool.h"
 
@@ -46,7 +47,10 @@ struct PrefetchKey {
 
 struct PrefetchValue {
     uint64_t check = 0;
-    exb_pull_waiter* waiter;
+    exb_pull_waiter* waiter = nullptr; // nullptr until a fused prefetch is sent
+    // A fused prefetch is sent with the push of the last batch, keep its indices until then.
+    std::vector<uint64_t> indices;
+    int64_t batch_id = 0;
 };
 
 class PrefetchTable {
@@ -67,6 +71,25 @@ public:
         return true;
     }
 
+    // Sends the first fused prefetch of the variable not sent yet by send(value),
+    // which returns the waiter. Returns false if there is none.
+    template<class Send>
+    bool send_fused(exb_variable* variable, Send send) {
+        exb_lock_guard guard(_mutex);
+        auto it = _table.find(variable);
+        if (it == _table.end()) {
+            return false;
+        }
+        for (PrefetchValue& value: it->second) {
+            if (value.waiter == nullptr) {
+                value.waiter = send(value);
+                value.indices = std::vector<uint64_t>();
+                return true;
+            }
+        }
+        return false;
+    }
+
     exb_mutex _mutex;
     std::unordered_map<exb_variable*, std::deque<PrefetchValue>> _table;
 };
@@ -222,9 +222,11 @@ def _get_context():
 class Variable:
     def __init__(self, initializer=None, trainable=None, name=None,
           dtype=None, shape=None, num_shards=None, sparse_as_dense=False,
-          graph_var=None):
+          graph_var=None, partition=None):
         if not num_shards:
             num_shards = -1
+        if not partition:
+            partition = 'modulo'
         # TODO: Initializer support direct Tensor and auto set shape.
         if shape is not None:
             shape = list(shape)
@@ -274,7 +276,7 @@ class Variable:
         # TensorFlow:AutoGraph not support mangled names.
         self.graph_var = graph_var
         self.storage = _get_context()._context.create_storage(num_shards)
-        self.variable = self.storage.create_variable(shape[0], embedding_dim, dtype)
+        self.variable = self.storage.create_variable(shape[0], embedding_dim, dtype, partition)
         self.variable.set_initializer(initializer)
         self.model_uuid = _get_context()._context.model_uuid
         self.model_version = _get_context()._model_version
@@ -293,7 +295,7 @@ class Variable:
     def sparse_as_dense(self):
         return self.__sparse_as_dense
 
-    def prefetch(self, indices, steps=None):
+    def prefetch(self, indices, steps=None, fused=False):
         if steps is None:
             steps = -1
         if self.sparse_as_dense:
@@ -303,7 +305,7 @@ class Variable:
             with tf.device('CPU:0'):
                 indices = tf.cast(indices, tf.int64)
         return exb_ops.prefetch_pull_weights(self.graph_var, indices,
-              variable_intptr=self.variable.intptr, steps=steps)
+              variable_intptr=self.variable.intptr, steps=steps, fused=fused)
 
     def sparse_read(self, indices):
         if self.sparse_as_dense:
@@ -380,6 +382,13 @@ num_shards: The Embedding layer will be divided into shards.
 
     n: The sum number of all shards on all servers.
 
+partition: How the keys are divided into shards.
+    'modulo': key % num_shards, the default.
+
+    'hash', 'jump': Hash of the key, for sequential keys. Stored in hash tables.
+
+    'range': Contiguous key ranges, keeps nearby keys in the same shard.
+
 explicit:
     False: The embeddings_regularizer is traited as activity_regularizer, and ignore other unsupported arguments。
 
@@ -388,7 +397,7 @@ explicit:
 class Embedding(tf.keras.layers.Embedding):
     def __init__(self, input_dim, output_dim, embeddings_initializer='uniform',
           embeddings_regularizer=None, activity_regularizer=None, embeddings_constraint=None, *args,
-          num_shards=None, sparse_as_dense=False, explicit=True, **kwargs):
+          num_shards=None, sparse_as_dense=False, explicit=True, partition=None, **kwargs):
         if input_dim is None:
             input_dim = -1
         if input_dim == -1:
@@ -407,6 +416,7 @@ class Embedding(tf.keras.layers.Embedding):
             raise ValueError('error input_dim')
 
         self.num_shards = num_shards # self.num_shards is private.
+        self.partition = partition
         self.sparse_as_dense = sparse_as_dense
         super(Embedding, self).__init__(input_dim, output_dim,
                embeddings_initializer=embeddings_initializer,
@@ -435,6 +445,7 @@ class Embedding(tf.keras.layers.Embedding):
                   dtype=self.dtype,
                   shape=(self.input_dim, self.output_dim),
                   num_shards=self.num_shards,
+                  partition=self.partition,
                   graph_var=self.embeddings)
         self.model_version = _get_context()._model_version
         self.built = True
@@ -496,11 +507,26 @@ def save_server_model(model, filepath, include_optimizer=True):
           _get_context().model_version, include_optimizer)
 
 
-def load_server_model(model, filepath):
+def load_server_model(model, filepath, deltas=()):
     '''
     Load the parameters on servers. This function must be called synchronously by all workers.
+
+    deltas: Paths of delta checkpoints saved after the checkpoint in filepath, loaded in order.
     '''
     _get_context()._context.load_model(filepath)
+    for delta in deltas:
+        _get_context()._context.load_model_delta(delta)
+
+
+def save_server_checkpoint(model, filepath, delta=False):
+    '''
+    Save a training checkpoint of the parameters on servers, including the optimizer states.
+
+    delta: Only save the rows changed since the last checkpoint of this function.
+        A full checkpoint is saved instead if there is no checkpoint before.
+    '''
+    _get_context()._context.checkpoint_model(filepath,
+          _get_context().model_version, 'delta' if delta else 'base')
 
 
 def save_as_original_model(model, filepath, overwrite=True, include_optimizer=True, *args, **kwargs):
@@ -642,7 +668,7 @@ def distributed_model(model, sparse_as_dense_size=64, num_shards=None, override_
     return model
 
 
-def pulling(dataset, model, steps=None):
+def pulling(dataset, model, steps=None, fused=False):
     '''
     EXPERIMENTAL! Return a tf.data.Dataset that will send pull requests.
 
@@ -654,6 +680,8 @@ def pulling(dataset, model, steps=None):
     dataset: an instance of tf.data.Dataset.
 
     model: an instance of Network.
+
+    fused: send each pull request with the push request of the last batch in one request.
         
     '''
     if not isinstance(dataset, tf.data.Dataset):
@@ -686,7 +714,7 @@ def pulling(dataset, model, steps=None):
         for variable, names in prefetch_dict.items():
             if len(names) == 1: 
                 print("prefetch " + names[0] + " for " + variable.name)
-                results[0][names[0]] = variable.prefetch(results[0][names[0]], steps=steps)
+                results[0][names[0]] = variable.prefetch(results[0][names[0]], steps=steps, fused=fused)
         return results
     return dataset.map(mapper) # Prefetching order must be same as the batch order.
 
@@ -112,6 +112,7 @@ REGISTER_OP("PrefetchPullWeights")
     .Output("output: Tindices")
     .Attr("variable_intptr: int")
     .Attr("steps: int")
+    .Attr("fused: bool = false") // sent with the push of the last batch
     .Attr("dtype: type")
     .Attr("Tindices: {int64}")
     .SetShapeFn([](InferenceContext* context) {
@@ -127,6 +128,7 @@ public:
     explicit PrefetchPullWeightsOp(OpKernelConstruction* context): OpKernel(context) {
         OP_REQUIRES_OK(context, context->GetAttr("variable_intptr", &variable_intptr_));
         OP_REQUIRES_OK(context, context->GetAttr("steps", &steps_));
+        OP_REQUIRES_OK(context, context->GetAttr("fused", &fused_));
         OP_REQUIRES(context, variable_intptr_ != 0, errors::InvalidArgument("null variable_intptr"));
         OP_REQUIRES(context, steps_ >= -1, errors::InvalidArgument("error prefetch steps"));
         if (steps_ == -1) {
@@ -169,7 +171,12 @@ public:
 
         PrefetchValue value;
         value.check = key.hash();
-        value.waiter = exb_pull_weights(key.variable, key.indices, key.n, key.batch_id);
+        if (fused_) {
+            value.indices.assign(key.indices, key.indices + key.n);
+            value.batch_id = key.batch_id;
+        } else {
+            value.waiter = exb_pull_weights(key.variable, key.indices, key.n, key.batch_id);
+        }
         global_prefetch_table.push(key, std::move(value));
         running_ = false;
     }
@@ -177,6 +184,7 @@ public:
 private:
     int64 variable_intptr_ = 0;
     int64 steps_ = 0;
+    bool fused_ = false;
     bool running_ = false;
 };
 
@@ -304,7 +312,9 @@ public:
             OP_REQUIRES(context, value.check == key.hash(),
                   errors::InvalidArgument("prefetch not match, maybe prefetch multi times or concurrently"));
             waiter = value.waiter;
-        } else {
+        }
+        if (waiter == nullptr) {
+            // not prefetched, or a fused prefetch without push before
             waiter = exb_pull_weights(key.variable, key.indices, key.n, key.batch_id);
         }
 
@@ -381,8 +391,16 @@ public:
 
         /// TODO: check datatype
         const void* data = grads.flat<T>().data();
-        exb_waiter* waiter = exb_push_gradients(reinterpret_cast<exb_variable*>(variable_intptr_),
-            reinterpret_cast<const uint64_t*>(indices.flat<Index>().data()), N, data);
+        exb_variable* variable = reinterpret_cast<exb_variable*>(variable_intptr_);
+        const uint64_t* push_indices = reinterpret_cast<const uint64_t*>(indices.flat<Index>().data());
+        // Send with the fused prefetch of the next batch, the push is waited by update weights.
+        if (global_prefetch_table.send_fused(variable, [&](const PrefetchValue& value) {
+            return exb_push_pull(variable, push_indices, N, data,
+                  value.indices.data(), value.indices.size(), value.batch_id);
+        })) {
+            return;
+        }
+        exb_waiter* waiter = exb_push_gradients(variable, push_indices, N, data);
         OP_REQUIRES(context, exb_wait(waiter),
                 errors::InvalidArgument("push failed: ", exb_last_error()));
     }
@@ -2,6 +2,7 @@
 #define PARADIGM4_HYPEREMBEDDING_EMBEDDING_OPTIMIZER_VARIABLE_H
 
 #include <limits>
+#include <pico-core/ThreadGroup.h>
 #include <pico-core/VirtualObject.h>
 #include "Meta.h"
 #include "EmbeddingTable.h"
@@ -9,6 +10,7 @@
 #include "EmbeddingOptimizer.h"
 #include "MpscGradientReducer.h"
 #include "VariableAsyncTask.h"
+#include "LockProfiler.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -25,6 +27,33 @@ public:
     virtual size_t read_keys(key_type* keys, size_t n) = 0;
 };
 
+// Logs the rows copied while changing the table or optimizer of a variable, at every tenth.
+class CopyProgress {
+public:
+    explicit CopyProgress(uint64_t total)
+        : _total(total), _start(std::chrono::steady_clock::now()) {}
+
+    void add(uint64_t n) { // thread safe
+        uint64_t done = _done.fetch_add(n, std::memory_order_relaxed) + n;
+        uint64_t tenth = _total ? std::min<uint64_t>(done * 10 / _total, 10) : 10;
+        uint64_t logged = _logged.load(std::memory_order_relaxed);
+        while (tenth > logged) {
+            if (_logged.compare_exchange_weak(logged, tenth, std::memory_order_relaxed)) {
+                SLOG(INFO) << "copied " << done << "/" << _total << " rows in "
+                      << std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now() - _start).count() << "s";
+                break;
+            }
+        }
+    }
+
+private:
+    uint64_t _total = 0;
+    std::chrono::steady_clock::time_point _start;
+    std::atomic<uint64_t> _done = {0};
+    std::atomic<uint64_t> _logged = {0};
+};
+
 template<class Key, class T>
 class EmbeddingOptimizerVariableInterface: core::VirtualObject {
     using key_type = Key;
@@ -51,22 +80,10 @@ public:
           const T* gradients, const uint64_t* counts, VariableAsyncTask& async_task) = 0; // thread safe
     virtual void update_weights() = 0;
 
-    virtual void copy_from(EmbeddingOptimizerVariableInterface<key_type, T>&& other, size_t block_num_items) {
-        size_t state_dim = other.embedding_optimizer()->state_dim(embedding_dim());
-        std::vector<key_type> indices(block_num_items);
-        std::vector<T> weights(indices.size() * embedding_dim());
-        std::vector<T> states(indices.size() * state_dim);
-        auto reader = other.create_key_reader();
-        size_t n = 0;
-        while ((n = reader->read_keys(indices.data(), indices.size()))) {
-            if (embedding_optimizer()->category() == other.embedding_optimizer()->category()) {
-                other.get_weights(indices.data(), n, weights.data(), states.data());
-                this->set_weights(indices.data(), n, weights.data(), states.data());
-            } else {
-                other.get_weights(indices.data(), n, weights.data());
-                this->set_weights(indices.data(), n, weights.data());
-            }
-        }
+    // Rows are copied by threads if the table supports it.
+    virtual void copy_from(EmbeddingOptimizerVariableInterface<key_type, T>&& other,
+          size_t block_num_items, size_t threads = 1) {
+        copy_rows(other, block_num_items, threads);
         _new_weights = std::move(other._new_weights);
         _gradients = std::move(other._gradients);
     }
@@ -114,6 +131,43 @@ public:
         return false;
     }
 
+    virtual size_t flush_checkpoint(size_t) {
+        return 0;
+    }
+
+    virtual void memory_usage(EmbeddingMemoryUsage& usage) {
+        EmbeddingTable<key_type, T>* table = embedding_table();
+        size_t dim = embedding_dim();
+        size_t state_dim = embedding_optimizer()->state_dim(dim);
+        uint64_t rows = table->rows_memory_usage();
+        usage.num_items += table->num_items();
+        usage.weights += rows * dim / (dim + state_dim);
+        usage.states += rows - rows * dim / (dim + state_dim);
+        usage.index += table->index_memory_usage();
+        usage.pending += _new_weights->rows_memory_usage() + _new_weights->index_memory_usage()
+              + _gradients->memory_usage();
+    }
+
+    // Keys changed since the last call for delta checkpoints,
+    // false if they were not tracked before the call.
+    virtual bool take_dirty_keys(core::vector<key_type>&) {
+        return false;
+    }
+
+    // A consistent image of the rows for dumping while training, rows changed after
+    // begin_snapshot keep their old values aside. False if snapshots are not supported.
+    virtual bool begin_snapshot() {
+        return false;
+    }
+    virtual uint64_t snapshot_num_keys() {
+        return 0;
+    }
+    virtual size_t read_snapshot_keys(key_type*, size_t) {
+        return 0;
+    }
+    virtual void get_snapshot_weights(const key_type*, size_t, T*, T* = nullptr) {}
+    virtual void end_snapshot() {}
+
     size_t embedding_dim() {
         return _embedding_dim;
     }
@@ -125,6 +179,27 @@ public:
 private:
     size_t _embedding_dim = 0;
 protected:
+    virtual void copy_rows(EmbeddingOptimizerVariableInterface<key_type, T>& other,
+          size_t block_num_items, size_t) {
+        size_t state_dim = other.embedding_optimizer()->state_dim(embedding_dim());
+        std::vector<key_type> indices(block_num_items);
+        std::vector<T> weights(indices.size() * embedding_dim());
+        std::vector<T> states(indices.size() * state_dim);
+        CopyProgress progress(other.embedding_table()->num_items());
+        auto reader = other.create_key_reader();
+        size_t n = 0;
+        while ((n = reader->read_keys(indices.data(), indices.size()))) {
+            if (embedding_optimizer()->category() == other.embedding_optimizer()->category()) {
+                other.get_weights(indices.data(), n, weights.data(), states.data());
+                this->set_weights(indices.data(), n, weights.data(), states.data());
+            } else {
+                other.get_weights(indices.data(), n, weights.data());
+                this->set_weights(indices.data(), n, weights.data());
+            }
+            progress.add(n);
+        }
+    }
+
     std::unique_ptr<EmbeddingHashTable<key_type, T>> _new_weights;
     std::unique_ptr<MpscGradientReducer<key_type, T>> _gradients;
     std::unique_ptr<EmbeddingInitializer<T>> _initializer;
@@ -205,6 +280,66 @@ public:
     }
 
 protected:
+    // Keys are read and their rows created by this thread, then the rows are copied by all threads.
+    // The new table is not changed by others, so it needs no snapshot or dirty keys.
+    void copy_rows(EmbeddingOptimizerVariableInterface<key_type, T>& other,
+          size_t block_num_items, size_t threads) override {
+        if (!Table::STABLE_ROWS || threads <= 1) {
+            return EmbeddingOptimizerVariableInterface<key_type, T>::copy_rows(other, block_num_items, threads);
+        }
+        size_t dim = this->embedding_dim();
+        bool copy_states = _optimizer.category() == other.embedding_optimizer()->category();
+        size_t state_dim = copy_states ? _optimizer.state_dim(dim) : 0;
+        CopyProgress progress(other.embedding_table()->num_items());
+        core::ThreadGroup group(threads);
+        core::vector<key_type> keys(block_num_items * threads * 16);
+        core::vector<T*> rows(keys.size());
+        auto reader = other.create_key_reader();
+        size_t n = 0;
+        while ((n = reader->read_keys(keys.data(), keys.size()))) {
+            _table.reserve_keys(keys.data(), n);
+            for (size_t i = 0; i < n; ++i) {
+                rows[i] = _table.set_value(keys[i]);
+            }
+            std::vector<core::AsyncReturn> asyncs;
+            size_t part = (n + threads - 1) / threads;
+            for (size_t begin = 0; begin < n; begin += part) {
+                size_t end = std::min(n, begin + part);
+                asyncs.push_back(group.async_exec([&, begin, end](int) {
+                    std::vector<T> weights(block_num_items * dim);
+                    std::vector<T> states(block_num_items * state_dim);
+                    for (size_t i = begin; i < end; i += block_num_items) {
+                        size_t m = std::min(block_num_items, end - i);
+                        other.get_weights(keys.data() + i, m, weights.data(),
+                              copy_states ? states.data() : nullptr);
+                        set_rows(rows.data() + i, m, weights.data(),
+                              copy_states ? states.data() : nullptr);
+                        progress.add(m);
+                    }
+                }));
+            }
+            for (core::AsyncReturn& async: asyncs) {
+                async.wait();
+            }
+        }
+    }
+
+    // Rows returned by set_value, thread safe for different rows.
+    void set_rows(T* const* rows, size_t n, const T* weights, const T* states) {
+        size_t dim = this->embedding_dim();
+        size_t state_dim = _optimizer.state_dim(dim);
+        for (size_t i = 0; i < n; ++i) {
+            if (states == nullptr) {
+                _optimizer.train_init({rows[i] + dim, dim});
+            } else {
+                std::copy_n(states, state_dim, rows[i] + dim);
+                states += state_dim;
+            }
+            std::copy_n(weights, dim, rows[i]);
+            weights += dim;
+        }
+    }
+
     class KeyReader: public EmbeddingVariableKeyReader<key_type> {
     public:
         KeyReader(Table& table): _reader(table) {}
@@ -237,7 +372,103 @@ class EmbeddingOptimizerVariable: public EmbeddingOptimizerVariableBasic<Table,
     using T = typename Optimizer::weight_type;
 public:
     EmbeddingOptimizerVariable(size_t embedding_dim, key_type empty_key)
-        : EmbeddingOptimizerVariableBasic<Table, Optimizer>(embedding_dim, empty_key) {}
+        : EmbeddingOptimizerVariableBasic<Table, Optimizer>(embedding_dim, empty_key),
+          _empty_key(empty_key) {}
+
+    virtual void set_weights(const key_type* keys, size_t n, const T* weights, const T* states) override {
+        for (size_t i = 0; i < n; ++i) {
+            save_snapshot_row(keys[i]);
+        }
+        EmbeddingOptimizerVariableBasic<Table, Optimizer>::set_weights(keys, n, weights, states);
+        for (size_t i = 0; i < n; ++i) {
+            this->_table.mark_dirty(keys[i]);
+        }
+    }
+
+    bool take_dirty_keys(core::vector<key_type>& keys) override {
+        return this->_table.take_dirty_keys(keys);
+    }
+
+    // False while another dump holds the snapshot, that dump keeps the shard locked instead.
+    // Tables without stable readers copy all the keys here with the shard locked.
+    bool begin_snapshot() override {
+        if (_snapshot) {
+            return false;
+        }
+        _snapshot = std::make_unique<Snapshot>(this->_table, _empty_key);
+        _snapshot->num_keys = this->_table.num_items();
+        if (!Table::STABLE_READER) {
+            key_type key;
+            _snapshot->keys.reserve(_snapshot->num_keys);
+            while (_snapshot->reader.read_key(key)) {
+                _snapshot->keys.push_back(key);
+            }
+        }
+        return true;
+    }
+
+    uint64_t snapshot_num_keys() override {
+        return _snapshot->num_keys;
+    }
+
+    // Not thread safe with update_weights and set_weights.
+    size_t read_snapshot_keys(key_type* keys, size_t n) override {
+        size_t i = 0;
+        key_type key;
+        while (i < n) {
+            if (Table::STABLE_READER) {
+                if (!_snapshot->reader.read_key(key)) {
+                    break;
+                }
+            } else {
+                if (_snapshot->cursor == _snapshot->keys.size()) {
+                    break;
+                }
+                key = _snapshot->keys[_snapshot->cursor++];
+            }
+            auto it = _snapshot->offsets.find(key);
+            if (it == _snapshot->offsets.end() || it->second != Snapshot::ABSENT) {
+                keys[i++] = key;
+            }
+        }
+        return i;
+    }
+
+    // Not thread safe with update_weights and set_weights.
+    void get_snapshot_weights(const key_type* keys, size_t n, T* weights, T* states) override {
+        size_t dim = this->embedding_dim();
+        size_t state_dim = this->_optimizer.state_dim(dim);
+        for (size_t i = 0; i < n; ++i) {
+            auto it = _snapshot->offsets.find(keys[i]);
+            if (it == _snapshot->offsets.end() || it->second == Snapshot::ABSENT) {
+                EmbeddingOptimizerVariableBasic<Table, Optimizer>::get_weights(keys + i, 1, weights, states);
+            } else {
+                const T* value = _snapshot->rows.data() + it->second;
+                std::copy_n(value, dim, weights);
+                if (states) {
+                    std::copy_n(value + dim, state_dim, states);
+                }
+            }
+            weights += dim;
+            if (states) {
+                states += state_dim;
+            }
+        }
+    }
+
+    void end_snapshot() override {
+        _snapshot.reset();
+    }
+
+    // The new weights are changed by pulls with the shared shard lock.
+    void memory_usage(EmbeddingMemoryUsage& usage) override {
+        core::lock_guard<ProfiledRWSpinLock> lock(_lock);
+        EmbeddingOptimizerVariableInterface<key_type, T>::memory_usage(usage);
+        if (_snapshot) {
+            usage.snapshot += hash_map_memory_usage(_snapshot->offsets)
+                  + _snapshot->keys.capacity() * sizeof(key_type) + _snapshot->rows.capacity() * sizeof(T);
+        }
+    }
 
     virtual void pull_weights(const key_type* keys, size_t n,
           T* weights, VariableAsyncTask&) override {
@@ -253,7 +484,7 @@ public:
         }
 
         if (!new_keys.empty()) {
-            core::lock_guard<core::RWSpinLock> lock(_lock);
+            core::lock_guard<ProfiledRWSpinLock> lock(_lock);
             for (size_t i: new_keys) {
                 T* value = this->_new_weights->update_value(keys[i]);
                 if (value == nullptr) {
@@ -276,13 +507,16 @@ public:
         const T* item_value = nullptr;
         typename EmbeddingHashTable<key_type, T>::Reader item_reader(*this->_new_weights);
         while ((item_value = item_reader.read_item(item_key))) {
+            save_snapshot_row(item_key);
             T* value = this->_table.set_value(item_key);
             std::copy_n(item_value, dim, value);
             this->_optimizer.train_init({value + dim, dim});
+            this->_table.mark_dirty(item_key);
         }
         auto block = this->_gradients->reduce_gradients();
         const T* grad = block.gradients;
         for (size_t i = 0; i < block.n; ++i) {
+            save_snapshot_row(block.keys[i]);
             T* value = this->_table.update_value(block.keys[i]);
             if (value == nullptr) {
                 value = this->_table.set_value(block.keys[i]);
@@ -290,13 +524,45 @@ public:
                 this->_optimizer.train_init({value + dim, dim});
             }
             this->_optimizer.update(value, {value + dim, dim}, block.counts[i], grad);
+            this->_table.mark_dirty(block.keys[i]);
             grad += dim;
         }
         this->_new_weights->clear();
         this->_gradients->clear();
     }
 
-    core::RWSpinLock _lock;
+    ProfiledRWSpinLock _lock{"variable"};
+
+private:
+    struct Snapshot {
+        static constexpr size_t ABSENT = -1; // created after the snapshot
+
+        Snapshot(Table& table, key_type empty_key): reader(table), offsets(empty_key) {}
+        typename Table::Reader reader;
+        core::vector<key_type> keys; // keys of tables without stable readers
+        size_t cursor = 0;
+        uint64_t num_keys = 0;
+        EasyHashMap<key_type, size_t> offsets; // offsets of the old rows changed after the snapshot
+        core::vector<T> rows;
+    };
+
+    // Called before a row is changed, the cost is bounded to the rows changed while dumping.
+    void save_snapshot_row(const key_type& key) {
+        if (!_snapshot || _snapshot->offsets.find(key) != _snapshot->offsets.end()) {
+            return;
+        }
+        const T* value = this->_table.get_value(key);
+        if (value == nullptr) {
+            _snapshot->offsets.force_emplace(key, size_t(Snapshot::ABSENT));
+        } else {
+            size_t value_dim = this->embedding_dim() + this->_optimizer.state_dim(this->embedding_dim());
+            _snapshot->offsets.force_emplace(key, _snapshot->rows.size());
+            _snapshot->rows.insert(_snapshot->rows.end(), value, value + value_dim);
+        }
+    }
+
+    key_type _empty_key;
+    std::unique_ptr<Snapshot> _snapshot;
 };
 
 }
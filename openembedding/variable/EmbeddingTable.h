@@ -10,6 +10,12 @@ namespace paradigm4 {
 namespace pico {
 namespace embedding {
 
+// Memory of the buckets of an EasyHashMap, which grow ahead of the size and stay after clears.
+template<class Key, class Value>
+uint64_t hash_map_memory_usage(EasyHashMap<Key, Value>& map) {
+    return map.bucket_count() * sizeof(std::pair<Key, Value>);
+}
+
 template<class Key, class T>
 class EmbeddingTable {
 public:
@@ -18,12 +24,19 @@ public:
     virtual std::string category() = 0;
     virtual uint64_t num_items() = 0;
     virtual void reserve_items(uint64_t num_items) = 0;
+    // Reserved for setting these keys, so set_value will not move the rows.
+    virtual void reserve_keys(const key_type*, size_t) {}
+    // DRAM of the rows and of the index in bytes.
+    virtual uint64_t rows_memory_usage() = 0;
+    virtual uint64_t index_memory_usage() = 0;
 };
 
 template<class Key, class T>
 class EmbeddingHashTable: public EmbeddingTable<Key, T> {
 public:
     using key_type = Key;
+    static constexpr bool STABLE_READER = false; // readers are invalid after inserts
+    static constexpr bool STABLE_ROWS = true; // rows never move, can be set by threads in parallel
 
     class Reader {
     public:
@@ -53,7 +66,7 @@ public:
     };
 
     EmbeddingHashTable(size_t value_dim, key_type empty_key)
-        : _table(empty_key), _value_dim(value_dim),
+        : _table(empty_key), _dirty(empty_key), _value_dim(value_dim),
           _block_dim(_value_dim * (63 * 1024 / sizeof(T) / _value_dim + 1)) {}
 
     std::string category()override {
@@ -68,6 +81,18 @@ public:
         _table.reserve(num_items);
     }
 
+    void reserve_keys(const key_type*, size_t n) override {
+        _table.reserve(_table.size() + n);
+    }
+
+    uint64_t rows_memory_usage() override {
+        return _pool.size() * _block_dim * sizeof(T);
+    }
+
+    uint64_t index_memory_usage() override {
+        return hash_map_memory_usage(_table) + hash_map_memory_usage(_dirty);
+    }
+
     // thread safe
     const T* get_value(const key_type& key) {
         return update_value(key);
@@ -97,6 +122,24 @@ public:
         return it->second;
     }
 
+    // Keys changed since the last take_dirty_keys, only tracked after the first call.
+    void mark_dirty(const key_type& key) {
+        if (_track_dirty) {
+            _dirty.try_emplace(key, true);
+        }
+    }
+
+    // Returns false if the keys were not tracked before.
+    bool take_dirty_keys(core::vector<key_type>& keys) {
+        for (auto& item: _dirty) {
+            keys.push_back(item.first);
+        }
+        _dirty.clear();
+        bool tracked = _track_dirty;
+        _track_dirty = true;
+        return tracked;
+    }
+
     void clear() {
         _table.clear();
         if (!_pool.empty()) {
@@ -112,6 +155,8 @@ public:
 
 private:
     EasyHashMap<key_type, T*> _table;
+    EasyHashMap<key_type, bool> _dirty;
+    bool _track_dirty = false;
     std::deque<core::vector<T>> _pool;
     size_t _value_dim = 0;
     size_t _block_dim = 0;
@@ -122,6 +167,8 @@ template<class Key, class T>
 class EmbeddingArrayTable: public EmbeddingTable<Key, T> {
 public:
     using key_type = Key;
+    static constexpr bool STABLE_READER = true;
+    static constexpr bool STABLE_ROWS = true; // after reserve_keys
 
     class Reader {
     public:
@@ -161,6 +208,25 @@ public:
         _upper_bound = num_items;
         _table.resize(num_items * _value_dim);
         _valid.resize(num_items);
+        _dirty.resize(num_items);
+    }
+
+    void reserve_keys(const key_type* keys, size_t n) override {
+        key_type upper_bound = _upper_bound;
+        for (size_t i = 0; i < n; ++i) {
+            upper_bound = std::max<key_type>(upper_bound, keys[i] + 1);
+        }
+        if (upper_bound > _upper_bound) {
+            reserve_items(upper_bound);
+        }
+    }
+
+    uint64_t rows_memory_usage() override {
+        return _table.capacity() * sizeof(T);
+    }
+
+    uint64_t index_memory_usage() override {
+        return (_valid.capacity() + _dirty.capacity()) / 8;
     }
 
     // thread safe
@@ -188,12 +254,35 @@ public:
         return nullptr;
     }
 
+    // Dirty bitmap of the keys changed since the last take_dirty_keys,
+    // only tracked after the first call.
+    void mark_dirty(key_type key) {
+        if (_track_dirty && key < _upper_bound) {
+            _dirty[key] = true;
+        }
+    }
+
+    // Returns false if the keys were not tracked before.
+    bool take_dirty_keys(core::vector<key_type>& keys) {
+        for (key_type key = 0; key < _upper_bound; ++key) {
+            if (_dirty[key]) {
+                keys.push_back(key);
+                _dirty[key] = false;
+            }
+        }
+        bool tracked = _track_dirty;
+        _track_dirty = true;
+        return tracked;
+    }
+
 private:
     size_t _value_dim = 0;
     size_t _num_items = 0;
     size_t _upper_bound = 0;
     std::vector<T> _table;
     std::vector<bool> _valid;
+    std::vector<bool> _dirty;
+    bool _track_dirty = false;
 };
 
 
@@ -29,8 +29,10 @@ public:
     void load_config(const core::Configure& config) override {
         std::string table = _entity->embedding_table()->category();
         std::string optimizer = _entity->embedding_optimizer()->category();
+        size_t migrate_threads = 8; // threads copying the rows to the new table or optimizer
         LOAD_CONFIG(config, table);
         LOAD_CONFIG(config, optimizer);
+        LOAD_CONFIG(config, migrate_threads);
         if (table != _entity->embedding_table()->category() ||
             optimizer != _entity->embedding_optimizer()->category()) {
             auto& factory = Factory<Entity, size_t, key_type>::singleton();
@@ -51,7 +53,7 @@ public:
             variable1->set_batch_id(_variable_batch_id);
             variable1->load_config(old_config);
             variable1->load_config(config);
-            variable1->copy_from(std::move(*_entity), server_block_num_items());
+            variable1->copy_from(std::move(*_entity), server_block_num_items(), migrate_threads);
             variable1->set_variable_context(_variable_context);
             _entity = std::move(variable1);
         } else {
@@ -71,6 +73,10 @@ public:
         return _entity->should_persist();
     }
 
+    size_t flush_checkpoint(size_t max_bytes) override {
+        return _entity->flush_checkpoint(max_bytes);
+    }
+
     void clear_weights() override {
         core::Configure config;
         dump_config(config);
@@ -129,10 +135,52 @@ public:
         return _entity->embedding_optimizer()->state_dim(_entity->embedding_dim()) * sizeof(T);
     }
 
+    bool take_dirty_indices(core::vector<key_type>& indices) override {
+        return _entity->take_dirty_keys(indices);
+    }
+
+    // The entity may be replaced while dumping, the snapshot keeps the old one.
+    bool begin_snapshot() override {
+        if (_snapshot_entity || !_entity->begin_snapshot()) {
+            return false;
+        }
+        _snapshot_entity = _entity;
+        return true;
+    }
+
+    uint64_t snapshot_num_indices() override {
+        return _snapshot_entity->snapshot_num_keys();
+    }
+
+    size_t read_snapshot_indices(key_type* indices, size_t n) override {
+        return _snapshot_entity->read_snapshot_keys(indices, n);
+    }
+
+    void get_snapshot_weights(const key_type* indices, size_t n,
+          char* weights, char* states) override {
+        _snapshot_entity->get_snapshot_weights(indices, n,
+              reinterpret_cast<T*>(weights),
+              reinterpret_cast<T*>(states));
+    }
+
+    void end_snapshot() override {
+        _snapshot_entity->end_snapshot();
+        _snapshot_entity.reset();
+    }
+
     size_t num_indices() override {
         return _entity->embedding_table()->num_items();
     }
 
+    void memory_usage(EmbeddingMemoryUsage& usage) override {
+        _entity->memory_usage(usage);
+        if (_snapshot_entity && _snapshot_entity != _entity) {
+            EmbeddingMemoryUsage replaced;
+            _snapshot_entity->memory_usage(replaced);
+            usage.snapshot += replaced.total();
+        }
+    }
+
     int create_reader() override {
         core::lock_guard<core::RWSpinLock> lock(_reader_lock);
         int reader_id = _next_reader_id++;
@@ -162,6 +210,7 @@ private:
     size_t _variable_batch_id = 0;
     EmbeddingVariableContext _variable_context;
     std::shared_ptr<Entity> _entity;
+    std::shared_ptr<Entity> _snapshot_entity;
 
     core::RWSpinLock _reader_lock;
     std::unordered_map<int, std::unique_ptr<EmbeddingVariableKeyReader<key_type>>> _readers;
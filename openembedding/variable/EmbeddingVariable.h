@@ -13,6 +13,44 @@ struct EmbeddingVariableContext {
     int variable_id = 0;
 };
 
+// DRAM used by variables in bytes.
+struct EmbeddingMemoryUsage {
+    uint64_t num_items = 0;
+    uint64_t weights = 0;  // weights part of the table rows
+    uint64_t states = 0;   // optimizer states part of the table rows
+    uint64_t index = 0;    // hash indices and bitmaps of the tables
+    uint64_t pending = 0;  // new weights and gradients waiting for update_weights
+    uint64_t snapshot = 0; // old rows kept for a dump
+
+    uint64_t total()const {
+        return weights + states + index + pending + snapshot;
+    }
+
+    EmbeddingMemoryUsage& operator+=(const EmbeddingMemoryUsage& other) {
+        num_items += other.num_items;
+        weights += other.weights;
+        states += other.states;
+        index += other.index;
+        pending += other.pending;
+        snapshot += other.snapshot;
+        return *this;
+    }
+
+    core::PicoJsonNode to_json_node()const {
+        core::PicoJsonNode json;
+        json.add("num_items", num_items);
+        json.add("weights", weights);
+        json.add("states", states);
+        json.add("index", index);
+        json.add("pending", pending);
+        json.add("snapshot", snapshot);
+        json.add("total", total());
+        return json;
+    }
+
+    PICO_SERIALIZATION(num_items, weights, states, index, pending, snapshot);
+};
+
 class EmbeddingVariableBase {
     using key_type = uint64_t;
 public:
@@ -23,6 +61,8 @@ public:
     virtual void dump_config(core::Configure& config) = 0;
     virtual bool persist_config(size_t persist_pending_window, core::Configure& config) = 0;
     virtual bool should_persist() = 0;
+    // Flushes part of the committing checkpoint, returns the bytes flushed. not thread safe
+    virtual size_t flush_checkpoint(size_t max_bytes) = 0;
     virtual void clear_weights() = 0; // clear initializer，weights. optimizer not change. reset slots.
     virtual size_t server_block_num_items() = 0;
     virtual void get_weights(const key_type* indices, size_t n,
@@ -36,8 +76,21 @@ public:
           const char* gradients, const key_type* counts, VariableAsyncTask& async_task) = 0; // thread safe
     virtual void update_weights() = 0;
     virtual size_t state_line_size() = 0;
+    // Indices changed since the last call, false if they were not tracked before the call.
+    virtual bool take_dirty_indices(core::vector<key_type>& indices) = 0;
+
+    // Rows as of begin_snapshot for dumping while training, false if not supported
+    // or another snapshot is not ended.
+    // The snapshot is read with shared shard locks, and ended with an exclusive lock.
+    virtual bool begin_snapshot() = 0;
+    virtual uint64_t snapshot_num_indices() = 0;
+    virtual size_t read_snapshot_indices(key_type* indices, size_t n) = 0;
+    virtual void get_snapshot_weights(const key_type* indices, size_t n,
+          char* weights, char* states = nullptr) = 0;
+    virtual void end_snapshot() = 0;
 
     virtual size_t num_indices() = 0;
+    virtual void memory_usage(EmbeddingMemoryUsage& usage) = 0;
     virtual int create_reader() = 0; // thread safe
     virtual size_t read_indices(int reader_id, key_type* indices, size_t n) = 0; // thread safe for unique reader_id
     virtual uint64_t get_reader_cursor(int reader_id) = 0; // // thread safe for unique reader_id
@@ -0,0 +1,242 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_LOCK_PROFILER_H
+#define PARADIGM4_HYPEREMBEDDING_LOCK_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <pico-core/SpinLock.h>
+#include <pico-core/RWSpinLock.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Contention of a named lock, shared by all the locks with the same name.
+struct LockStats {
+    std::atomic<uint64_t> acquisitions = {0};
+    std::atomic<uint64_t> shared_acquisitions = {0};
+    std::atomic<uint64_t> contentions = {0}; // acquisitions not got at the first try
+    std::atomic<uint64_t> spins = {0};
+    std::atomic<uint64_t> wait_ns = {0};
+    std::atomic<uint64_t> hold_ns = {0};
+    std::atomic<uint64_t> max_hold_ns = {0};
+
+    void add_wait(uint64_t spin_count, uint64_t ns) {
+        contentions.fetch_add(1, std::memory_order_relaxed);
+        spins.fetch_add(spin_count, std::memory_order_relaxed);
+        wait_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    void add_hold(uint64_t ns) {
+        hold_ns.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t max = max_hold_ns.load(std::memory_order_relaxed);
+        while (ns > max && !max_hold_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+    }
+};
+
+// Disabled by default, then a profiled lock costs one relaxed load more than the lock.
+class LockProfiler {
+public:
+    static LockProfiler& singleton() {
+        static LockProfiler profiler;
+        return profiler;
+    }
+
+    static uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool enabled()const {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    void set_enabled(bool enabled) {
+        _enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    LockStats& stats(const std::string& name) {
+        core::lock_guard<core::RWSpinLock> guard(_lock);
+        std::unique_ptr<LockStats>& stats = _stats[name];
+        if (!stats) {
+            stats = std::make_unique<LockStats>();
+        }
+        return *stats;
+    }
+
+    // One line for each lock, ordered by the waiting time.
+    std::string report() {
+        std::vector<std::pair<uint64_t, std::string>> lines;
+        {
+            core::lock_guard<core::RWSpinLock> guard(_lock);
+            for (auto& pair: _stats) {
+                LockStats& stats = *pair.second;
+                std::ostringstream line;
+                line << pair.first
+                     << " acquisitions: " << stats.acquisitions.load()
+                     << " shared: " << stats.shared_acquisitions.load()
+                     << " contentions: " << stats.contentions.load()
+                     << " spins: " << stats.spins.load()
+                     << " wait_ms: " << stats.wait_ns.load() / 1000000
+                     << " hold_ms: " << stats.hold_ns.load() / 1000000
+                     << " max_hold_us: " << stats.max_hold_ns.load() / 1000;
+                lines.emplace_back(stats.wait_ns.load(), line.str());
+            }
+        }
+        std::sort(lines.begin(), lines.end(), std::greater<std::pair<uint64_t, std::string>>());
+        std::string result;
+        for (auto& line: lines) {
+            result += line.second + "\n";
+        }
+        return result;
+    }
+
+private:
+    std::atomic<bool> _enabled = {false};
+    core::RWSpinLock _lock;
+    std::map<std::string, std::unique_ptr<LockStats>> _stats;
+};
+
+// Spins on try_lock like RWSpinLock itself, counting the spins.
+template<class TryLock>
+void profiled_spin(TryLock try_lock, LockStats& stats) {
+    if (try_lock()) {
+        return;
+    }
+    uint64_t start = LockProfiler::now_ns();
+    uint64_t spins = 0;
+    for (; !try_lock(); ++spins) {
+        if (spins < 1000) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    stats.add_wait(spins, LockProfiler::now_ns() - start);
+}
+
+// Locks owned by pico-ps, e.g. ps::ShardData, may not have try_lock, only the waiting time is known.
+template<class Mutex>
+void profiled_acquire(Mutex& mutex, LockStats& stats, bool shared) {
+    uint64_t start = LockProfiler::now_ns();
+    if (shared) {
+        mutex.lock_shared();
+    } else {
+        mutex.lock();
+    }
+    uint64_t wait = LockProfiler::now_ns() - start;
+    if (wait > 1000) {
+        stats.add_wait(0, wait);
+    }
+}
+
+inline void profiled_acquire(core::RWSpinLock& mutex, LockStats& stats, bool shared) {
+    if (shared) {
+        profiled_spin([&mutex]() { return mutex.try_lock_shared(); }, stats);
+    } else {
+        profiled_spin([&mutex]() { return mutex.try_lock(); }, stats);
+    }
+}
+
+// Returns the time the lock is held from, 0 if the profiler is disabled.
+template<class Mutex>
+uint64_t profiled_lock(Mutex& mutex, LockStats& stats) {
+    if (!LockProfiler::singleton().enabled()) {
+        mutex.lock();
+        return 0;
+    }
+    profiled_acquire(mutex, stats, false);
+    stats.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return LockProfiler::now_ns();
+}
+
+template<class Mutex>
+uint64_t profiled_lock_shared(Mutex& mutex, LockStats& stats) {
+    if (!LockProfiler::singleton().enabled()) {
+        mutex.lock_shared();
+        return 0;
+    }
+    profiled_acquire(mutex, stats, true);
+    stats.shared_acquisitions.fetch_add(1, std::memory_order_relaxed);
+    return LockProfiler::now_ns();
+}
+
+template<class Mutex>
+void profiled_unlock(Mutex& mutex, LockStats& stats, uint64_t start) {
+    mutex.unlock();
+    if (start) {
+        stats.add_hold(LockProfiler::now_ns() - start);
+    }
+}
+
+template<class Mutex>
+void profiled_unlock_shared(Mutex& mutex, LockStats& stats, uint64_t start) {
+    mutex.unlock_shared();
+    if (start) {
+        stats.add_hold(LockProfiler::now_ns() - start);
+    }
+}
+
+// Drop-in core::RWSpinLock recording contention by name, works with core::lock_guard.
+// Hold time is recorded for exclusive locks only.
+class ProfiledRWSpinLock {
+public:
+    explicit ProfiledRWSpinLock(const std::string& name)
+        : _stats(&LockProfiler::singleton().stats(name)) {}
+
+    ProfiledRWSpinLock(const ProfiledRWSpinLock&) = delete;
+    ProfiledRWSpinLock& operator=(const ProfiledRWSpinLock&) = delete;
+
+    void lock() {
+        _hold_start = profiled_lock(_lock, *_stats);
+    }
+
+    void unlock() {
+        profiled_unlock(_lock, *_stats, _hold_start);
+    }
+
+    void lock_shared() {
+        profiled_lock_shared(_lock, *_stats);
+    }
+
+    void unlock_shared() {
+        _lock.unlock_shared();
+    }
+
+private:
+    core::RWSpinLock _lock;
+    LockStats* _stats;
+    uint64_t _hold_start = 0; // written by the exclusive owner only
+};
+
+// Profiles a shared lock of a lock owned by others, records the hold time.
+template<class Mutex>
+class ProfiledSharedLockGuard {
+public:
+    ProfiledSharedLockGuard(Mutex& mutex, LockStats& stats)
+        : _mutex(mutex), _stats(stats), _start(profiled_lock_shared(mutex, stats)) {}
+
+    ProfiledSharedLockGuard(const ProfiledSharedLockGuard&) = delete;
+    ProfiledSharedLockGuard& operator=(const ProfiledSharedLockGuard&) = delete;
+
+    ~ProfiledSharedLockGuard() {
+        profiled_unlock_shared(_mutex, _stats, _start);
+    }
+
+private:
+    Mutex& _mutex;
+    LockStats& _stats;
+    uint64_t _start;
+};
+
+}
+}
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include <pico-core/PicoJsonNode.h>
 #include <pico-ps/model/Model.h>
 #include "DataType.h"
+#include "ShardPartition.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -30,19 +31,26 @@ struct EmbeddingVariableMeta {
     DataType datatype;
     uint64_t embedding_dim = 0;
     uint64_t vocabulary_size = 0;
+    ShardPartition partition;
 
     size_t line_size()const {
         return datatype.size() * embedding_dim;
     }
 
+    ShardPartitioner partitioner(int32_t shard_num)const {
+        return ShardPartitioner(partition, shard_num, vocabulary_size);
+    }
+
     friend bool operator==(const EmbeddingVariableMeta& a, const EmbeddingVariableMeta& b) {
         return a.datatype == b.datatype &&
               a.embedding_dim == b.embedding_dim &&
-              a.vocabulary_size == b.vocabulary_size;
+              a.vocabulary_size == b.vocabulary_size &&
+              a.partition == b.partition;
     }
 
+    // Hashed partitions keep the keys as shard indices.
     bool use_hash_table()const {
-        return vocabulary_size >= (1ull << 63);
+        return vocabulary_size >= (1ull << 63) || !partition.dense();
     }
 
     bool from_json_node(const core::PicoJsonNode& json) {
@@ -60,6 +68,13 @@ struct EmbeddingVariableMeta {
         if (!json.at("vocabulary_size").try_as(vocabulary_size)) {
             return false;
         }
+        // model version 0.2 has no partition
+        std::string partition_str = "modulo";
+        json.at("partition").try_as(partition_str);
+        partition = ShardPartition(partition_str);
+        if (partition.policy == ShardPartition::UNKNOWN) {
+            return false;
+        }
         return true;
     }
 
@@ -68,10 +83,11 @@ struct EmbeddingVariableMeta {
         json.add("datatype", datatype.to_string());
         json.add("embedding_dim", embedding_dim);
         json.add("vocabulary_size", vocabulary_size);
+        json.add("partition", partition.to_string());
         return json;
     }
 
-    PICO_SERIALIZATION(datatype, embedding_dim, vocabulary_size);
+    PICO_SERIALIZATION(datatype, embedding_dim, vocabulary_size, partition);
 };
 
 struct ModelVariableMeta {
@@ -105,9 +121,15 @@ struct ModelVariableMeta {
 struct ModelOfflineMeta {
     std::string model_sign;
     std::vector<ModelVariableMeta> variables;
+    std::string checkpoint; // "base" or "delta" for checkpoints, empty for full dumps
 
     static std::string version() {
-        return "0.2";
+        return "0.3";
+    }
+
+    // 0.2 is read with the modulo partition.
+    static bool readable(const std::string& format_version) {
+        return format_version == version() || format_version == "0.2";
     }
 
     bool from_json_node(const core::PicoJsonNode& json) {
@@ -122,9 +144,11 @@ struct ModelOfflineMeta {
             }
             variables.push_back(variable);
         }
+        checkpoint.clear();
+        json.at("checkpoint").try_as(checkpoint);
         std::string format_version = "unknown";
         json.at("version").try_as(format_version);
-        SCHECK(format_version == ModelOfflineMeta::version())
+        SCHECK(ModelOfflineMeta::readable(format_version))
               << "OpenEmbedding model format version is " << format_version
               << ", current versoin is " << ModelOfflineMeta::version() << ".";
         return true;
@@ -138,6 +162,9 @@ struct ModelOfflineMeta {
             vars.push_back(variable.to_json_node());
         }
         json.add("variables", vars);
+        if (!checkpoint.empty()) {
+            json.add("checkpoint", checkpoint);
+        }
         json.add("version", ModelOfflineMeta::version());
         return json;
     }
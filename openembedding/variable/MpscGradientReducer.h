@@ -3,6 +3,7 @@
 
 #include <pico-ps/common/EasyHashMap.h>
 #include "EmbeddingInitializer.h"
+#include "EmbeddingTable.h"
 
 namespace paradigm4 {
 namespace pico {
@@ -52,6 +53,12 @@ public:
         return {_keys.data(), _keys.size(), _gradients.data(), _counts.data()};
     }
 
+    // Gradients reduced since the last clear, in bytes.
+    uint64_t memory_usage() {
+        return hash_map_memory_usage(_offsets) + _keys.capacity() * sizeof(key_type)
+              + _gradients.capacity() * sizeof(T) + _counts.capacity() * sizeof(uint64_t);
+    }
+
     void clear() {
         _offsets.clear();
         _keys.clear();
@@ -1,8 +1,13 @@
 #ifndef PARADIGM4_HYPEREMBEDDING_PERSIST_MANAGER_H
 #define PARADIGM4_HYPEREMBEDDING_PERSIST_MANAGER_H
 
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
 #include <pico-core/pico_log.h>
 #include <pico-core/SpinLock.h>
+#include <pico-core/RWSpinLock.h>
 #include <pico-core/FileSystem.h>
 
 namespace paradigm4 {
@@ -44,11 +49,128 @@ public:
         void release_cache(size_t size) {
             _acquired_size.fetch_sub(size);
         }
+
+        size_t cache_size() {
+            return _cache_size.load(std::memory_order_relaxed);
+        }
     private:
         std::atomic<size_t> _cache_size = {0};
         std::atomic<size_t> _acquired_size = {0};
     };
 
+    // Dynamic cache of a cache item pool, the pool grows up to target and shrinks to it.
+    struct CacheBudget {
+        std::atomic<size_t> target = {std::numeric_limits<size_t>::max()};
+        std::atomic<size_t> used = {0};
+        std::atomic<size_t> ghost_hits = {0}; // misses of the keys recently evicted
+        std::atomic<size_t> ghost_bytes = {0}; // cache the ghost keys stand for
+    };
+
+    // Moves the dynamic cache between the pools by the marginal benefit, i.e. the ghost hits
+    // per byte. Pools grow greedily until the cache is full, then the targets are fitted to
+    // the cache every round: pools added later get a fair share, the cache of removed pools
+    // is handed back to the others, and one step is moved from the pool benefiting least to
+    // the pool benefiting most.
+    class CacheBudgetController {
+    public:
+        std::shared_ptr<CacheBudget> add_budget() {
+            core::lock_guard<core::RWSpinLock> guard(_lock);
+            _budgets.push_back(std::make_shared<CacheBudget>());
+            return _budgets.back();
+        }
+
+        void remove_budget(const std::shared_ptr<CacheBudget>& budget) {
+            core::lock_guard<core::RWSpinLock> guard(_lock);
+            _budgets.erase(std::remove(_budgets.begin(), _budgets.end(), budget), _budgets.end());
+            if (_budgets.empty()) {
+                _full = false;
+            }
+        }
+
+        void redistribute(size_t cache_size) {
+            core::lock_guard<core::RWSpinLock> guard(_lock);
+            if (_budgets.empty()) {
+                return;
+            }
+            size_t step = cache_size / 20;
+            size_t used = 0;
+            for (auto& budget: _budgets) {
+                used += budget->used.load();
+            }
+            if (!_full && used + step < cache_size) {
+                for (auto& budget: _budgets) {
+                    budget->ghost_hits.store(0);
+                }
+                return;
+            }
+            fit_targets(cache_size, step);
+            _full = true;
+
+            CacheBudget* donor = nullptr;
+            CacheBudget* receiver = nullptr;
+            double donor_benefit = 0.0, receiver_benefit = 0.0;
+            for (auto& budget: _budgets) {
+                double benefit = static_cast<double>(budget->ghost_hits.exchange(0)) /
+                      std::max<size_t>(1, budget->ghost_bytes.load());
+                if (budget->target.load() > step && (!donor || benefit < donor_benefit)) {
+                    donor = budget.get();
+                    donor_benefit = benefit;
+                }
+                if (benefit > 0 && (!receiver || benefit > receiver_benefit)) {
+                    receiver = budget.get();
+                    receiver_benefit = benefit;
+                }
+            }
+            // some hysteresis, moving cache costs pmem flushes
+            if (donor && receiver && donor != receiver && receiver_benefit > 2 * donor_benefit) {
+                donor->target.fetch_sub(step);
+                receiver->target.fetch_add(step);
+            }
+        }
+
+    private:
+        // Pools growing greedily when the cache gets full keep what they use, at least a step,
+        // pools added after that get cache_size / n. The others are scaled down to fit the
+        // cache, or share the spare cache equally.
+        void fit_targets(size_t cache_size, size_t step) {
+            size_t n = _budgets.size();
+            size_t fair = cache_size / n;
+            size_t fixed = 0, rest = 0;
+            std::vector<bool> added(n, false);
+            for (size_t i = 0; i < n; ++i) {
+                CacheBudget& budget = *_budgets[i];
+                if (budget.target.load() == std::numeric_limits<size_t>::max()) {
+                    if (_full) {
+                        budget.target.store(fair);
+                        added[i] = true;
+                        fixed += fair;
+                        continue;
+                    }
+                    budget.target.store(std::max(budget.used.load(), step));
+                }
+                rest += budget.target.load();
+            }
+            size_t room = cache_size - fixed;
+            if (rest > room) {
+                double scale = static_cast<double>(room) / rest;
+                for (size_t i = 0; i < n; ++i) {
+                    if (!added[i]) {
+                        CacheBudget& budget = *_budgets[i];
+                        budget.target.store(static_cast<size_t>(budget.target.load() * scale));
+                    }
+                }
+            } else {
+                for (auto& budget: _budgets) {
+                    budget->target.fetch_add((room - rest) / n);
+                }
+            }
+        }
+
+        core::RWSpinLock _lock;
+        std::vector<std::shared_ptr<CacheBudget>> _budgets;
+        bool _full = false;
+    };
+
     static PersistManager& singleton() {
         static PersistManager manager;
         return manager;
@@ -76,6 +198,8 @@ public:
 
     CacheManager reserved_cache;
     CacheManager dynamic_cache;
+    CacheBudgetController cache_budgets;
+    std::string cache_policy = "lru"; // default replacement policy of the dram caches
 private:
     std::string _prefix;
     std::string _pmem_pool_root_path;
@@ -36,19 +36,32 @@ public:
     // 16 for PmemItemPool free space overhead
     CacheItemPool(size_t value_dim)
         : _base_pool(value_dim),
-          _item_memory_cost(_base_pool.item_size(_base_pool.value_dim()) + 16) {}
+          _item_memory_cost(_base_pool.item_size(_base_pool.value_dim()) + 16),
+          _budget(PersistManager::singleton().cache_budgets.add_budget()) {}
 
     ~CacheItemPool() {
         PersistManager::singleton().dynamic_cache.release_cache(
               (_acquired + _prefetched) * _item_memory_cost);
         PersistManager::singleton().reserved_cache.release_cache(
               (_reserved) * _item_memory_cost);
+        PersistManager::singleton().cache_budgets.remove_budget(_budget);
     }
 
     size_t item_memory_cost() {
         return _item_memory_cost;
     }
 
+    PersistManager::CacheBudget& budget() {
+        return *_budget;
+    }
+
+    // Items to delete to shrink to the target of the budget.
+    size_t num_over_budget() {
+        size_t used = (_acquired - std::min(_released, _acquired)) * _item_memory_cost;
+        size_t target = _budget->target.load(std::memory_order_relaxed);
+        return used > target ? (used - target + _item_memory_cost - 1) / _item_memory_cost : 0;
+    }
+
     CacheItem* try_new_item() {
         if (_expanding) {
             if (_reserved_acquired < _reserved) {
@@ -89,11 +102,17 @@ public:
     }
 
     void rebalance() {
+        release();
+        _expanding = true;
+    }
+
+    // Returns the cache of the deleted items.
+    void release() {
         _released = std::min(_released, _acquired);
         PersistManager::singleton().dynamic_cache.release_cache(_released * _item_memory_cost);
         _acquired -= _released;
-        _expanding = true;
         _released = 0;
+        _budget->used.store((_acquired + _prefetched) * _item_memory_cost, std::memory_order_relaxed);
     }
 
     bool expanding() {
@@ -111,8 +130,13 @@ public:
 
 private:
     bool prefetch(size_t n) {
+        size_t used = (_acquired + _prefetched + n) * _item_memory_cost;
+        if (used > _budget->target.load(std::memory_order_relaxed)) {
+            return false;
+        }
         if (PersistManager::singleton().dynamic_cache.acquire_cache(n * _item_memory_cost)) {
             _prefetched += n;
+            _budget->used.store(used, std::memory_order_relaxed);
             return true;
         }
         return false;
@@ -127,6 +151,7 @@ private:
     size_t _reserved = 0;
     size_t _reserved_acquired = 0;
     bool _expanding = true;
+    std::shared_ptr<PersistManager::CacheBudget> _budget;
 };
 
 template<class Head, class T>
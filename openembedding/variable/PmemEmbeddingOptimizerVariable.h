@@ -33,6 +33,9 @@ public:
 
     void load_config(const core::Configure& config) override {
         EmbeddingOptimizerVariableBasic<Table, Optimizer>::load_config(config);
+        std::string cache_policy = this->_table.cache_policy();
+        LOAD_CONFIG(config, cache_policy);
+        SCHECK(this->_table.set_cache_policy(cache_policy)) << "unknown cache policy " << cache_policy;
         std::string pmem_pool_path;
         LOAD_CONFIG(config, pmem_pool_path);
         if (!pmem_pool_path.empty()) {
@@ -44,14 +47,18 @@ public:
         }
     }
 
+    // The new weights are changed by pulls with the shared shard lock.
+    void memory_usage(EmbeddingMemoryUsage& usage) override {
+        core::lock_guard<ProfiledRWSpinLock> lock(_lock);
+        EmbeddingOptimizerVariableBasic<Table, Optimizer>::memory_usage(usage);
+        usage.pending += hash_map_memory_usage(_cache);
+    }
+
     bool persist_config(size_t persist_pending_window, core::Configure& config) override {
         auto& _table = this->_table;
         int64_t checkpoint = _table.start_commit_checkpoint();
-        std::string hit_rate = "0.0";
-        if (_table.set_count()) {
-            size_t rate1000 = 1000 * _table.hit_count() / _table.set_count();
-            hit_rate = std::to_string(rate1000 / 10) + "." + std::to_string(rate1000 % 10);
-        }
+        std::string hit_rate = rate_string(_table.hit_count(), _table.set_count());
+        std::string hot_hit_rate = rate_string(_table.hot_hit_count(), _table.set_count());
         while (_table.checkpoints().size() > persist_pending_window) {
             _table.pop_checkpoint();
         }
@@ -64,7 +71,9 @@ public:
 
         SLOG(INFO) << "batch id " << _variable_batch_id
                 << ", variable id " << _variable_context.variable_id
+                << ", cache policy " << _table.cache_policy()
                 << ", hit rate " << hit_rate << "%"
+                << ", protected hit rate " << hot_hit_rate << "%"
                 << ", flushed " << _table.flush_count()
                 << ", all " << _table.set_count()
                 << ", checkpoints " << show(_table.checkpoints())
@@ -72,11 +81,14 @@ public:
                 << ", table items " << _table.num_items()
                 << ", pmem items " << _table.num_pmem_items()
                 << ", freespace items " << _table.num_freespace_items()
-                << ", cache items " << _table.num_cache_items();
+                << ", cache items " << _table.num_cache_items()
+                << ", protected cache items " << _table.num_hot_cache_items();
 
         this->dump_config(config);
         std::string pmem_pool_path = _table.pmem_pool_path();
+        std::string cache_policy = _table.cache_policy();
         SAVE_CONFIG(config, pmem_pool_path);
+        SAVE_CONFIG(config, cache_policy);
         SAVE_CONFIG(config, checkpoint);
         return true;
     }
@@ -85,6 +97,12 @@ public:
         return this->_table.should_commit_checkpoint();
     }
 
+    size_t flush_checkpoint(size_t max_bytes) override {
+        size_t item_bytes = this->_table.cache_item_memory_cost();
+        size_t max_items = std::max<size_t>(1, max_bytes / item_bytes);
+        return this->_table.flush_committing_items(max_items) * item_bytes;
+    }
+
     void set_weights(const key_type* keys, size_t n, const T* weights, const T* states)override {
         EmbeddingOptimizerVariableBasic<Table, Optimizer>::set_weights(keys, n, weights, states);
         this->_table.next_work();
@@ -108,7 +126,7 @@ public:
         }
 
         if (!new_keys.empty()) {
-            core::lock_guard<core::RWSpinLock> lock(_lock);
+            core::lock_guard<ProfiledRWSpinLock> lock(_lock);
             for (size_t i: new_keys) {
                 T* value = this->_new_weights->update_value(keys[i]);
                 if (value == nullptr) {
@@ -163,6 +181,15 @@ public:
     }
 
 private:
+    // percentage with one decimal
+    std::string rate_string(size_t count, size_t total) {
+        if (total == 0) {
+            return "0.0";
+        }
+        size_t rate1000 = 1000 * count / total;
+        return std::to_string(rate1000 / 10) + "." + std::to_string(rate1000 % 10);
+    }
+
     std::string show(const std::deque<int64_t>& vals) {
         std::string show_vals = "[";
         for (int64_t val: vals) {
@@ -193,7 +220,7 @@ private:
 
     size_t _variable_batch_id = 0;
     EmbeddingVariableContext _variable_context;
-    core::RWSpinLock _lock;
+    ProfiledRWSpinLock _lock{"pmem_variable"};
     EasyHashMap<key_type, T*> _cache;
 };
 
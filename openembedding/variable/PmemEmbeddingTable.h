@@ -1,6 +1,7 @@
 #ifndef PARADIGM4_HYPEREMBEDDING_PMEM_EMBEDDING_TABLE_H
 #define PARADIGM4_HYPEREMBEDDING_PMEM_EMBEDDING_TABLE_H
 
+#include <limits>
 #include <pico-ps/common/EasyHashMap.h>
 #include "PmemEmbeddingItemPool.h"
 #include "EmbeddingTable.h"
@@ -32,6 +33,10 @@ public:
             return _table[key];
         }
 
+        uint64_t memory_usage() {
+            return _table.capacity() * sizeof(Pointer);
+        }
+
         class Reader {
         public:
             Reader(EmbeddingIndex& table): _table(&table) {}
@@ -82,6 +87,10 @@ public:
             return _table.try_emplace(key, Pointer()).first->second;
         }
 
+        uint64_t memory_usage() {
+            return hash_map_memory_usage(_table);
+        }
+
         class Reader {
         public:
             Reader(EmbeddingIndex& table)
@@ -108,6 +117,9 @@ template<class Key, class T, class EmbeddingIndexTag>
 class PmemEmbeddingTable: public EmbeddingTable<Key, T> {
 public:
     using key_type = Key;
+    static constexpr bool STABLE_ROWS = false; // cache items may be flushed by other sets
+    static constexpr size_t GHOST_BITS = 14;
+    static constexpr size_t MAX_SHRINK_ITEMS = 1024; // evicted by one next_work
     static_assert(std::is_trivially_copyable<Key>::value, "pmem table need trivally copyable key type.");
 
     struct PmemItemHead {
@@ -122,6 +134,7 @@ public:
         key_type key = key_type();
         CacheItem* next = nullptr;
         CacheItem* prev = nullptr;
+        bool hot = false; // in the protected segment of 2q
 
         void erase() {
             next->prev = prev;
@@ -184,6 +197,9 @@ public:
           _table(empty_key), _cache_pool(value_dim), _pmem_pool(value_dim) {
         _cache_head = _cache_pool.new_item();
         _cache_head->prev = _cache_head->next = _cache_head;
+        _hot_head = _cache_pool.new_item();
+        _hot_head->prev = _hot_head->next = _hot_head;
+        _cache_pool.budget().ghost_bytes.store((size_t(1) << GHOST_BITS) * _cache_pool.item_memory_cost());
     }
 
     ~PmemEmbeddingTable() {}
@@ -191,8 +207,10 @@ public:
     bool load_pmem_pool(const std::string& pmem_pool_path, int64_t checkpoint) {
         size_t value_dim = _value_dim;
         key_type empty_key = _empty_key;
+        std::string cache_policy = _cache_policy;
         this->~PmemEmbeddingTable();
         new (this) PmemEmbeddingTable(value_dim, empty_key);
+        set_cache_policy(cache_policy);
         if (_pmem_pool.load_pmem_pool(pmem_pool_path, checkpoint, _table, _num_items)) {
             _work_id = _committing = checkpoint;
             return true;
@@ -212,6 +230,15 @@ public:
         _table.reserve_items(n);
     }
 
+    // Only the cache items of the rows are in DRAM.
+    uint64_t rows_memory_usage() override {
+        return _cache_pool.num_items() * _cache_pool.item_memory_cost();
+    }
+
+    uint64_t index_memory_usage() override {
+        return _table.memory_usage();
+    }
+
     void prefetch_reserve_cache(uint64_t n) {
         _cache_pool.prefetch_reserve(n);
     }
@@ -220,6 +247,41 @@ public:
         return _pmem_pool.pmem_pool_path();
     }
 
+    static bool is_cache_policy(const std::string& policy) {
+        return policy == "lru" || policy == "2q";
+    }
+
+    // Replacement of the DRAM cache items, "lru" or "2q".
+    // Cache items of a segment are always ordered by work id, which the checkpoints rely on.
+    // 2q puts new items in the probation segment and items set again in the protected segment,
+    // so one pass over cold keys only replaces the probation segment.
+    bool set_cache_policy(const std::string& policy) {
+        if (!is_cache_policy(policy)) {
+            return false;
+        }
+        if (policy == "lru") {
+            // merge the protected segment into the probation segment by work id
+            CacheItem* pos = _cache_head->next;
+            while (_hot_head->next != _hot_head) {
+                CacheItem* item = _hot_head->next;
+                while (pos != _cache_head && pos->work_id <= item->work_id) {
+                    pos = pos->next;
+                }
+                item->erase();
+                item->hot = false;
+                pos->insert_prev(item);
+            }
+            _num_hot_items = 0;
+        }
+        _cache_policy = policy;
+        _two_queue = policy == "2q";
+        return true;
+    }
+
+    const std::string& cache_policy() {
+        return _cache_policy;
+    }
+
     // thread safe
     const T* get_value(const key_type& key) {
         ItemPointer it = _table.get_pointer(key);
@@ -248,9 +310,23 @@ public:
                     _pmem_pool.push_item(flush_to_pmem_item(item));
                 }
                 item->erase();
-                _cache_head->insert_prev(item);
+                if (_two_queue) {
+                    if (item->hot) {
+                        ++_hot_hit_count;
+                    } else {
+                        item->hot = true;
+                        ++_num_hot_items;
+                    }
+                    _hot_head->insert_prev(item);
+                } else {
+                    _cache_head->insert_prev(item);
+                }
             } else {
                 PmemItem* pmem_item = it.as_pmem_item();
+                if (!_ghosts.empty() && _ghosts[ghost_slot(key)] == key) {
+                    _cache_pool.budget().ghost_hits.fetch_add(1, std::memory_order_relaxed);
+                    _ghosts[ghost_slot(key)] = _empty_key;
+                }
                 item = cache_miss_new_item();
                 std::copy_n(pmem_item->data, _value_dim, item->data);
                 if (pmem_item->work_id < _committing) {
@@ -284,7 +360,9 @@ public:
 
     void next_work() {
         ++_work_id;
-        if (!_pendings.empty() && _cache_head->next->work_id >= _pendings.front()) {
+        shrink_cache();
+        if (!_pendings.empty() && committed(_cache_head, _pendings.front()) &&
+              committed(_hot_head, _pendings.front())) {
             _pmem_pool.push_checkpoint(_pendings.front());
             _pendings.pop_front();
         }
@@ -313,18 +391,16 @@ public:
 
     void flush_committing_checkpoint() {
         SCHECK(!_pendings.empty());
-        CacheItem* item = _cache_head->next;
-        while (item != _cache_head && item->work_id < _pendings.front()) {
-            item->erase();
-            _table.set_pointer(item->key) = flush_to_pmem_item(item);
-            _cache_pool.delete_item(item);
-            item = _cache_head->next;
-        }
-        if (!_pendings.empty()) {
-            _pmem_pool.push_checkpoint(_pendings.front()); 
-            _pendings.pop_front();
-        }
-        _cache_pool.rebalance();
+        size_t flushed = 0;
+        flush_oldest_checkpoint(std::numeric_limits<size_t>::max(), flushed);
+    }
+
+    // Flushes at most max_items cache items of the committing checkpoints from the oldest,
+    // and commits the checkpoints with no item left. Returns the number of items flushed.
+    size_t flush_committing_items(size_t max_items) {
+        size_t flushed = 0;
+        while (!_pendings.empty() && flush_oldest_checkpoint(max_items, flushed));
+        return flushed;
     }
 
     const std::deque<int64_t>& checkpoints() {
@@ -339,6 +415,10 @@ public:
         return _cache_pool.item_memory_cost();
     }
 
+    PersistManager::CacheBudget& cache_budget() {
+        return _cache_pool.budget();
+    }
+
     size_t hit_count() {
         return _hit_count;
     }
@@ -347,6 +427,15 @@ public:
         return _set_count;
     }
 
+    // Hits of the items in the protected segment of 2q.
+    size_t hot_hit_count() {
+        return _hot_hit_count;
+    }
+
+    size_t num_hot_cache_items() {
+        return _num_hot_items;
+    }
+
     size_t flush_count() {
         return _flush_count;
     }
@@ -379,13 +468,91 @@ private:
         return pmem_item;
     }
 
+    // The oldest item of a segment if it can be replaced.
+    CacheItem* oldest_item(CacheItem* head) {
+        CacheItem* item = head->next;
+        return item != head && item->work_id < _work_id ? item : nullptr;
+    }
+
+    bool committed(CacheItem* head, int64_t checkpoint) {
+        return head->next == head || head->next->work_id >= checkpoint;
+    }
+
+    // Returns true if the oldest committing checkpoint is committed.
+    bool flush_oldest_checkpoint(size_t max_items, size_t& flushed) {
+        for (CacheItem* head: {_cache_head, _hot_head}) {
+            CacheItem* item = head->next;
+            while (flushed < max_items && item != head && item->work_id < _pendings.front()) {
+                item->erase();
+                _num_hot_items -= item->hot;
+                _table.set_pointer(item->key) = flush_to_pmem_item(item);
+                _cache_pool.delete_item(item);
+                item = head->next;
+                ++flushed;
+            }
+        }
+        if (!committed(_cache_head, _pendings.front()) || !committed(_hot_head, _pendings.front())) {
+            return false;
+        }
+        _pmem_pool.push_checkpoint(_pendings.front()); 
+        _pendings.pop_front();
+        _cache_pool.rebalance();
+        return true;
+    }
+
+    // 2q keeps at least a quarter of the cache items in the probation segment.
+    CacheItem* replaced_item() {
+        CacheItem* item = oldest_item(_cache_head);
+        if (_num_hot_items) {
+            CacheItem* hot = oldest_item(_hot_head);
+            size_t num_items = _cache_pool.num_items();
+            if (hot && (!item || (num_items - _num_hot_items) * 4 < num_items)) {
+                item = hot;
+            }
+        }
+        return item;
+    }
+
+    // Keys recently evicted, direct mapped. A miss of a ghost key is a hit if the cache
+    // were larger by the number of ghost slots, which tells the budget controller the benefit.
+    size_t ghost_slot(const key_type& key) {
+        return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull) >> (64 - GHOST_BITS);
+    }
+
+    void evict(CacheItem* item) {
+        item->erase();
+        _num_hot_items -= item->hot;
+        item->hot = false;
+        _table.set_pointer(item->key) = flush_to_pmem_item(item);
+        if (_ghosts.empty()) {
+            _ghosts.resize(size_t(1) << GHOST_BITS, _empty_key);
+        }
+        _ghosts[ghost_slot(item->key)] = item->key;
+    }
+
+    // Evicts the coldest items while the pool is over its budget, a part each work.
+    void shrink_cache() {
+        size_t n = std::min(_cache_pool.num_over_budget(), size_t(MAX_SHRINK_ITEMS));
+        if (n == 0) {
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            CacheItem* item = replaced_item();
+            if (item == nullptr) {
+                break;
+            }
+            evict(item);
+            _cache_pool.delete_item(item);
+        }
+        _cache_pool.release();
+    }
+
     CacheItem* cache_miss_new_item() {
         CacheItem* item = _cache_pool.try_new_item();
         if (item == nullptr) {
-            item = _cache_head->next;
-            if (item != _cache_head && item->work_id < _work_id) {
-                item->erase();
-                _table.set_pointer(item->key) = flush_to_pmem_item(item);
+            item = replaced_item();
+            if (item) {
+                evict(item);
             } else {
                 item = _cache_pool.new_item();
             }
@@ -406,13 +573,19 @@ private:
     key_type _empty_key = key_type();
     uint64_t _num_items = 0;
     EmbeddingIndex _table;
-    CacheItem* _cache_head = nullptr;
+    CacheItem* _cache_head = nullptr; // the only segment of lru, the probation segment of 2q
+    CacheItem* _hot_head = nullptr;
+    size_t _num_hot_items = 0;
+    std::vector<key_type> _ghosts;
+    std::string _cache_policy = "lru";
+    bool _two_queue = false;
 
     CacheItemPool<CacheItemHead, T> _cache_pool;
     PmemItemPool<PmemItemHead, T> _pmem_pool;
 
     size_t _hit_count = 0;
     size_t _set_count = 0;
+    size_t _hot_hit_count = 0;
     size_t _flush_count = 0;
 };
 
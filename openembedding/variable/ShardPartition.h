@@ -0,0 +1,141 @@
+#ifndef PARADIGM4_HYPEREMBEDDING_SHARD_PARTITION_H
+#define PARADIGM4_HYPEREMBEDDING_SHARD_PARTITION_H
+
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <pico-core/Archive.h>
+#include <pico-core/pico_log.h>
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// How the keys of a variable are divided into the shards of its storage.
+class ShardPartition {
+public:
+    enum Policy {
+        UNKNOWN = -1,
+        MODULO = 0, // key % shard_num
+        HASH = 1,   // multiplicative hash of the key
+        JUMP = 2,   // jump consistent hash of the key
+        RANGE = 3,  // contiguous key ranges of vocabulary_size / shard_num
+    };
+
+    explicit ShardPartition(int policy = MODULO): policy(policy) {}
+
+    ShardPartition(const std::string& str) {
+        if (str == "modulo") {
+            policy = MODULO;
+        } else if (str == "hash") {
+            policy = HASH;
+        } else if (str == "jump") {
+            policy = JUMP;
+        } else if (str == "range") {
+            policy = RANGE;
+        } else {
+            policy = UNKNOWN;
+        }
+    }
+
+    std::string to_string()const {
+        switch (policy) {
+            case MODULO: return "modulo";
+            case HASH: return "hash";
+            case JUMP: return "jump";
+            case RANGE: return "range";
+            default: return "unknown";
+        }
+    }
+
+    // Shard indices are less than vocabulary_size / shard_num + 1, so array tables can be used.
+    // Otherwise shard indices are the keys.
+    bool dense()const {
+        return policy == MODULO || policy == RANGE;
+    }
+
+    friend bool operator==(ShardPartition a, ShardPartition b) {
+        return a.policy == b.policy;
+    }
+
+    friend bool operator!=(ShardPartition a, ShardPartition b) {
+        return a.policy != b.policy;
+    }
+
+    int policy = MODULO;
+
+    PICO_SERIALIZATION(policy);
+};
+
+// ShardPartition of a storage, maps a key to its shard and the index in the shard.
+class ShardPartitioner {
+public:
+    ShardPartitioner(ShardPartition partition, int32_t shard_num, uint64_t vocabulary_size)
+        : _policy(partition.policy), _shard_num(shard_num) {
+        SCHECK(shard_num > 0);
+        if (_policy == ShardPartition::RANGE) {
+            _range = std::max<uint64_t>(1, vocabulary_size / _shard_num + (vocabulary_size % _shard_num != 0));
+        }
+    }
+
+    int32_t shard(uint64_t key)const {
+        switch (_policy) {
+            case ShardPartition::MODULO:
+                return key % _shard_num;
+            case ShardPartition::HASH:
+                return ((key * 0x9E3779B97F4A7C15ull) >> 32) * _shard_num >> 32;
+            case ShardPartition::JUMP:
+                return jump_hash(key, _shard_num);
+            case ShardPartition::RANGE:
+                return std::min<uint64_t>(key / _range, _shard_num - 1);
+            default:
+                SLOG(FATAL) << "unknown shard partition " << _policy;
+                return -1;
+        }
+    }
+
+    // index of the key in its shard.
+    uint64_t index(uint64_t key, int32_t shard_id)const {
+        switch (_policy) {
+            case ShardPartition::MODULO:
+                return key / _shard_num;
+            case ShardPartition::RANGE:
+                return key - shard_id * _range;
+            default:
+                return key;
+        }
+    }
+
+    uint64_t key(uint64_t index, int32_t shard_id)const {
+        switch (_policy) {
+            case ShardPartition::MODULO:
+                return index * _shard_num + shard_id;
+            case ShardPartition::RANGE:
+                return index + shard_id * _range;
+            default:
+                return index;
+        }
+    }
+
+private:
+    // Lamping and Veach, A Fast, Minimal Memory, Consistent Hash Algorithm.
+    static int32_t jump_hash(uint64_t key, int32_t num_buckets) {
+        int64_t b = -1, j = 0;
+        while (j < num_buckets) {
+            b = j;
+            key = key * 2862933555777941757ull + 1;
+            j = (b + 1) * (double(1ll << 31) / double((key >> 33) + 1));
+        }
+        return b;
+    }
+
+    int _policy = ShardPartition::MODULO;
+    uint64_t _shard_num = 1;
+    uint64_t _range = 0;
+};
+
+}
+}
+}
+
+#endif
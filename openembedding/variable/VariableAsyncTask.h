@@ -1,29 +1,65 @@
 #ifndef PARADIGM4_HYPEREMBEDDING_ASYNC_OPERATOR_THREAD_POOL_H
 #define PARADIGM4_HYPEREMBEDDING_ASYNC_OPERATOR_THREAD_POOL_H
 
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <pico-core/SpinLock.h>
-#include <pico-core/RpcChannel.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <thread>
+#include "LockProfiler.h"
 
 namespace paradigm4 {
 namespace pico {
 namespace embedding {
 
-class VariableAsyncTask {
+// Number of unfinished async tasks. Waiters spin briefly, then park on a futex,
+// and the task finishing the last one wakes them.
+class AsyncTaskCounter {
 public:
-    static void wait(std::atomic<size_t>& _counter) {
-        for (int tests = 0; unlikely(_counter.load(std::memory_order_acquire)); ++tests) {
-            if (tests < 128) {
-                cpu_relax();
-            } else {
-                static constexpr std::chrono::microseconds us0{0};
-                std::this_thread::sleep_for(us0);
+    void add() {
+        _count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void sub() {
+        if (_count.fetch_sub(1) == 1 && _waiters.load()) {
+            syscall(SYS_futex, &_count, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+        }
+    }
+
+    size_t count()const {
+        return _count.load(std::memory_order_acquire);
+    }
+
+    // Returns when no task is unfinished.
+    void wait() {
+        for (int tests = 0; tests < 128; ++tests) {
+            if (likely(_count.load(std::memory_order_acquire) == 0)) {
+                return;
             }
+            cpu_relax();
+        }
+        for (uint32_t count = _count.load(); count; count = _count.load()) {
+            // A task finishing after the load either sees the waiter or changes the futex word.
+            _waiters.fetch_add(1);
+            syscall(SYS_futex, &_count, FUTEX_WAIT_PRIVATE, count, nullptr, nullptr, 0);
+            _waiters.fetch_sub(1);
         }
     }
 
+private:
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word should be 32 bits");
+    std::atomic<uint32_t> _count = {0};
+    std::atomic<uint32_t> _waiters = {0};
+};
+
+class VariableAsyncTask {
+public:
     VariableAsyncTask() {}
-    VariableAsyncTask(int thread_id, std::atomic<size_t>& counter, core::RWSpinLock& shard_lock)
+    VariableAsyncTask(int thread_id, AsyncTaskCounter& counter, core::RWSpinLock& shard_lock)
         : _thread_id(thread_id), _counter(&counter), _shard_lock(&shard_lock) {}
     VariableAsyncTask(const VariableAsyncTask&) = delete;
     VariableAsyncTask(VariableAsyncTask&& other) = default;
@@ -54,13 +90,13 @@ public:
         }
         _entity = nullptr;
         _done = nullptr;
-        _counter->fetch_sub(1, std::memory_order_relaxed);
+        _counter->sub();
     }
 
     void set_done(std::function<void()>&& done) {
         SCHECK(_done == nullptr && _counter);
         if (done) {
-            _counter->fetch_add(1, std::memory_order_relaxed);
+            _counter->add();
             _done = std::move(done);
         }
     }
@@ -71,12 +107,16 @@ public:
 
 private:
     size_t _thread_id = 0;
-    std::atomic<size_t>* _counter = nullptr;
+    AsyncTaskCounter* _counter = nullptr;
     core::RWSpinLock* _shard_lock = nullptr;
     std::shared_ptr<void> _entity = nullptr;
     std::function<void()> _done; 
 };
 
+// Tasks are submitted immediately to the queue of thread_id() % threads. An idle worker claims
+// a queue, its own first, and runs its tasks until it is empty, so one queue is never run by two
+// workers and the tasks of a variable run in submission order. Idle workers claim the other
+// queues, so several hot variables are spread over all the cores.
 class VariableAsyncTaskThreadPool {
 public:
     static VariableAsyncTaskThreadPool& singleton() {
@@ -86,75 +126,157 @@ public:
 
     void submit(VariableAsyncTask&& async_task) {
         SCHECK(_initialized);
-        core::lock_guard<core::RWSpinLock> guard(_lock);
-        size_t num_tasks = _num_tasks.load(std::memory_order_relaxed) + 1;
-        _num_tasks.store(num_tasks, std::memory_order_relaxed);
-        _tasks.push_back(std::move(async_task));
-        if (_tasks.size() >= _batch_num_tasks) {
-            for (VariableAsyncTask& task: _tasks) {
-                if (task) {
-                    _channels[task.thread_id() % _threads.size()]->send(std::move(task));
-                }   
-            }
-            _tasks.clear();
+        if (!async_task) {
+            return;
         }
-    }
-
-    // very illformed! TODO: remove
-    void initialize_batch_task() {
-        if (_batch_num_tasks.load(std::memory_order_relaxed) == 0 &&
-              _num_tasks.load(std::memory_order_relaxed) != 0) {
-            core::lock_guard<core::RWSpinLock> guard(_lock);
-            if (_batch_num_tasks.load() == 0) {
-                SLOG(INFO) << "set batch num tasks " << _num_tasks.load();
-                _batch_num_tasks.store(_num_tasks);
+        TaskQueue& queue = *_queues[async_task.thread_id() % _queues.size()];
+        bool ready = false;
+        {
+            core::lock_guard<ProfiledRWSpinLock> guard(queue.lock);
+            queue.tasks.push_back(std::move(async_task));
+            queue.size.store(queue.tasks.size(), std::memory_order_relaxed);
+            ready = !queue.busy && queue.tasks.size() == 1;
+        }
+        if (ready) {
+            _ready.fetch_add(1);
+            if (_sleeping.load()) {
+                std::lock_guard<std::mutex> guard(_mutex);
+                _cv.notify_one();
             }
         }
     }
 
     void initialize(size_t thread_num) {
         SCHECK(!_initialized);
+        SCHECK(thread_num > 0);
         _initialized = true;
-        _num_tasks.store(0);
-        _batch_num_tasks.store(0);
+        _terminated.store(false);
+        _ready.store(0);
+        _steals.store(0);
+        _queues.resize(thread_num);
         _threads.resize(thread_num);
-        _channels.resize(thread_num);
         for (size_t i = 0; i < _threads.size(); ++i) {
-            _channels[i] = std::make_unique<core::RpcChannel<VariableAsyncTask>>();
+            _queues[i] = std::make_unique<TaskQueue>();
+        }
+        for (size_t i = 0; i < _threads.size(); ++i) {
             _threads[i] = std::thread(&VariableAsyncTaskThreadPool::running, this, i);
         }
     }
 
+    // Runs the remaining tasks before the workers exit.
     void finalize() {
         SCHECK(_initialized);
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _terminated.store(true);
+            _cv.notify_all();
+        }
         for (size_t i = 0; i < _threads.size(); ++i) {
-            _channels[i]->terminate();
             _threads[i].join();
         }
+        SLOG(INFO) << "async task pool finalized, " << _steals.load() << " queues stolen";
+        _threads.clear();
+        _queues.clear();
         _initialized = false;
     }
 
 private:
+    struct alignas(64) TaskQueue {
+        ProfiledRWSpinLock lock{"async_task_queue"};
+        std::deque<VariableAsyncTask> tasks;
+        bool busy = false; // claimed by a worker
+        std::atomic<size_t> size = {0}; // read without the lock by thieves
+    };
+
+    bool claim(size_t i) {
+        TaskQueue& queue = *_queues[i];
+        if (queue.size.load(std::memory_order_relaxed) == 0) { // avoids locking empty queues
+            return false;
+        }
+        core::lock_guard<ProfiledRWSpinLock> guard(queue.lock);
+        if (queue.tasks.empty() || queue.busy) {
+            return false;
+        }
+        queue.busy = true;
+        _ready.fetch_sub(1);
+        return true;
+    }
+
+    // The next task of a claimed queue, the queue is released when empty.
+    bool pop(size_t i, VariableAsyncTask& task) {
+        TaskQueue& queue = *_queues[i];
+        core::lock_guard<ProfiledRWSpinLock> guard(queue.lock);
+        if (queue.tasks.empty()) {
+            queue.busy = false;
+            return false;
+        }
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        queue.size.store(queue.tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool claim_any(size_t i, size_t& claimed) {
+        for (size_t k = 0; k < _queues.size(); ++k) {
+            claimed = (i + k) % _queues.size();
+            if (claim(claimed)) {
+                if (k) {
+                    _steals.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
     void running(size_t i) {
-        VariableAsyncTask task;
-        while (_channels[i]->recv(task, -1)) {
-            // must finalize task in loop
-            VariableAsyncTask done = std::move(task); 
-            done.done();
+        for (;;) {
+            size_t claimed;
+            if (claim_any(i, claimed)) {
+                for (;;) {
+                    VariableAsyncTask task;
+                    if (!pop(claimed, task)) {
+                        break;
+                    }
+                    // must finalize task in loop
+                    task.done();
+                }
+                continue;
+            }
+            bool idle = true;
+            for (int tests = 0; tests < 128 && idle; ++tests) {
+                cpu_relax();
+                idle = _ready.load(std::memory_order_relaxed) == 0;
+            }
+            if (!idle) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_terminated.load() && _ready.load() == 0) {
+                // the busy queues are run to the end by their workers
+                return;
+            }
+            _sleeping.fetch_add(1);
+            _cv.wait(lock, [this]() { return _ready.load() || _terminated.load(); });
+            _sleeping.fetch_sub(1);
         }
     }
 
     bool _initialized = false;
     std::vector<std::thread> _threads;
-    std::vector<std::unique_ptr<core::RpcChannel<VariableAsyncTask>>> _channels;
+    std::vector<std::unique_ptr<TaskQueue>> _queues;
 
-    core::RWSpinLock _lock;
-    std::atomic<size_t> _num_tasks = {0};
-    std::atomic<size_t> _batch_num_tasks = {0};
-    std::vector<VariableAsyncTask> _tasks;
+    // Queues with tasks and not claimed. A submitter increases _ready before reading _sleeping,
+    // and a worker increases _sleeping before reading _ready under _mutex, so one of them sees
+    // the other and no wakeup is lost.
+    std::atomic<size_t> _ready = {0};
+    std::atomic<size_t> _sleeping = {0};
+    std::atomic<bool> _terminated = {false};
+    std::atomic<size_t> _steals = {0};
+    std::mutex _mutex;
+    std::condition_variable _cv;
 };
 
-
 }
 }
 }
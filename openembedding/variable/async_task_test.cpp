@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "VariableAsyncTask.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+// Waiters return only after the tasks of their round are all done, also when they sleep on the futex.
+TEST(AsyncTaskCounter, WaitForSubs) {
+    constexpr int ROUNDS = 1000;
+    constexpr int SUBBERS = 4;
+    constexpr int WAITERS = 3;
+    constexpr int TASKS = 1000;
+    AsyncTaskCounter counter;
+    std::atomic<int> done = {0};
+    for (int round = 0; round < ROUNDS; ++round) {
+        done = 0;
+        for (int i = 0; i < TASKS; ++i) {
+            counter.add();
+        }
+        std::vector<std::thread> threads;
+        for (int t = 0; t < SUBBERS; ++t) {
+            threads.emplace_back([&, t]() {
+                if (round % 10 == t) {
+                    // long enough for the waiters to block
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                for (int i = t; i < TASKS; i += SUBBERS) {
+                    done.fetch_add(1);
+                    counter.sub();
+                }
+            });
+        }
+        for (int t = 0; t < WAITERS; ++t) {
+            threads.emplace_back([&]() {
+                counter.wait();
+                EXPECT_EQ(0, counter.count());
+                EXPECT_EQ(TASKS, done.load());
+            });
+        }
+        for (std::thread& thread: threads) {
+            thread.join();
+        }
+    }
+}
+
+// Tasks of one variable run in submission order, also when idle workers take the other queues.
+TEST(VariableAsyncTaskThreadPool, VariableOrder) {
+    constexpr int THREADS = 8;
+    constexpr int VARIABLES = 6; // shared by the submitters, more than the queues
+    constexpr int TASKS = 100000;
+    VariableAsyncTaskThreadPool pool;
+    pool.initialize(4);
+    AsyncTaskCounter counter;
+    std::vector<core::RWSpinLock> locks(VARIABLES);
+    std::vector<std::vector<int>> runs(VARIABLES);
+    // one submitter per variable at a time, so each variable has a submission order
+    std::vector<std::vector<int>> submits(VARIABLES);
+    std::vector<core::RWSpinLock> submit_locks(VARIABLES);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 gen(t);
+            for (int i = 0; i < TASKS; ++i) {
+                int variable_id = gen() % VARIABLES;
+                int value = t * TASKS + i;
+                int work = gen() % 20;
+                core::lock_guard<core::RWSpinLock> guard(submit_locks[variable_id]);
+                submits[variable_id].push_back(value);
+                VariableAsyncTask task(variable_id, counter, locks[variable_id]);
+                task.set_done([&runs, variable_id, value, work]() {
+                    for (volatile int k = 0; k < work; k = k + 1);
+                    runs[variable_id].push_back(value);
+                });
+                pool.submit(std::move(task));
+            }
+        });
+    }
+    for (std::thread& thread: threads) {
+        thread.join();
+    }
+    counter.wait();
+    EXPECT_EQ(0, counter.count());
+    pool.finalize();
+    for (int variable_id = 0; variable_id < VARIABLES; ++variable_id) {
+        EXPECT_EQ(submits[variable_id], runs[variable_id]);
+    }
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "EmbeddingTable.h"
+#include "EmbeddingOptimizerVariable.h"
+
+namespace paradigm4 {
+namespace pico {
+namespace embedding {
+
+template<class Table>
+void test_dirty_keys(Table& table) {
+    core::vector<uint64_t> keys;
+    for (uint64_t key: {1, 5, 9}) {
+        table.set_value(key)[0] = key;
+        table.mark_dirty(key);
+    }
+    // not tracked before the first take
+    ASSERT_FALSE(table.take_dirty_keys(keys));
+    ASSERT_TRUE(keys.empty());
+
+    for (uint64_t key: {9, 2, 5, 9}) {
+        table.set_value(key)[0] = key;
+        table.mark_dirty(key);
+    }
+    ASSERT_TRUE(table.take_dirty_keys(keys));
+    std::sort(keys.begin(), keys.end());
+    EXPECT_EQ(core::vector<uint64_t>({2, 5, 9}), keys);
+
+    keys.clear();
+    ASSERT_TRUE(table.take_dirty_keys(keys));
+    EXPECT_TRUE(keys.empty());
+
+    table.mark_dirty(1);
+    ASSERT_TRUE(table.take_dirty_keys(keys));
+    EXPECT_EQ(core::vector<uint64_t>({1}), keys);
+    EXPECT_EQ(1, table.get_value(1)[0]);
+}
+
+TEST(EmbeddingHashTable, TakeDirtyKeys) {
+    EmbeddingHashTable<uint64_t, float> table(4, -1);
+    test_dirty_keys(table);
+}
+
+TEST(EmbeddingArrayTable, TakeDirtyKeys) {
+    EmbeddingArrayTable<uint64_t, float> table(4, -1);
+    table.reserve_items(16);
+    test_dirty_keys(table);
+}
+
+TEST(EmbeddingArrayTable, TakeDirtyKeysAfterGrow) {
+    EmbeddingArrayTable<uint64_t, float> table(4, -1);
+    core::vector<uint64_t> keys;
+    ASSERT_FALSE(table.take_dirty_keys(keys));
+    // rows set beyond the reserved items grow the dirty bitmap
+    table.set_value(100)[0] = 1;
+    table.mark_dirty(100);
+    ASSERT_TRUE(table.take_dirty_keys(keys));
+    EXPECT_EQ(core::vector<uint64_t>({100}), keys);
+}
+
+template<class Table>
+void test_snapshot() {
+    using Variable = EmbeddingOptimizerVariable<Table, EmbeddingDefaultOptimizer<float>>;
+    Variable variable(2, -1);
+    variable.embedding_table()->reserve_items(16);
+    core::vector<uint64_t> keys = {1, 2};
+    core::vector<float> weights = {1, 1, 2, 2};
+    variable.set_weights(keys.data(), keys.size(), weights.data(), nullptr);
+
+    ASSERT_TRUE(variable.begin_snapshot());
+    // an overlapping dump falls back to the locked dump
+    ASSERT_FALSE(variable.begin_snapshot());
+    EXPECT_EQ(2, variable.snapshot_num_keys());
+
+    // rows changed and created during the dump
+    keys = {2, 3};
+    weights = {5, 5, 3, 3};
+    variable.set_weights(keys.data(), keys.size(), weights.data(), nullptr);
+
+    keys.assign(4, 0);
+    keys.resize(variable.read_snapshot_keys(keys.data(), keys.size()));
+    std::sort(keys.begin(), keys.end());
+    ASSERT_EQ(core::vector<uint64_t>({1, 2}), keys);
+    weights.assign(4, 0);
+    variable.get_snapshot_weights(keys.data(), keys.size(), weights.data(), nullptr);
+    EXPECT_EQ(core::vector<float>({1, 1, 2, 2}), weights);
+    variable.end_snapshot();
+
+    ASSERT_TRUE(variable.begin_snapshot());
+    EXPECT_EQ(3, variable.snapshot_num_keys());
+    keys = {2, 3};
+    variable.get_snapshot_weights(keys.data(), keys.size(), weights.data(), nullptr);
+    EXPECT_EQ(core::vector<float>({5, 5, 3, 3}), weights);
+    variable.end_snapshot();
+}
+
+TEST(EmbeddingOptimizerVariable, HashTableSnapshot) {
+    test_snapshot<EmbeddingHashTable<uint64_t, float>>();
+}
+
+TEST(EmbeddingOptimizerVariable, ArrayTableSnapshot) {
+    test_snapshot<EmbeddingArrayTable<uint64_t, float>>();
+}
+
+}
+
+// Rows and states copied by several threads are the rows of the old variable, and
+// the states are initialized if the optimizer changed.
+template<class Table, class Optimizer>
+void test_copy_rows(size_t threads) {
+    using Adagrad = EmbeddingAdagradOptimizer<float>;
+    constexpr size_t DIM = 4;
+    constexpr size_t NUM = 10000; // not a multiple of the blocks read by the copy
+    EmbeddingOptimizerVariable<EmbeddingHashTable<uint64_t, float>, Adagrad> source(DIM, -1);
+    core::vector<uint64_t> keys;
+    core::vector<float> weights, states;
+    for (uint64_t i = 0; i < NUM; ++i) {
+        keys.push_back(i * 3);
+        for (size_t j = 0; j < DIM; ++j) {
+            weights.push_back(i + j);
+            states.push_back(-1.0 * i - j);
+        }
+    }
+    source.set_weights(keys.data(), keys.size(), weights.data(), states.data());
+
+    // the states a new row of the optimizer is initialized with
+    EmbeddingOptimizerVariable<Table, Optimizer> expected(DIM, -1);
+    size_t state_dim = expected.embedding_optimizer()->state_dim(DIM);
+    if (expected.embedding_optimizer()->category() != source.embedding_optimizer()->category()) {
+        expected.set_weights(keys.data(), keys.size(), weights.data(), nullptr);
+        states.resize(keys.size() * state_dim);
+        expected.get_weights(keys.data(), keys.size(), weights.data(), states.data());
+    }
+
+    EmbeddingOptimizerVariable<Table, Optimizer> variable(DIM, -1);
+    variable.copy_from(std::move(source), 64, threads);
+    ASSERT_EQ(NUM, variable.embedding_table()->num_items());
+    core::vector<float> copied_weights(weights.size()), copied_states(states.size());
+    variable.get_weights(keys.data(), keys.size(), copied_weights.data(), copied_states.data());
+    EXPECT_EQ(weights, copied_weights);
+    EXPECT_EQ(states, copied_states);
+}
+
+TEST(EmbeddingOptimizerVariable, CopyRows) {
+    for (size_t threads: {1, 4, 7}) {
+        test_copy_rows<EmbeddingHashTable<uint64_t, float>, EmbeddingAdagradOptimizer<float>>(threads);
+        test_copy_rows<EmbeddingArrayTable<uint64_t, float>, EmbeddingAdagradOptimizer<float>>(threads);
+        test_copy_rows<EmbeddingHashTable<uint64_t, float>, EmbeddingAdamOptimizer<float>>(threads);
+        test_copy_rows<EmbeddingArrayTable<uint64_t, float>, EmbeddingAdamOptimizer<float>>(threads);
+    }
+}
+
+}
+}
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    int ret = RUN_ALL_TESTS();
+    return ret;
+}
@@ -144,7 +144,121 @@ TEST(PmemEmbeddingTable, SingleCheckpoint) {
     core::FileSystem::rmrf(pmem_pool_root_path);
 }
 
+// Sets 16 hot keys twice, scans 1000 cold keys, then sets the hot keys again, returns the hits.
+size_t scan_hot_hits(const std::string& cache_policy) {
+    PersistManager::singleton().initialize(pmem_pool_root_path);
+    PmemEmbeddingHashTable<uint64_t,double> pt(64, -1);
+    PersistManager::singleton().dynamic_cache.set_cache_size(pt.cache_item_memory_cost() * 64);
+    EXPECT_TRUE(pt.set_cache_policy(cache_policy));
+    for (size_t round = 0; round < 2; ++round) {
+        for (uint64_t key = 0; key < 16; ++key) {
+            pt.set_value(key)[0] = key;
+        }
+        pt.next_work();
+    }
+    for (uint64_t key = 100; key < 1100; ++key) {
+        pt.set_value(key)[0] = key;
+        pt.next_work();
+    }
+    size_t hit_count = pt.hit_count();
+    for (uint64_t key = 0; key < 16; ++key) {
+        EXPECT_EQ(double(key), pt.set_value(key)[0]);
+    }
+    pt.next_work();
+    core::FileSystem::rmrf(pmem_pool_root_path);
+    return pt.hit_count() - hit_count;
+}
+
+TEST(PmemEmbeddingTable, IncrementalCheckpointFlush) {
+    PersistManager::singleton().initialize(pmem_pool_root_path);
+    PmemEmbeddingHashTable<uint64_t,double> pt(64, -1);
+    PersistManager::singleton().dynamic_cache.set_cache_size(pt.cache_item_memory_cost() * 64);
+    for (uint64_t key = 0; key < 10; ++key) {
+        pt.set_value(key)[0] = key;
+        pt.next_work();
+    }
+    pt.start_commit_checkpoint();
+    EXPECT_EQ(1, pt.pending_checkpoints().size());
+    EXPECT_EQ(4, pt.flush_committing_items(4));
+    EXPECT_EQ(1, pt.pending_checkpoints().size());
+    EXPECT_EQ(4, pt.flush_committing_items(4));
+    EXPECT_EQ(2, pt.flush_committing_items(4));
+    EXPECT_EQ(0, pt.pending_checkpoints().size());
+    EXPECT_EQ(1, pt.checkpoints().size());
+    EXPECT_EQ(0, pt.flush_committing_items(4));
+    for (uint64_t key = 0; key < 10; ++key) {
+        EXPECT_EQ(double(key), pt.get_value(key)[0]);
+    }
+    core::FileSystem::rmrf(pmem_pool_root_path);
+}
 
+TEST(PmemEmbeddingTable, ShrinkCacheToBudget) {
+    PersistManager::singleton().initialize(pmem_pool_root_path);
+    PmemEmbeddingHashTable<uint64_t,double> pt(64, -1);
+    size_t cost = pt.cache_item_memory_cost();
+    PersistManager::singleton().dynamic_cache.set_cache_size(cost * 128);
+    for (uint64_t key = 0; key < 128; ++key) {
+        pt.set_value(key)[0] = key;
+        pt.next_work();
+    }
+    EXPECT_EQ(130, pt.num_cache_items()); // with the heads of the segments
+    pt.cache_budget().target.store(cost * 32);
+    pt.next_work();
+    EXPECT_EQ(34, pt.num_cache_items());
+    EXPECT_EQ(cost * 32, pt.cache_budget().used.load());
+    for (uint64_t key = 0; key < 128; ++key) {
+        EXPECT_EQ(double(key), pt.get_value(key)[0]);
+    }
+    EXPECT_EQ(0, pt.cache_budget().ghost_hits.load());
+    pt.set_value(0);
+    EXPECT_EQ(1, pt.cache_budget().ghost_hits.load());
+    core::FileSystem::rmrf(pmem_pool_root_path);
+}
+
+TEST(PmemEmbeddingTable, CacheBudgetController) {
+    PersistManager::CacheBudgetController controller;
+    auto cold = controller.add_budget();
+    auto hot = controller.add_budget();
+    for (auto& budget: {cold, hot}) {
+        budget->used.store(50);
+        budget->ghost_bytes.store(10);
+    }
+    controller.redistribute(200);
+    EXPECT_EQ(std::numeric_limits<size_t>::max(), hot->target.load()); // not full
+    hot->ghost_hits.store(5);
+    controller.redistribute(100);
+    EXPECT_EQ(45, cold->target.load());
+    EXPECT_EQ(55, hot->target.load());
+    EXPECT_EQ(0, hot->ghost_hits.load());
+
+    // a pool added when full gets a fair share, the others are scaled down
+    auto added = controller.add_budget();
+    controller.redistribute(100);
+    EXPECT_EQ(33, added->target.load());
+    EXPECT_EQ(30, cold->target.load());
+    EXPECT_EQ(36, hot->target.load());
+
+    // the cache of a removed pool is handed back
+    controller.remove_budget(hot);
+    controller.redistribute(100);
+    EXPECT_EQ(48, cold->target.load());
+    EXPECT_EQ(51, added->target.load());
+
+    // pools grow greedily again after all are removed
+    controller.remove_budget(cold);
+    controller.remove_budget(added);
+    auto fresh = controller.add_budget();
+    controller.redistribute(100);
+    EXPECT_EQ(std::numeric_limits<size_t>::max(), fresh->target.load());
+}
+
+TEST(PmemEmbeddingTable, ScanResistantCachePolicy) {
+    EXPECT_EQ(0, scan_hot_hits("lru"));
+    EXPECT_EQ(16, scan_hot_hits("2q"));
+    PmemEmbeddingHashTable<uint64_t,double> pt(64, -1);
+    EXPECT_FALSE(pt.set_cache_policy("clock"));
+    EXPECT_EQ("lru", pt.cache_policy());
+}
 
 }
 }